@@ -509,6 +509,9 @@ public:
 
   inline bool valid() const { return _max.x() > _min.x() && _max.y() > _min.y() && _max.z() > _min.z(); }
 
+  // nothing expanded it yet. a flat or single point box is not empty, though it is not valid either
+  inline bool empty() const { return _max.x() < _min.x() || _max.y() < _min.y() || _max.z() < _min.z(); }
+
 private:
   Tvec3<T> _min, _max;
 };
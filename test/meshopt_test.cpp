@@ -0,0 +1,152 @@
+#include "MeshoptDecoder.h"
+
+#include <cstdio>
+#include <cstring>
+
+// index buffers and their encodings from meshoptimizer's own tests, so the bytes come from the reference encoder
+
+// 4 6 5 leaves next at 6, the last triangle cannot continue the sequence
+static const unsigned int index_buffer[] = {0, 1, 2, 2, 1, 3, 4, 6, 5, 7, 8, 9};
+
+static const unsigned char index_data_v0[] = {
+  0xe0, 0xf0, 0x10, 0xfe, 0xff, 0xf0, 0x0c, 0xff, 0x02, 0x02, 0x02, 0x00, 0x76, 0x87, 0x56, 0x67,
+  0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+};
+
+// the second 0 1 2 restarts the sequence with a zero aux byte, 5 and 4 are coded against the last index
+static const unsigned int index_buffer_tricky[] = {0, 1, 2, 2, 1, 3, 0, 1, 2, 2, 1, 5, 2, 1, 4};
+
+static const unsigned char index_data_v1[] = {
+  0xe1, 0xf0, 0x10, 0xfe, 0x1f, 0x3d, 0x00, 0x0a, 0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86,
+  0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+};
+
+// 51 and 49 go through the second baseline, 1000 needs a two byte vbyte
+static const unsigned int index_sequence[] = {0, 1, 51, 2, 49, 1000};
+
+static const unsigned char index_sequence_v1[] = {
+  0xd1, 0x00, 0x04, 0xcd, 0x01, 0x04, 0x07, 0x98, 0x1f, 0x00, 0x00, 0x00, 0x00,
+};
+
+// vertex streams encoded by hand to the EXT_meshopt_compression layout, the smallest group mode every time.
+// the first one is the vertex buffer of meshoptimizer's tests
+
+// px py pz (u16), nu nv (u8), tx ty (u16): 2 bit groups with escapes and all zero channels
+static const unsigned char vertex_buffer[] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0x2c, 0x01, 0, 0, 0, 0, 0, 0, 0xf4, 0x01, 0, 0,
+  0, 0, 0x2c, 0x01, 0, 0, 0, 0, 0, 0, 0xf4, 0x01,
+  0x2c, 0x01, 0x2c, 0x01, 0, 0, 0, 0, 0xf4, 0x01, 0xf4, 0x01,
+};
+
+static const unsigned char vertex_data_v0[] = {
+  0xa0, 0x01, 0x3f, 0x00, 0x00, 0x00, 0x58, 0x57, 0x58, 0x01, 0x26, 0x00, 0x00, 0x00, 0x01, 0x0c,
+  0x00, 0x00, 0x00, 0x58, 0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x3f, 0x00,
+  0x00, 0x00, 0x17, 0x18, 0x17, 0x01, 0x26, 0x00, 0x00, 0x00, 0x01, 0x0c, 0x00, 0x00, 0x00, 0x17,
+  0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// 20 vertices of {0, i, 5i, 37i^2 + 11}: two groups per channel, one with every group mode (0, 2, 4 and 8 bits)
+static const unsigned char vertex_groups_v0[] = {
+  0xa0, 0x00, 0x05, 0x2a, 0xaa, 0xaa, 0xaa, 0xaa, 0x00, 0x00, 0x00, 0x06, 0x0a, 0xaa, 0xaa, 0xaa,
+  0xaa, 0xaa, 0xaa, 0xaa, 0xff, 0x00, 0x00, 0x00, 0x0a, 0x0a, 0x0a, 0x0a, 0x07, 0x00, 0x4a, 0xde,
+  0x8d, 0x06, 0x9a, 0xd1, 0x3d, 0x56, 0xea, 0x81, 0x12, 0xa6, 0xc5, 0x31, 0x62, 0xff, 0x00, 0x00,
+  0x00, 0xf6, 0x75, 0x1e, 0xb2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x0b,
+};
+
+// filter inputs and outputs from meshoptimizer's own tests, the fourth component passes through oct untouched
+static const unsigned char oct8_data[] = {0, 1, 127, 0, 0, 187, 127, 1, 255, 1, 127, 0, 14, 130, 127, 1};
+static const unsigned char oct8_expected[] = {0, 1, 127, 0, 0, 159, 82, 1, 255, 1, 127, 0, 1, 130, 241, 1};
+
+static const unsigned short oct12_data[] = {0, 1, 2047, 0, 0, 1870, 2047, 1, 2017, 1, 2047, 0, 14, 1300, 2047, 1};
+static const unsigned short oct12_expected[] = {
+  0, 16, 32767, 0, 0, 32621, 3088, 1, 32764, 16, 471, 0, 307, 28541, 16093, 1,
+};
+
+static const unsigned short quat12_data[] = {
+  0, 1, 0, 0x7fc, 0, 1870, 0, 0x7fd, 2017, 1, 0, 0x7fe, 14, 1300, 0, 0x7ff,
+};
+static const unsigned short quat12_expected[] = {
+  32767, 0, 11, 0, 0, 25013, 0, 21166, 11, 0, 23504, 22830, 158, 14715, 0, 29277,
+};
+
+// 0, 1.5, -36 and 2097151.75 as float bits
+static const unsigned int exp_data[] = {0, 0xff000003, 0x02fffff7, 0xfe7fffff};
+static const unsigned int exp_expected[] = {0, 0x3fc00000, 0xc2100000, 0x49fffffe};
+
+static int failures = 0;
+
+static void report(const char *name, bool ok)
+{
+  printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+  failures += !ok;
+}
+
+static void check(const char *name, const unsigned int *expected, size_t count, const unsigned char *data, size_t size)
+{
+  unsigned int decoded[16] = {};
+  unsigned short decoded16[16] = {};
+  bool ok = meshopt::decode_index_buffer(decoded, count, 4, data, size) && memcmp(decoded, expected, count * 4) == 0;
+  ok = ok && meshopt::decode_index_buffer(decoded16, count, 2, data, size);
+  for (size_t i = 0; ok && i < count; i++)
+    ok = decoded16[i] == expected[i];
+  report(name, ok);
+}
+
+static void check_sequence(const char *name, const unsigned int *expected, size_t count, const unsigned char *data, size_t size)
+{
+  unsigned int decoded[16] = {};
+  unsigned short decoded16[16] = {};
+  bool ok = meshopt::decode_index_sequence(decoded, count, 4, data, size) && memcmp(decoded, expected, count * 4) == 0;
+  ok = ok && meshopt::decode_index_sequence(decoded16, count, 2, data, size);
+  for (size_t i = 0; ok && i < count; i++)
+    ok = decoded16[i] == expected[i];
+  report(name, ok);
+}
+
+static void check_vertices(const char *name, const unsigned char *expected, size_t count, size_t vertex_size,
+                           const unsigned char *data, size_t size)
+{
+  unsigned char decoded[256] = {};
+  bool ok = meshopt::decode_vertex_buffer(decoded, count, vertex_size, data, size) &&
+            memcmp(decoded, expected, count * vertex_size) == 0;
+  // a stream cut short must be rejected, not read past
+  ok = ok && !meshopt::decode_vertex_buffer(decoded, count, vertex_size, data, size - 1);
+  report(name, ok);
+}
+
+static void check_filter(const char *name, meshopt::Filter filter, const void *input, const void *expected, size_t count,
+                         size_t stride)
+{
+  unsigned char decoded[64] = {};
+  memcpy(decoded, input, count * stride);
+  bool ok = meshopt::apply_filter(filter, decoded, count, stride) && memcmp(decoded, expected, count * stride) == 0;
+  report(name, ok);
+}
+
+int main()
+{
+  check("index buffer v0", index_buffer, 12, index_data_v0, sizeof(index_data_v0));
+  check("index buffer v1 restart", index_buffer_tricky, 15, index_data_v1, sizeof(index_data_v1));
+  check_sequence("index sequence v1", index_sequence, 6, index_sequence_v1, sizeof(index_sequence_v1));
+
+  check_vertices("vertex buffer v0", vertex_buffer, 4, 12, vertex_data_v0, sizeof(vertex_data_v0));
+  unsigned char groups[20 * 4];
+  for (unsigned int i = 0; i < 20; i++) {
+    groups[i * 4 + 0] = 0;
+    groups[i * 4 + 1] = (unsigned char)i;
+    groups[i * 4 + 2] = (unsigned char)(i * 5);
+    groups[i * 4 + 3] = (unsigned char)(i * i * 37 + 11);
+  }
+  check_vertices("vertex buffer v0 group modes", groups, 20, 4, vertex_groups_v0, sizeof(vertex_groups_v0));
+
+  check_filter("filter oct8", meshopt::Filter::Octahedral, oct8_data, oct8_expected, 4, 4);
+  check_filter("filter oct12", meshopt::Filter::Octahedral, oct12_data, oct12_expected, 4, 8);
+  check_filter("filter quat12", meshopt::Filter::Quaternion, quat12_data, quat12_expected, 4, 8);
+  check_filter("filter exp", meshopt::Filter::Exponential, exp_data, exp_expected, 1, 16);
+  return failures ? 1 : 0;
+}
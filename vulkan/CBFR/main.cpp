@@ -490,9 +490,9 @@ public:
 
 
     uint8_t *data = 0;
-    VK_CHECK_RESULT(vkMapMemory(*_device, _ubo_buf->memory(), sz, sizeof(lights_ubo), 0, (void **)&data));
+    data = _ubo_buf->map() + sz;
     memcpy(data, &lights_ubo, sizeof(lights_ubo));
-    vkUnmapMemory(*_device, _ubo_buf->memory());
+    _ubo_buf->unmap();
 
     {
       decltype(material_ubo) mate_bufs[49];
@@ -504,9 +504,9 @@ public:
       }
 
       uint8_t *data = 0;
-      VK_CHECK_RESULT(vkMapMemory(*_device, _material_buf->memory(), 0, _material_buf->size(), 0, (void **)&data));
+      data = _material_buf->map();
       memcpy(data, &mate_bufs, _material_buf->size());
-      vkUnmapMemory(*_device, _material_buf->memory());
+      _material_buf->unmap();
     }
   }
 
@@ -619,7 +619,7 @@ public:
     pipelineCreateInfo.pDepthStencilState = &depthStencilState;
     pipelineCreateInfo.pDynamicState = &dynamicState;
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+    _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo, "cbfr");
 
     vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
     vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
@@ -633,9 +633,9 @@ public:
     matrix_ubo.prj = tg::perspective<float>(fov, float(_w) / _h, 0.1, 1000);
     // tg::near_clip(matrix_ubo.prj, tg::vec4(0, 0, -1, 0.5));
     uint8_t *data = 0;
-    VK_CHECK_RESULT(vkMapMemory(*_device, _ubo_buf->memory(), 0, sizeof(matrix_ubo), 0, (void **)&data));
+    data = _ubo_buf->map();
     memcpy(data, &matrix_ubo, sizeof(matrix_ubo));
-    vkUnmapMemory(*_device, _ubo_buf->memory());
+    _ubo_buf->unmap();
   }
 
   void create_sphere()
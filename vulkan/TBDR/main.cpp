@@ -77,8 +77,6 @@ public:
     if(_mesh)
       _mesh->create_pipeline(render_pass());
 
-    build_command_buffers();
-
     update_frame();
   }
 
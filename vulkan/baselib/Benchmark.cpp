@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+CameraPath CameraPath::orbit(const tg::vec3 &center, float radius, float height, uint32_t keys)
+{
+  CameraPath path;
+  keys = std::max(keys, 2u);
+  for (uint32_t i = 0; i < keys; i++) {
+    // the last key closes the circle
+    float a = 2 * float(M_PI) * i / (keys - 1);
+    tg::vec3 eye = center + tg::vec3(radius * cos(a), radius * sin(a), height);
+    path.add({eye, center, tg::vec3(0, 0, 1)});
+  }
+  return path;
+}
+
+CameraPath::Key CameraPath::sample(float t) const
+{
+  if (_keys.size() < 2)
+    return _keys.empty() ? Key{tg::vec3(0, -5, 0), tg::vec3(0), tg::vec3(0, 0, 1)} : _keys.front();
+
+  float x = std::clamp(t, 0.f, 1.f) * (_keys.size() - 1);
+  size_t i = std::min(size_t(x), _keys.size() - 2);
+  float f = x - i;
+  auto &a = _keys[i], &b = _keys[i + 1];
+  return {a.eye + (b.eye - a.eye) * f, a.pos + (b.pos - a.pos) * f, tg::normalize(a.up + (b.up - a.up) * f)};
+}
+
+bool CameraPath::load(const std::string &file)
+{
+  std::ifstream in(file);
+  if (!in)
+    return false;
+
+  std::vector<Key> keys;
+  Key k;
+  while (in >> k.eye.x() >> k.eye.y() >> k.eye.z() >> k.pos.x() >> k.pos.y() >> k.pos.z() >> k.up.x() >> k.up.y() >> k.up.z())
+    keys.push_back(k);
+  if (keys.empty())
+    return false;
+  _keys = std::move(keys);
+  return true;
+}
+
+bool CameraPath::save(const std::string &file) const
+{
+  std::ofstream out(file, std::ios::trunc);
+  if (!out)
+    return false;
+  for (auto &k : _keys) {
+    out << k.eye.x() << " " << k.eye.y() << " " << k.eye.z() << " " << k.pos.x() << " " << k.pos.y() << " " << k.pos.z() << " "
+        << k.up.x() << " " << k.up.y() << " " << k.up.z() << "\n";
+  }
+  return bool(out);
+}
+
+BenchmarkReport::Summary BenchmarkReport::summarize(std::vector<double> samples)
+{
+  Summary s;
+  s.count = samples.size();
+  if (samples.empty())
+    return s;
+
+  std::sort(samples.begin(), samples.end());
+  // nearest rank
+  auto rank = [&](double p) { return samples[std::min(samples.size() - 1, size_t(std::ceil(p * samples.size())) - 1)]; };
+  double sum = 0;
+  for (auto v : samples)
+    sum += v;
+  s.avg = sum / samples.size();
+  s.min = samples.front();
+  s.max = samples.back();
+  s.p50 = rank(0.5);
+  s.p95 = rank(0.95);
+  s.p99 = rank(0.99);
+  return s;
+}
+
+void BenchmarkReport::set_info(const std::string &device, int w, int h, uint32_t frames)
+{
+  _device = device;
+  _w = w;
+  _h = h;
+  _frames = frames;
+}
+
+std::string BenchmarkReport::json() const
+{
+  auto summary = [](std::ostringstream &out, const char *name, const std::vector<double> &samples) {
+    auto s = summarize(samples);
+    out << "  \"" << name << "\": {\"samples\": " << s.count << ", \"avg\": " << s.avg << ", \"min\": " << s.min << ", \"p50\": " << s.p50
+        << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "},\n";
+  };
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\n";
+  out << "  \"device\": \"" << _device << "\",\n";
+  if (!_mode.empty())
+    out << "  \"mode\": \"" << _mode << "\",\n";
+  out << "  \"width\": " << _w << ",\n";
+  out << "  \"height\": " << _h << ",\n";
+  out << "  \"frames\": " << _frames << ",\n";
+  summary(out, "cpu_ms", _cpu);
+  summary(out, "gpu_ms", _gpu);
+  out << "  \"passes\": [";
+  for (size_t i = 0; i < _passes.size(); i++)
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << _passes[i].name << "\", \"avg_ms\": " << _passes[i].avg_ms << "}";
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+bool BenchmarkReport::write(const std::string &file) const
+{
+  std::ofstream out(file, std::ios::trunc);
+  if (!out)
+    return false;
+  out << json();
+  return bool(out);
+}
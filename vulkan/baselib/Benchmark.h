@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tmath.h"
+
+// camera poses over a run, sampled linearly between evenly spaced keys.
+// stored as text, one "eye pos up" line of nine numbers per key.
+class CameraPath {
+public:
+  struct Key {
+    tg::vec3 eye;
+    tg::vec3 pos;
+    tg::vec3 up;
+  };
+
+  // a circle around center at the given radius and height, z up
+  static CameraPath orbit(const tg::vec3 &center, float radius, float height, uint32_t keys = 64);
+
+  void add(const Key &key) { _keys.push_back(key); }
+  void clear() { _keys.clear(); }
+  bool empty() const { return _keys.empty(); }
+  size_t size() const { return _keys.size(); }
+
+  // t from 0 at the first key to 1 at the last
+  Key sample(float t) const;
+
+  bool load(const std::string &file);
+  bool save(const std::string &file) const;
+
+private:
+  std::vector<Key> _keys;
+};
+
+// timings of a benchmark run, written as json
+class BenchmarkReport {
+public:
+  struct Summary {
+    size_t count = 0;
+    double avg = 0, min = 0, max = 0;
+    double p50 = 0, p95 = 0, p99 = 0;
+  };
+
+  struct Pass {
+    std::string name;
+    double avg_ms;
+  };
+
+  static Summary summarize(std::vector<double> samples);
+
+  void set_info(const std::string &device, int w, int h, uint32_t frames);
+  // what the run is compared by, e.g. how passes are begun
+  void set_mode(const std::string &mode) { _mode = mode; }
+  void add_cpu(double ms) { _cpu.push_back(ms); }
+  void add_gpu(double ms) { _gpu.push_back(ms); }
+  void add_pass(const std::string &name, double avg_ms) { _passes.push_back({name, avg_ms}); }
+
+  std::string json() const;
+  bool write(const std::string &file) const;
+
+private:
+  std::string _device;
+  std::string _mode;
+  int _w = 0, _h = 0;
+  uint32_t _frames = 0;
+  std::vector<double> _cpu, _gpu;
+  std::vector<Pass> _passes;
+};
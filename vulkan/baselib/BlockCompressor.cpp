@@ -0,0 +1,881 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace tex {
+
+namespace {
+
+struct Block {
+  float px[16][4];
+};
+
+void fetch_block(const uint8_t *rgba, uint32_t w, uint32_t h, uint32_t bx, uint32_t by, Block &blk)
+{
+  for (uint32_t y = 0; y < 4; y++) {
+    uint32_t sy = std::min(by * 4 + y, h - 1);
+    for (uint32_t x = 0; x < 4; x++) {
+      uint32_t sx = std::min(bx * 4 + x, w - 1);
+      const uint8_t *p = rgba + (size_t(sy) * w + sx) * 4;
+      for (int c = 0; c < 4; c++)
+        blk.px[y * 4 + x][c] = p[c];
+    }
+  }
+}
+
+// principal axis of the block over the first n channels, returns false for a flat block
+bool principal_axis(const Block &blk, int n, float mean[4], float axis[4])
+{
+  for (int c = 0; c < 4; c++)
+    mean[c] = axis[c] = 0.f;
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < n; c++)
+      mean[c] += blk.px[i][c] / 16.f;
+
+  float cov[4][4] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[4];
+    for (int c = 0; c < n; c++)
+      d[c] = blk.px[i][c] - mean[c];
+    for (int r = 0; r < n; r++)
+      for (int c = 0; c < n; c++)
+        cov[r][c] += d[r] * d[c];
+  }
+
+  float v[4] = {1.f, 1.f, 1.f, 1.f};
+  for (int iter = 0; iter < 8; iter++) {
+    float t[4] = {};
+    for (int r = 0; r < n; r++)
+      for (int c = 0; c < n; c++)
+        t[r] += cov[r][c] * v[c];
+    float len = 0.f;
+    for (int c = 0; c < n; c++)
+      len = std::max(len, std::fabs(t[c]));
+    if (len < 1e-6f)
+      return false;
+    for (int c = 0; c < n; c++)
+      v[c] = t[c] / len;
+  }
+
+  float len = 0.f;
+  for (int c = 0; c < n; c++)
+    len += v[c] * v[c];
+  len = std::sqrt(len);
+  for (int c = 0; c < n; c++)
+    axis[c] = v[c] / len;
+  return true;
+}
+
+// endpoints along the principal axis, slightly inset to trade extremes for the bulk of the block
+void fit_endpoints(const Block &blk, int n, float e0[4], float e1[4])
+{
+  float mean[4], axis[4];
+  if (!principal_axis(blk, n, mean, axis)) {
+    for (int c = 0; c < 4; c++)
+      e0[c] = e1[c] = mean[c];
+    return;
+  }
+
+  float tmin = std::numeric_limits<float>::max(), tmax = -tmin;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.f;
+    for (int c = 0; c < n; c++)
+      t += (blk.px[i][c] - mean[c]) * axis[c];
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  float inset = (tmax - tmin) / 32.f;
+  tmin += inset;
+  tmax -= inset;
+
+  for (int c = 0; c < n; c++) {
+    e0[c] = std::clamp(mean[c] + axis[c] * tmax, 0.f, 255.f);
+    e1[c] = std::clamp(mean[c] + axis[c] * tmin, 0.f, 255.f);
+  }
+}
+
+// least squares endpoints for fixed interpolation weights (weight of e0 per pixel)
+bool refine_endpoints(const Block &blk, int n, const float *weights, float e0[4], float e1[4])
+{
+  float aa = 0.f, ab = 0.f, bb = 0.f, ap[4] = {}, bp[4] = {};
+  for (int i = 0; i < 16; i++) {
+    float a = weights[i], b = 1.f - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < n; c++) {
+      ap[c] += a * blk.px[i][c];
+      bp[c] += b * blk.px[i][c];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if (std::fabs(det) < 1e-6f)
+    return false;
+  for (int c = 0; c < n; c++) {
+    e0[c] = std::clamp((ap[c] * bb - bp[c] * ab) / det, 0.f, 255.f);
+    e1[c] = std::clamp((bp[c] * aa - ap[c] * ab) / det, 0.f, 255.f);
+  }
+  return true;
+}
+
+template <int N>
+int nearest(const float *px, const int (*palette)[4], int count, float &err)
+{
+  int best = 0;
+  err = std::numeric_limits<float>::max();
+  for (int k = 0; k < count; k++) {
+    float d = 0.f;
+    for (int c = 0; c < N; c++) {
+      float t = px[c] - palette[k][c];
+      d += t * t;
+    }
+    if (d < err) {
+      err = d;
+      best = k;
+    }
+  }
+  return best;
+}
+
+/* BC1 colour block */
+
+uint16_t pack_565(const float c[4])
+{
+  int r = std::clamp(int(c[0] * 31.f / 255.f + 0.5f), 0, 31);
+  int g = std::clamp(int(c[1] * 63.f / 255.f + 0.5f), 0, 63);
+  int b = std::clamp(int(c[2] * 31.f / 255.f + 0.5f), 0, 31);
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpack_565(uint16_t v, int c[4])
+{
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+  c[3] = 255;
+}
+
+void bc1_palette(uint16_t c0, uint16_t c1, bool four_color, int palette[4][4])
+{
+  unpack_565(c0, palette[0]);
+  unpack_565(c1, palette[1]);
+  for (int c = 0; c < 4; c++) {
+    if (four_color) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+}
+
+float bc1_indices(const Block &blk, uint16_t c0, uint16_t c1, uint32_t &bits)
+{
+  int palette[4][4];
+  bc1_palette(c0, c1, true, palette);
+  float total = 0.f, err;
+  bits = 0;
+  for (int i = 0; i < 16; i++) {
+    bits |= uint32_t(nearest<3>(blk.px[i], palette, c0 == c1 ? 1 : 4, err)) << (i * 2);
+    total += err;
+  }
+  return total;
+}
+
+void encode_bc1(const Block &blk, uint8_t *out)
+{
+  static const float weights[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+
+  float e0[4], e1[4];
+  fit_endpoints(blk, 3, e0, e1);
+  uint16_t c0 = pack_565(e0), c1 = pack_565(e1);
+  if (c0 < c1)
+    std::swap(c0, c1);
+  uint32_t bits;
+  float err = bc1_indices(blk, c0, c1, bits);
+
+  float w[16];
+  for (int i = 0; i < 16; i++)
+    w[i] = weights[(bits >> (i * 2)) & 3];
+  if (c0 != c1 && refine_endpoints(blk, 3, w, e0, e1)) {
+    uint16_t r0 = pack_565(e0), r1 = pack_565(e1);
+    if (r0 < r1)
+      std::swap(r0, r1);
+    uint32_t rbits;
+    float rerr = bc1_indices(blk, r0, r1, rbits);
+    if (rerr < err) {
+      c0 = r0;
+      c1 = r1;
+      bits = rbits;
+    }
+  }
+
+  memcpy(out, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &bits, 4);
+}
+
+void decode_bc1(const uint8_t *in, bool force_four_color, uint8_t px[16][4])
+{
+  uint16_t c0, c1;
+  uint32_t bits;
+  memcpy(&c0, in, 2);
+  memcpy(&c1, in + 2, 2);
+  memcpy(&bits, in + 4, 4);
+  int palette[4][4];
+  bc1_palette(c0, c1, force_four_color || c0 > c1, palette);
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 4; c++)
+      px[i][c] = uint8_t(palette[(bits >> (i * 2)) & 3][c]);
+}
+
+/* BC4 single channel block, used for BC3 alpha and both BC5 channels */
+
+void bc4_palette(int a0, int a1, int palette[8])
+{
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int k = 1; k < 7; k++)
+      palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+  } else {
+    for (int k = 1; k < 5; k++)
+      palette[k + 1] = ((5 - k) * a0 + k * a1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encode_bc4(const Block &blk, int channel, uint8_t *out)
+{
+  float lo = 255.f, hi = 0.f;
+  for (int i = 0; i < 16; i++) {
+    lo = std::min(lo, blk.px[i][channel]);
+    hi = std::max(hi, blk.px[i][channel]);
+  }
+  int a0 = int(hi + 0.5f), a1 = int(lo + 0.5f);
+  int palette[8];
+  bc4_palette(a0, a1, palette);
+
+  uint64_t bits = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0, besterr = 1 << 30;
+    for (int k = 0; k < (a0 == a1 ? 1 : 8); k++) {
+      int d = std::abs(int(blk.px[i][channel] + 0.5f) - palette[k]);
+      if (d < besterr) {
+        besterr = d;
+        best = k;
+      }
+    }
+    bits |= uint64_t(best) << (i * 3);
+  }
+
+  out[0] = uint8_t(a0);
+  out[1] = uint8_t(a1);
+  for (int k = 0; k < 6; k++)
+    out[2 + k] = uint8_t(bits >> (k * 8));
+}
+
+void decode_bc4(const uint8_t *in, int channel, uint8_t px[16][4])
+{
+  int palette[8];
+  bc4_palette(in[0], in[1], palette);
+  uint64_t bits = 0;
+  for (int k = 0; k < 6; k++)
+    bits |= uint64_t(in[2 + k]) << (k * 8);
+  for (int i = 0; i < 16; i++)
+    px[i][channel] = uint8_t(palette[(bits >> (i * 3)) & 7]);
+}
+
+/* BC7, encoded in mode 6 only: one subset, rgba 7.7.7.7 endpoints with a p-bit each and 4 bit indices */
+
+const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Endpoint {
+  int q[4];
+  int p;
+};
+
+Bc7Endpoint quantize_bc7(const float e[4])
+{
+  Bc7Endpoint best = {};
+  float besterr = std::numeric_limits<float>::max();
+  for (int p = 0; p < 2; p++) {
+    Bc7Endpoint ep = {};
+    ep.p = p;
+    float err = 0.f;
+    for (int c = 0; c < 4; c++) {
+      ep.q[c] = std::clamp(int((e[c] - p) / 2.f + 0.5f), 0, 127);
+      float d = float(ep.q[c] * 2 + p) - e[c];
+      err += d * d;
+    }
+    if (err < besterr) {
+      besterr = err;
+      best = ep;
+    }
+  }
+  return best;
+}
+
+void bc7_palette(const Bc7Endpoint &ep0, const Bc7Endpoint &ep1, int palette[16][4])
+{
+  for (int c = 0; c < 4; c++) {
+    int a = ep0.q[c] * 2 + ep0.p, b = ep1.q[c] * 2 + ep1.p;
+    for (int k = 0; k < 16; k++)
+      palette[k][c] = ((64 - bc7_weights[k]) * a + bc7_weights[k] * b + 32) >> 6;
+  }
+}
+
+float bc7_indices(const Block &blk, const Bc7Endpoint &ep0, const Bc7Endpoint &ep1, int idx[16])
+{
+  int palette[16][4];
+  bc7_palette(ep0, ep1, palette);
+  float total = 0.f, err;
+  for (int i = 0; i < 16; i++) {
+    idx[i] = nearest<4>(blk.px[i], palette, 16, err);
+    total += err;
+  }
+  return total;
+}
+
+struct BitWriter {
+  uint64_t lo = 0, hi = 0;
+  int pos = 0;
+  void put(uint32_t v, int n)
+  {
+    for (int i = 0; i < n; i++, pos++) {
+      uint64_t bit = (v >> i) & 1;
+      if (pos < 64)
+        lo |= bit << pos;
+      else
+        hi |= bit << (pos - 64);
+    }
+  }
+};
+
+struct BitReader {
+  uint64_t lo = 0, hi = 0;
+  int pos = 0;
+  uint32_t get(int n)
+  {
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++, pos++) {
+      uint64_t bit = pos < 64 ? (lo >> pos) & 1 : (hi >> (pos - 64)) & 1;
+      v |= uint32_t(bit) << i;
+    }
+    return v;
+  }
+};
+
+void encode_bc7(const Block &blk, uint8_t *out)
+{
+  float e0[4], e1[4];
+  fit_endpoints(blk, 4, e0, e1);
+  Bc7Endpoint ep0 = quantize_bc7(e0), ep1 = quantize_bc7(e1);
+  int idx[16];
+  float err = bc7_indices(blk, ep0, ep1, idx);
+
+  float w[16];
+  for (int i = 0; i < 16; i++)
+    w[i] = 1.f - bc7_weights[idx[i]] / 64.f;
+  if (refine_endpoints(blk, 4, w, e0, e1)) {
+    Bc7Endpoint r0 = quantize_bc7(e0), r1 = quantize_bc7(e1);
+    int ridx[16];
+    float rerr = bc7_indices(blk, r0, r1, ridx);
+    if (rerr < err) {
+      ep0 = r0;
+      ep1 = r1;
+      memcpy(idx, ridx, sizeof(idx));
+    }
+  }
+
+  // the first index is stored without its top bit
+  if (idx[0] & 8) {
+    std::swap(ep0, ep1);
+    for (int i = 0; i < 16; i++)
+      idx[i] = 15 - idx[i];
+  }
+
+  BitWriter bw;
+  bw.put(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    bw.put(ep0.q[c], 7);
+    bw.put(ep1.q[c], 7);
+  }
+  bw.put(ep0.p, 1);
+  bw.put(ep1.p, 1);
+  bw.put(idx[0], 3);
+  for (int i = 1; i < 16; i++)
+    bw.put(idx[i], 4);
+
+  memcpy(out, &bw.lo, 8);
+  memcpy(out + 8, &bw.hi, 8);
+}
+
+/* BC7 decoding, every mode. the tables are the ones of the format spec */
+
+struct Bc7Mode {
+  int subsets, partition_bits, rotation_bits, selector_bits;
+  int color_bits, alpha_bits, endpoint_pbits, shared_pbits;
+  int index_bits, index2_bits;
+};
+
+const Bc7Mode bc7_modes[8] = {
+  {3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+  {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+  {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+  {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+  {1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+  {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+  {1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+  {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+};
+
+// bit i is the subset of pixel i
+const uint16_t bc7_partition2[64] = {
+  0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+  0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+  0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+  0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// bits 2i and 2i + 1 are the subset of pixel i
+const uint32_t bc7_partition3[64] = {
+  0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+  0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+  0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+  0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+  0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+  0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+  0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+  0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// pixels whose index drops its top bit, besides pixel 0
+const uint8_t bc7_anchor2[64] = {
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 2,  8,  2,  2,  8,  8,  15, 2,  8,  2,  2,  8,  8,  2,  2,
+  15, 15, 6,  8,  2,  8,  15, 15, 2,  8,  2,  2,  2,  15, 15, 6,
+  6,  2,  6,  8,  15, 15, 2,  2,  15, 15, 15, 15, 15, 2,  2,  15,
+};
+
+const uint8_t bc7_anchor3[2][64] = {
+  {
+    3,  3,  15, 15, 8,  3,  15, 15, 8,  8,  6,  6,  6,  5,  3,  3,
+    3,  3,  8,  15, 3,  3,  6,  10, 5,  8,  8,  6,  8,  5,  15, 15,
+    8,  15, 3,  5,  6,  10, 8,  15, 15, 3,  15, 5,  15, 15, 15, 15,
+    3,  15, 5,  5,  5,  8,  5,  10, 5,  10, 8,  13, 15, 12, 3,  3,
+  },
+  {
+    15, 8,  8,  3,  15, 15, 3,  8,  15, 15, 15, 15, 15, 15, 15, 8,
+    15, 8,  15, 3,  15, 8,  15, 8,  3,  15, 6,  10, 15, 15, 10, 8,
+    15, 3,  15, 10, 10, 8,  9,  10, 6,  15, 8,  15, 3,  6,  6,  8,
+    15, 3,  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3,  15, 15, 8,
+  },
+};
+
+const int bc7_weights2[4] = {0, 21, 43, 64};
+const int bc7_weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+
+const int *bc7_weight_table(int bits)
+{
+  return bits == 2 ? bc7_weights2 : bits == 3 ? bc7_weights3 : bc7_weights;
+}
+
+int bc7_subset(const Bc7Mode &mode, int partition, int pixel)
+{
+  if (mode.subsets == 2)
+    return (bc7_partition2[partition] >> pixel) & 1;
+  if (mode.subsets == 3)
+    return (bc7_partition3[partition] >> (pixel * 2)) & 3;
+  return 0;
+}
+
+bool bc7_anchor(const Bc7Mode &mode, int partition, int pixel)
+{
+  if (pixel == 0)
+    return true;
+  if (mode.subsets == 2)
+    return pixel == bc7_anchor2[partition];
+  if (mode.subsets == 3)
+    return pixel == bc7_anchor3[0][partition] || pixel == bc7_anchor3[1][partition];
+  return false;
+}
+
+void decode_bc7(const uint8_t *in, uint8_t px[16][4])
+{
+  BitReader br;
+  memcpy(&br.lo, in, 8);
+  memcpy(&br.hi, in + 8, 8);
+
+  // the mode is the position of the lowest set bit of the first byte
+  int m = 0;
+  while (m < 8 && !br.get(1))
+    m++;
+  if (m == 8) {
+    // reserved, the spec decodes it as transparent black
+    memset(px, 0, 16 * 4);
+    return;
+  }
+  const Bc7Mode &mode = bc7_modes[m];
+
+  int partition = br.get(mode.partition_bits);
+  int rotation = br.get(mode.rotation_bits);
+  int selector = br.get(mode.selector_bits);
+
+  // subset, endpoint, channel
+  int ep[3][2][4] = {};
+  for (int c = 0; c < 3; c++)
+    for (int s = 0; s < mode.subsets; s++)
+      for (int e = 0; e < 2; e++)
+        ep[s][e][c] = br.get(mode.color_bits);
+  for (int s = 0; s < mode.subsets; s++)
+    for (int e = 0; e < 2; e++)
+      ep[s][e][3] = br.get(mode.alpha_bits);
+
+  int color_bits = mode.color_bits, alpha_bits = mode.alpha_bits;
+  if (mode.endpoint_pbits || mode.shared_pbits) {
+    for (int s = 0; s < mode.subsets; s++) {
+      int p[2];
+      if (mode.endpoint_pbits) {
+        p[0] = br.get(1);
+        p[1] = br.get(1);
+      } else {
+        p[0] = p[1] = br.get(1);
+      }
+      for (int e = 0; e < 2; e++)
+        for (int c = 0; c < 4; c++)
+          ep[s][e][c] = (ep[s][e][c] << 1) | p[e];
+    }
+    color_bits++;
+    if (alpha_bits)
+      alpha_bits++;
+  }
+
+  // widen to 8 bits by repeating the top bits
+  for (int s = 0; s < mode.subsets; s++)
+    for (int e = 0; e < 2; e++) {
+      for (int c = 0; c < 3; c++) {
+        int v = ep[s][e][c] << (8 - color_bits);
+        ep[s][e][c] = v | (v >> color_bits);
+      }
+      if (alpha_bits) {
+        int v = ep[s][e][3] << (8 - alpha_bits);
+        ep[s][e][3] = v | (v >> alpha_bits);
+      } else {
+        ep[s][e][3] = 255;
+      }
+    }
+
+  int idx[16], idx2[16] = {};
+  for (int i = 0; i < 16; i++)
+    idx[i] = br.get(mode.index_bits - (bc7_anchor(mode, partition, i) ? 1 : 0));
+  for (int i = 0; mode.index2_bits && i < 16; i++)
+    idx2[i] = br.get(mode.index2_bits - (i == 0 ? 1 : 0));
+
+  // modes 4 and 5 index color and alpha separately, the selector swaps the two sets in mode 4
+  int color_index_bits = mode.index_bits, alpha_index_bits = mode.index2_bits ? mode.index2_bits : mode.index_bits;
+  const int *color_idx = idx, *alpha_idx = mode.index2_bits ? idx2 : idx;
+  if (selector) {
+    std::swap(color_index_bits, alpha_index_bits);
+    std::swap(color_idx, alpha_idx);
+  }
+  const int *color_w = bc7_weight_table(color_index_bits), *alpha_w = bc7_weight_table(alpha_index_bits);
+
+  for (int i = 0; i < 16; i++) {
+    int s = bc7_subset(mode, partition, i);
+    for (int c = 0; c < 4; c++) {
+      int w = c < 3 ? color_w[color_idx[i]] : alpha_w[alpha_idx[i]];
+      px[i][c] = uint8_t(((64 - w) * ep[s][0][c] + w * ep[s][1][c] + 32) >> 6);
+    }
+    if (rotation)
+      std::swap(px[i][3], px[i][rotation - 1]);
+  }
+}
+
+void encode_block(const Block &blk, BlockFormat format, uint8_t *out)
+{
+  switch (format) {
+  case BlockFormat::BC1:
+    encode_bc1(blk, out);
+    break;
+  case BlockFormat::BC3:
+    encode_bc4(blk, 3, out);
+    encode_bc1(blk, out + 8);
+    break;
+  case BlockFormat::BC5:
+    encode_bc4(blk, 0, out);
+    encode_bc4(blk, 1, out + 8);
+    break;
+  case BlockFormat::BC7:
+    encode_bc7(blk, out);
+    break;
+  }
+}
+
+void decode_block(const uint8_t *in, BlockFormat format, uint8_t px[16][4])
+{
+  switch (format) {
+  case BlockFormat::BC1:
+    decode_bc1(in, false, px);
+    break;
+  case BlockFormat::BC3:
+    decode_bc1(in + 8, true, px);
+    decode_bc4(in, 3, px);
+    break;
+  case BlockFormat::BC5:
+    for (int i = 0; i < 16; i++) {
+      px[i][2] = 0;
+      px[i][3] = 255;
+    }
+    decode_bc4(in, 0, px);
+    decode_bc4(in + 8, 1, px);
+    break;
+  case BlockFormat::BC7:
+    decode_bc7(in, px);
+    break;
+  }
+}
+
+}
+
+size_t block_bytes(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+uint32_t block_vk_format(BlockFormat format, bool srgb)
+{
+  // VK_FORMAT_BC1_RGBA_*, VK_FORMAT_BC3_*, VK_FORMAT_BC5_UNORM, VK_FORMAT_BC7_*
+  switch (format) {
+  case BlockFormat::BC1:
+    return srgb ? 134 : 133;
+  case BlockFormat::BC3:
+    return srgb ? 138 : 137;
+  case BlockFormat::BC5:
+    return 141;
+  case BlockFormat::BC7:
+    return srgb ? 146 : 145;
+  }
+  return 0;
+}
+
+bool block_format_from_vk(uint32_t vk_format, BlockFormat &format)
+{
+  switch (vk_format) {
+  case 131: case 132: case 133: case 134:
+    format = BlockFormat::BC1;
+    return true;
+  case 137: case 138:
+    format = BlockFormat::BC3;
+    return true;
+  case 141:
+    format = BlockFormat::BC5;
+    return true;
+  case 145: case 146:
+    format = BlockFormat::BC7;
+    return true;
+  }
+  return false;
+}
+
+CompressedImage compress(const uint8_t *rgba, const std::vector<MipLevel> &levels, BlockFormat format, uint32_t threads)
+{
+  CompressedImage img;
+  img.format = format;
+  img.w = levels.empty() ? 0 : levels[0].w;
+  img.h = levels.empty() ? 0 : levels[0].h;
+
+  struct Row {
+    uint32_t level, by;
+  };
+  std::vector<Row> rows;
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < levels.size(); i++) {
+    MipLevel lv = levels[i];
+    uint32_t bw = (lv.w + 3) / 4, bh = (lv.h + 3) / 4;
+    lv.offset = total;
+    lv.size = size_t(bw) * bh * block_bytes(format);
+    total += lv.size;
+    img.levels.push_back(lv);
+    for (uint32_t by = 0; by < bh; by++)
+      rows.push_back({i, by});
+  }
+  img.data.resize(total);
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t r = next++; r < rows.size(); r = next++) {
+      const MipLevel &src = levels[rows[r].level];
+      const MipLevel &dst = img.levels[rows[r].level];
+      uint32_t bw = (src.w + 3) / 4;
+      uint8_t *out = img.data.data() + dst.offset + size_t(rows[r].by) * bw * block_bytes(format);
+      Block blk;
+      for (uint32_t bx = 0; bx < bw; bx++, out += block_bytes(format)) {
+        fetch_block(rgba + src.offset, src.w, src.h, bx, rows[r].by, blk);
+        encode_block(blk, format, out);
+      }
+    }
+  };
+
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  threads = std::min<uint32_t>(threads, uint32_t(rows.size()));
+  std::vector<std::thread> pool;
+  for (uint32_t t = 1; t < threads; t++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+
+  return img;
+}
+
+void decompress(const uint8_t *blocks, uint32_t w, uint32_t h, BlockFormat format, uint8_t *rgba)
+{
+  uint32_t bw = (w + 3) / 4, bh = (h + 3) / 4;
+  uint8_t px[16][4];
+  for (uint32_t by = 0; by < bh; by++) {
+    for (uint32_t bx = 0; bx < bw; bx++, blocks += block_bytes(format)) {
+      decode_block(blocks, format, px);
+      for (uint32_t y = 0; y < 4 && by * 4 + y < h; y++)
+        for (uint32_t x = 0; x < 4 && bx * 4 + x < w; x++)
+          memcpy(rgba + (size_t(by * 4 + y) * w + bx * 4 + x) * 4, px[y * 4 + x], 4);
+    }
+  }
+}
+
+double psnr(const uint8_t *a, const uint8_t *b, uint32_t w, uint32_t h, BlockFormat format)
+{
+  int channels = format == BlockFormat::BC1 ? 3 : format == BlockFormat::BC5 ? 2 : 4;
+  double sum = 0.0;
+  for (size_t i = 0; i < size_t(w) * h; i++) {
+    for (int c = 0; c < channels; c++) {
+      double d = double(a[i * 4 + c]) - double(b[i * 4 + c]);
+      sum += d * d;
+    }
+  }
+  double mse = sum / (double(w) * h * channels);
+  if (mse <= 0.0)
+    return std::numeric_limits<double>::infinity();
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+template <typename T>
+static void write_le(std::vector<uint8_t> &out, T v)
+{
+  size_t pos = out.size();
+  out.resize(pos + sizeof(T));
+  memcpy(out.data() + pos, &v, sizeof(T));
+}
+
+bool write_ktx2(const std::string &file, const CompressedImage &img, bool srgb)
+{
+  const uint32_t level_count = uint32_t(img.levels.size());
+  const uint32_t block = uint32_t(block_bytes(img.format));
+
+  // basic data format descriptor, colour models KHR_DF_MODEL_BC1A .. KHR_DF_MODEL_BC7
+  struct Sample {
+    uint32_t offset, length, channel;
+  };
+  std::vector<Sample> samples;
+  uint32_t model = 0;
+  switch (img.format) {
+  case BlockFormat::BC1:
+    model = 128;
+    samples.push_back({0, 64, 0});
+    break;
+  case BlockFormat::BC3:
+    model = 130;
+    samples.push_back({0, 64, 15});
+    samples.push_back({64, 64, 0});
+    break;
+  case BlockFormat::BC5:
+    model = 132;
+    samples.push_back({0, 64, 0});
+    samples.push_back({64, 64, 1});
+    break;
+  case BlockFormat::BC7:
+    model = 134;
+    samples.push_back({0, 128, 0});
+    break;
+  }
+  bool srgb_tf = srgb && img.format != BlockFormat::BC5;
+
+  std::vector<uint8_t> dfd;
+  uint32_t block_size = 24 + 16 * uint32_t(samples.size());
+  write_le<uint32_t>(dfd, 4 + block_size);
+  write_le<uint32_t>(dfd, 0);
+  write_le<uint32_t>(dfd, 2 | (block_size << 16));
+  write_le<uint32_t>(dfd, model | (1 << 8) | ((srgb_tf ? 2 : 1) << 16));
+  write_le<uint32_t>(dfd, 3 | (3 << 8));
+  write_le<uint32_t>(dfd, block);
+  write_le<uint32_t>(dfd, 0);
+  for (auto &smp : samples) {
+    uint32_t qualifiers = (srgb_tf && smp.channel == 15) ? 0x1 : 0;
+    write_le<uint32_t>(dfd, smp.offset | ((smp.length - 1) << 16) | (smp.channel << 24) | (qualifiers << 28));
+    write_le<uint32_t>(dfd, 0);
+    write_le<uint32_t>(dfd, 0);
+    write_le<uint32_t>(dfd, 0xFFFFFFFFu);
+  }
+
+  const uint32_t dfd_offset = 80 + 24 * level_count;
+
+  // level data follows the dfd, smallest level first, every level block aligned
+  std::vector<uint64_t> offsets(level_count);
+  uint64_t pos = dfd_offset + dfd.size();
+  for (int i = int(level_count) - 1; i >= 0; i--) {
+    pos = (pos + block - 1) / block * block;
+    offsets[i] = pos;
+    pos += img.levels[i].size;
+  }
+
+  std::vector<uint8_t> out(ktx2_identifier, ktx2_identifier + sizeof(ktx2_identifier));
+  write_le<uint32_t>(out, block_vk_format(img.format, srgb));
+  write_le<uint32_t>(out, 1);
+  write_le<uint32_t>(out, img.w);
+  write_le<uint32_t>(out, img.h);
+  write_le<uint32_t>(out, 0);
+  write_le<uint32_t>(out, 0);
+  write_le<uint32_t>(out, 1);
+  write_le<uint32_t>(out, level_count);
+  write_le<uint32_t>(out, 0);
+
+  write_le<uint32_t>(out, dfd_offset);
+  write_le<uint32_t>(out, uint32_t(dfd.size()));
+  write_le<uint32_t>(out, 0);
+  write_le<uint32_t>(out, 0);
+  write_le<uint64_t>(out, 0);
+  write_le<uint64_t>(out, 0);
+
+  for (uint32_t i = 0; i < level_count; i++) {
+    write_le<uint64_t>(out, offsets[i]);
+    write_le<uint64_t>(out, img.levels[i].size);
+    write_le<uint64_t>(out, img.levels[i].size);
+  }
+  out.insert(out.end(), dfd.begin(), dfd.end());
+
+  out.resize(pos, 0);
+  for (uint32_t i = 0; i < level_count; i++)
+    memcpy(out.data() + offsets[i], img.data.data() + img.levels[i].offset, img.levels[i].size);
+
+  std::ofstream os(file, std::ios::binary);
+  if (!os) {
+    std::cerr << "Could not write " << file << std::endl;
+    return false;
+  }
+  os.write((const char *)out.data(), out.size());
+  return bool(os);
+}
+
+}
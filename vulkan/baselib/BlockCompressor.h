@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TextureTools.h"
+
+namespace tex {
+
+enum class BlockFormat { BC1, BC3, BC5, BC7 };
+
+struct CompressedImage {
+  BlockFormat format = BlockFormat::BC1;
+  uint32_t w = 0, h = 0;
+  std::vector<MipLevel> levels;
+  std::vector<uint8_t> data;
+};
+
+size_t block_bytes(BlockFormat format);
+
+// matching VkFormat value, the ktx2 header stores it as a plain uint32
+uint32_t block_vk_format(BlockFormat format, bool srgb);
+
+bool block_format_from_vk(uint32_t vk_format, BlockFormat &format);
+
+// compress every level of an rgba8 mip chain, blocks are spread over threads
+CompressedImage compress(const uint8_t *rgba, const std::vector<MipLevel> &levels, BlockFormat format, uint32_t threads = 0);
+
+// decode one compressed level back to rgba8
+void decompress(const uint8_t *blocks, uint32_t w, uint32_t h, BlockFormat format, uint8_t *rgba);
+
+// psnr over the channels the format actually stores
+double psnr(const uint8_t *a, const uint8_t *b, uint32_t w, uint32_t h, BlockFormat format);
+
+bool write_ktx2(const std::string &file, const CompressedImage &img, bool srgb);
+
+}
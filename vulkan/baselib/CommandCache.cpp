@@ -0,0 +1,95 @@
+#include "CommandCache.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+CommandCache::CommandCache(VulkanDevice *dev, uint32_t frames) : _device(dev), _frames(frames)
+{
+  for (uint32_t f = 0; f < _frames; f++)
+    _pools.push_back(_device->create_command_pool(_device->graphics_family(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT));
+}
+
+CommandCache::~CommandCache()
+{
+  // destroying a pool frees its command buffers
+  for (auto pool : _pools)
+    vkDestroyCommandPool(*_device, pool, nullptr);
+}
+
+uint32_t CommandCache::create_segment()
+{
+  Segment segment;
+  segment.copies.resize(_frames);
+  _segments.push_back(std::move(segment));
+  return uint32_t(_segments.size() - 1);
+}
+
+void CommandCache::invalidate(uint32_t segment)
+{
+  _segments[segment].generation++;
+}
+
+void CommandCache::invalidate_all()
+{
+  for (auto &segment : _segments)
+    segment.generation++;
+}
+
+void CommandCache::begin_frame()
+{
+  _stats = {};
+}
+
+void CommandCache::execute(VkCommandBuffer primary, uint32_t frame, uint32_t segment, VkRenderPass pass, uint32_t subpass, const RecordFn &fn)
+{
+  VkCommandBufferInheritanceInfo inherit = {};
+  inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inherit.renderPass = pass;
+  inherit.subpass = subpass;
+  replay(primary, frame, segment, inherit, {0, (uint64_t)pass, subpass}, fn);
+}
+
+void CommandCache::execute(VkCommandBuffer primary, uint32_t frame, uint32_t segment, const VkCommandBufferInheritanceRenderingInfo &rendering,
+                           const RecordFn &fn)
+{
+  VkCommandBufferInheritanceInfo inherit = {};
+  inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inherit.pNext = &rendering;
+
+  std::vector<uint64_t> key = {1, rendering.colorAttachmentCount};
+  for (uint32_t i = 0; i < rendering.colorAttachmentCount; i++)
+    key.push_back(uint64_t(rendering.pColorAttachmentFormats[i]));
+  key.insert(key.end(), {uint64_t(rendering.depthAttachmentFormat), uint64_t(rendering.stencilAttachmentFormat)});
+  replay(primary, frame, segment, inherit, std::move(key), fn);
+}
+
+void CommandCache::replay(VkCommandBuffer primary, uint32_t frame, uint32_t segment, const VkCommandBufferInheritanceInfo &inherit,
+                          std::vector<uint64_t> &&pass, const RecordFn &fn)
+{
+  auto &seg = _segments[segment];
+  auto &copy = seg.copies[frame];
+
+  if (copy.generation != seg.generation || copy.pass != pass) {
+    // the frame's previous submit is done, nothing pending executes this copy any more
+    if (!copy.cmd)
+      copy.cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, _pools[frame], false);
+    else
+      VK_CHECK_RESULT(vkResetCommandBuffer(copy.cmd, 0));
+
+    // no one time submit, the copy is executed again every frame until it goes stale
+    VkCommandBufferBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin.pInheritanceInfo = &inherit;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(copy.cmd, &begin));
+    fn(copy.cmd, frame);
+    VK_CHECK_RESULT(vkEndCommandBuffer(copy.cmd));
+
+    copy.generation = seg.generation;
+    copy.pass = std::move(pass);
+    _stats.recorded++;
+  } else {
+    _stats.replayed++;
+  }
+
+  vkCmdExecuteCommands(primary, 1, &copy.cmd);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <vector>
+
+class VulkanDevice;
+
+// draw work recorded once into secondary command buffers and replayed until it is invalidated.
+// a segment keeps one secondary per frame in flight, since what it binds may differ per frame (ring
+// offsets). a stale copy is recorded again when its own frame comes round, once that frame's previous
+// submit has finished, so only frames whose state changed pay for recording.
+class CommandCache {
+public:
+  // records the segment for frame into cmd. cmd continues the pass, viewport, scissor, pipeline and
+  // descriptor sets are not inherited.
+  using RecordFn = std::function<void(VkCommandBuffer cmd, uint32_t frame)>;
+
+  struct Stats {
+    // segments recorded and replayed since the last begin_frame
+    uint32_t recorded = 0;
+    uint32_t replayed = 0;
+  };
+
+  CommandCache(VulkanDevice *dev, uint32_t frames);
+  ~CommandCache();
+
+  // a new segment, recorded on its first execute. ids stay valid for the cache's lifetime
+  uint32_t create_segment();
+
+  // what the segment records changed, every frame records it again before replaying it
+  void invalidate(uint32_t segment);
+  void invalidate_all();
+
+  // the frame's previous submit has finished, the stats start over
+  void begin_frame();
+
+  // primary must be inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS on the
+  // given pass and subpass. a copy recorded for another pass is recorded again.
+  void execute(VkCommandBuffer primary, uint32_t frame, uint32_t segment, VkRenderPass pass, uint32_t subpass, const RecordFn &fn);
+
+  // the same inside vkCmdBeginRendering with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+  void execute(VkCommandBuffer primary, uint32_t frame, uint32_t segment, const VkCommandBufferInheritanceRenderingInfo &rendering,
+               const RecordFn &fn);
+
+  const Stats &stats() const { return _stats; }
+
+private:
+  struct Copy {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    // segment generation and pass the copy was recorded for, generation 0 is never recorded
+    uint64_t generation = 0;
+    std::vector<uint64_t> pass;
+  };
+
+  struct Segment {
+    uint64_t generation = 1;
+    // one per frame in flight
+    std::vector<Copy> copies;
+  };
+
+  void replay(VkCommandBuffer primary, uint32_t frame, uint32_t segment, const VkCommandBufferInheritanceInfo &inherit,
+              std::vector<uint64_t> &&pass, const RecordFn &fn);
+
+private:
+  VulkanDevice *_device = nullptr;
+  uint32_t _frames = 0;
+
+  // one per frame in flight, the copies are reset one by one
+  std::vector<VkCommandPool> _pools;
+  std::vector<Segment> _segments;
+
+  Stats _stats;
+};
@@ -4,6 +4,8 @@
 
 DepthPass::DepthPass(const std::shared_ptr<VulkanDevice> &dev) : VulkanPass(dev)
 {
+  _color_format = VK_FORMAT_UNDEFINED;
+  _depth_format = VK_FORMAT_D32_SFLOAT;
 }
 
 DepthPass::~DepthPass()
@@ -15,7 +17,7 @@ void DepthPass::initialize()
   VkRenderPass render_pass = VK_NULL_HANDLE;
 
   VkAttachmentDescription attachment = {};
-  attachment.format = VK_FORMAT_D32_SFLOAT;
+  attachment.format = _depth_format;
   attachment.samples = VK_SAMPLE_COUNT_1_BIT;
   attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
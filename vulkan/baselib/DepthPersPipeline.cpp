@@ -27,10 +27,12 @@ DepthPersPipeline::~DepthPersPipeline()
 
 void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
 {
+  _pass = render_pass;
+  _subpass = subpass;
+
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_layout();
-  pipelineCreateInfo.renderPass = *render_pass;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -111,13 +113,13 @@ void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/depth_pers.vert.spv");
+  shaderStages[0].module = shader("depth_pers.vert");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/depth_pers.frag.spv");
+  shaderStages[1].module = shader("depth_pers.frag");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -132,12 +134,9 @@ void DepthPersPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pViewportState = &viewportState;
   pipelineCreateInfo.pDepthStencilState = &depthStencilState;
   pipelineCreateInfo.pDynamicState = 0;
-  pipelineCreateInfo.subpass = subpass;
-
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+  render_pass->attach(pipelineCreateInfo, subpass);
 
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo, "depth_pers");
 }
 
 VkPipelineLayout DepthPersPipeline::pipe_layout()
@@ -0,0 +1,121 @@
+#include "DescriptorAllocator.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr uint32_t max_sets_per_pool = 4096;
+
+std::vector<DescriptorAllocator::Hint> DescriptorAllocator::default_hints()
+{
+  return {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+          {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+          {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+          {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0.5f},
+          {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.25f}};
+}
+
+DescriptorAllocator::DescriptorAllocator(VulkanDevice *dev, bool free_sets, std::vector<Hint> hints, uint32_t sets_per_pool)
+  : _device(dev), _free_sets(free_sets), _hints(std::move(hints)), _next_size(sets_per_pool)
+{
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+  for (auto &p : _pools)
+    vkDestroyDescriptorPool(*_device, p.pool, nullptr);
+}
+
+DescriptorAllocator::Pool DescriptorAllocator::create_pool(uint32_t sets)
+{
+  std::vector<VkDescriptorPoolSize> sizes;
+  for (auto &h : _hints)
+    sizes.push_back({h.type, std::max(1u, uint32_t(std::ceil(h.per_set * sets)))});
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.flags = _free_sets ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+  pool_info.maxSets = sets;
+  pool_info.poolSizeCount = (uint32_t)sizes.size();
+  pool_info.pPoolSizes = sizes.data();
+
+  Pool pool;
+  pool.capacity = sets;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(*_device, &pool_info, nullptr, &pool.pool));
+  return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void *next)
+{
+  VkDescriptorSetAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.pNext = next;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &layout;
+
+  // newest pool first, older ones only get another try when sets were freed back into them
+  for (uint32_t i = (uint32_t)_pools.size(); i-- > 0;) {
+    auto &p = _pools[i];
+    if (p.sets >= p.capacity)
+      continue;
+    alloc_info.descriptorPool = p.pool;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkResult res = vkAllocateDescriptorSets(*_device, &alloc_info, &set);
+    if (res == VK_SUCCESS) {
+      p.sets++;
+      if (_free_sets)
+        _owners[set] = i;
+      return set;
+    }
+    if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL)
+      VK_CHECK_RESULT(res);
+    if (!_free_sets)
+      break;
+  }
+
+  _pools.push_back(create_pool(_next_size));
+  _next_size = std::min(_next_size * 2, max_sets_per_pool);
+
+  auto &p = _pools.back();
+  alloc_info.descriptorPool = p.pool;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(*_device, &alloc_info, &set));
+  p.sets++;
+  if (_free_sets)
+    _owners[set] = uint32_t(_pools.size() - 1);
+  return set;
+}
+
+void DescriptorAllocator::free(VkDescriptorSet set)
+{
+  assert(_free_sets);
+  auto it = _owners.find(set);
+  if (it == _owners.end())
+    return;
+  auto &p = _pools[it->second];
+  vkFreeDescriptorSets(*_device, p.pool, 1, &set);
+  p.sets--;
+  _owners.erase(it);
+}
+
+void DescriptorAllocator::reset()
+{
+  for (auto &p : _pools) {
+    if (p.sets)
+      vkResetDescriptorPool(*_device, p.pool, 0);
+    p.sets = 0;
+  }
+  _owners.clear();
+}
+
+DescriptorStats DescriptorAllocator::stats() const
+{
+  DescriptorStats st;
+  st.pools = (uint32_t)_pools.size();
+  for (auto &p : _pools) {
+    st.sets += p.sets;
+    st.capacity += p.capacity;
+  }
+  return st;
+}
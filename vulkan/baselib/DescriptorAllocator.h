@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <unordered_map>
+#include <vector>
+
+class VulkanDevice;
+
+struct DescriptorStats {
+  uint32_t pools = 0;
+  uint32_t sets = 0;
+  uint32_t capacity = 0;
+
+  float utilization() const { return capacity ? float(sets) / capacity : 0.f; }
+};
+
+// hands out descriptor sets from a list of pools, a new and larger pool is created whenever the
+// current ones run out. pool sizes follow the per set hints, e.g. {COMBINED_IMAGE_SAMPLER, 2} reserves
+// two samplers for every set the pool can hold.
+// long lived allocators free sets one by one, transient ones (free_sets = false) are only reset().
+class DescriptorAllocator {
+public:
+  struct Hint {
+    VkDescriptorType type;
+    float per_set;
+  };
+
+  DescriptorAllocator(VulkanDevice *dev, bool free_sets, std::vector<Hint> hints = default_hints(), uint32_t sets_per_pool = 64);
+  ~DescriptorAllocator();
+
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void *next = nullptr);
+
+  void free(VkDescriptorSet set);
+
+  // every set goes back at once, the pools are kept for the next round
+  void reset();
+
+  DescriptorStats stats() const;
+
+  static std::vector<Hint> default_hints();
+
+private:
+  struct Pool {
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    uint32_t capacity = 0;
+    uint32_t sets = 0;
+  };
+
+  Pool create_pool(uint32_t sets);
+
+private:
+  VulkanDevice *_device = nullptr;
+  bool _free_sets = false;
+  std::vector<Hint> _hints;
+  uint32_t _next_size = 0;
+
+  std::vector<Pool> _pools;
+  // pool index of every live set, only kept when sets are freed individually
+  std::unordered_map<VkDescriptorSet, uint32_t> _owners;
+};
@@ -0,0 +1,684 @@
+#include "FrameGraph.h"
+#include "VulkanDevice.h"
+#include "VulkanImage.h"
+#include "VulkanSwapChain.h"
+#include "GpuProfiler.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void FrameGraph::Builder::color(Handle h, VkClearColorValue clear, VkAttachmentLoadOp load)
+{
+  VkClearValue value;
+  value.color = clear;
+  _graph->_passes[_pass].uses.push_back({h, Access::Color, load, value});
+  _graph->_resources[h].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+}
+
+void FrameGraph::Builder::depth(Handle h, VkClearDepthStencilValue clear, VkAttachmentLoadOp load)
+{
+  VkClearValue value;
+  value.depthStencil = clear;
+  _graph->_passes[_pass].uses.push_back({h, Access::Depth, load, value});
+  _graph->_resources[h].usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+}
+
+void FrameGraph::Builder::sample(Handle h)
+{
+  _graph->_passes[_pass].uses.push_back({h, Access::Sample, VK_ATTACHMENT_LOAD_OP_LOAD, {}});
+  _graph->_resources[h].usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+}
+
+void FrameGraph::Builder::secondary()
+{
+  _graph->_passes[_pass].secondary = true;
+}
+
+void FrameGraph::Builder::side_effect()
+{
+  _graph->_passes[_pass].side_effect = true;
+}
+
+FrameGraph::FrameGraph(VulkanDevice *dev) : _device(dev)
+{
+}
+
+FrameGraph::~FrameGraph()
+{
+  release_transients();
+
+  VkDevice dev = *_device;
+  std::vector<VkRenderPass> passes;
+  for (auto &it : _render_passes)
+    passes.push_back(it.second);
+  _device->retire([dev, passes]() {
+    for (auto pass : passes)
+      vkDestroyRenderPass(dev, pass, nullptr);
+  });
+
+  std::vector<VkFramebuffer> frames;
+  for (auto &it : _framebuffers)
+    frames.push_back(it.second);
+  _device->retire_framebuffers(frames);
+}
+
+void FrameGraph::reset()
+{
+  _resources.clear();
+  _passes.clear();
+}
+
+FrameGraph::Handle FrameGraph::import_image(const std::string &name, VulkanImage *image)
+{
+  Resource r;
+  r.name = name;
+  r.kind = Kind::Imported;
+  r.image = image;
+  r.format = image->format();
+  r.width = image->width();
+  r.height = image->height();
+  _resources.push_back(r);
+  return Handle(_resources.size() - 1);
+}
+
+FrameGraph::Handle FrameGraph::import_swapchain(const std::string &name, VulkanSwapChain *swapchain)
+{
+  Resource r;
+  r.name = name;
+  r.kind = Kind::Swapchain;
+  r.swapchain = swapchain;
+  r.format = swapchain->color_format();
+  r.width = swapchain->width();
+  r.height = swapchain->height();
+  r.output = true;
+  _resources.push_back(r);
+  return Handle(_resources.size() - 1);
+}
+
+FrameGraph::Handle FrameGraph::create_image(const std::string &name, uint32_t w, uint32_t h, VkFormat format)
+{
+  Resource r;
+  r.name = name;
+  r.kind = Kind::Transient;
+  r.format = format;
+  r.width = w;
+  r.height = h;
+  _resources.push_back(r);
+  return Handle(_resources.size() - 1);
+}
+
+void FrameGraph::mark_output(Handle h)
+{
+  _resources[h].output = true;
+}
+
+void FrameGraph::add_pass(const std::string &name, const std::function<void(Builder &)> &setup, ExecuteFn fn)
+{
+  Pass pass;
+  pass.name = name;
+  pass.fn = std::move(fn);
+  _passes.push_back(std::move(pass));
+
+  Builder builder(this, uint32_t(_passes.size() - 1));
+  setup(builder);
+}
+
+void FrameGraph::compile()
+{
+  cull();
+
+  // attachments are only stored when a later pass or the outside world still reads them
+  for (size_t p = 0; p < _passes.size(); p++) {
+    if (_passes[p].culled)
+      continue;
+    for (auto &use : _passes[p].uses) {
+      auto &r = _resources[use.res];
+      bool needed = r.kind != Kind::Transient || r.output;
+      for (size_t q = p + 1; q < _passes.size() && !needed; q++) {
+        if (_passes[q].culled)
+          continue;
+        for (auto &later : _passes[q].uses)
+          needed |= later.res == use.res;
+      }
+      use.store = needed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+  }
+
+  bool recreated = false;
+  realize_transients(recreated);
+
+  // framebuffers hold imported views, a new set means the swapchain or an import was recreated
+  std::vector<uint64_t> key;
+  std::vector<VkImage> images;
+  for (auto &r : _resources) {
+    if (r.kind == Kind::Imported) {
+      key.push_back((uint64_t)r.image->image_view());
+      images.push_back(r.image->image());
+    } else if (r.kind == Kind::Swapchain) {
+      for (uint32_t i = 0; i < r.swapchain->image_count(); i++) {
+        key.push_back((uint64_t)r.swapchain->image_view(i));
+        images.push_back(r.swapchain->image(i));
+      }
+    }
+  }
+  if (recreated || key != _import_key) {
+    std::vector<VkFramebuffer> frames;
+    for (auto &it : _framebuffers)
+      frames.push_back(it.second);
+    _device->retire_framebuffers(frames);
+    _framebuffers.clear();
+    _import_key = key;
+
+    // states of images that are gone, their handles may come back for new images
+    for (auto it = _states.begin(); it != _states.end();) {
+      if (std::find(images.begin(), images.end(), it->first) == images.end())
+        it = _states.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  _stats.passes = 0;
+  _stats.culled = 0;
+  for (auto &pass : _passes) {
+    if (pass.culled) {
+      _stats.culled++;
+      continue;
+    }
+    _stats.passes++;
+
+    pass.render_pass = VK_NULL_HANDLE;
+    pass.attachments = false;
+    pass.color_formats.clear();
+    pass.depth_format = VK_FORMAT_UNDEFINED;
+    for (auto &use : pass.uses) {
+      if (use.access == Access::Sample)
+        continue;
+      auto &r = _resources[use.res];
+      pass.extent = {r.width, r.height};
+      pass.attachments = true;
+      if (use.access == Access::Color)
+        pass.color_formats.push_back(r.format);
+      else
+        pass.depth_format = r.format;
+    }
+    if (!pass.attachments)
+      continue;
+
+    if (!_dynamic) {
+      pass.render_pass = render_pass(pass);
+      continue;
+    }
+    bool stencil = vks::tools::formatAspect(pass.depth_format) & VK_IMAGE_ASPECT_STENCIL_BIT;
+    pass.inherit = {};
+    pass.inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    pass.inherit.colorAttachmentCount = uint32_t(pass.color_formats.size());
+    pass.inherit.pColorAttachmentFormats = pass.color_formats.data();
+    pass.inherit.depthAttachmentFormat = pass.depth_format;
+    pass.inherit.stencilAttachmentFormat = stencil ? pass.depth_format : VK_FORMAT_UNDEFINED;
+    pass.inherit.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  }
+}
+
+void FrameGraph::cull()
+{
+  std::vector<uint32_t> pass_refs(_passes.size(), 0), res_refs(_resources.size(), 0);
+  std::vector<std::vector<uint32_t>> writers(_resources.size());
+
+  for (uint32_t p = 0; p < _passes.size(); p++) {
+    auto &pass = _passes[p];
+    pass.culled = false;
+    for (auto &use : pass.uses) {
+      if (use.access != Access::Sample) {
+        pass_refs[p]++;
+        writers[use.res].push_back(p);
+      }
+      if (use.access == Access::Sample || use.load == VK_ATTACHMENT_LOAD_OP_LOAD)
+        res_refs[use.res]++;
+    }
+  }
+
+  std::vector<Handle> unused;
+  for (Handle r = 0; r < _resources.size(); r++) {
+    if (_resources[r].output)
+      res_refs[r]++;
+    if (res_refs[r] == 0)
+      unused.push_back(r);
+  }
+
+  // a pass goes once everything it writes is unused, then what it reads loses a reader
+  while (!unused.empty()) {
+    Handle r = unused.back();
+    unused.pop_back();
+    for (auto p : writers[r]) {
+      auto &pass = _passes[p];
+      if (pass.culled || --pass_refs[p] > 0 || pass.side_effect)
+        continue;
+      pass.culled = true;
+      for (auto &use : pass.uses) {
+        if (use.access == Access::Sample || use.load == VK_ATTACHMENT_LOAD_OP_LOAD) {
+          if (--res_refs[use.res] == 0)
+            unused.push_back(use.res);
+        }
+      }
+    }
+  }
+}
+
+void FrameGraph::realize_transients(bool &recreated)
+{
+  // lifetimes in kept pass order
+  std::vector<int32_t> first(_resources.size(), -1), last(_resources.size(), -1);
+  uint32_t order = 0;
+  for (auto &pass : _passes) {
+    if (pass.culled)
+      continue;
+    for (auto &use : pass.uses) {
+      if (first[use.res] < 0)
+        first[use.res] = int32_t(order);
+      last[use.res] = int32_t(order);
+    }
+    order++;
+  }
+
+  std::vector<Handle> used;
+  std::vector<uint64_t> key;
+  for (Handle h = 0; h < _resources.size(); h++) {
+    auto &r = _resources[h];
+    r.transient = -1;
+    if (r.kind != Kind::Transient || first[h] < 0)
+      continue;
+    r.transient = int32_t(used.size());
+    used.push_back(h);
+    key.insert(key.end(), {r.width, r.height, uint64_t(r.format), r.usage, uint64_t(first[h]), uint64_t(last[h])});
+  }
+
+  recreated = key != _transient_key;
+  if (!recreated)
+    return;
+
+  release_transients();
+  _transient_key = key;
+  _stats.transient_bytes = 0;
+  _stats.allocated_bytes = 0;
+
+  VkDevice dev = *_device;
+  std::vector<VkMemoryRequirements> reqs(used.size());
+  _transients.resize(used.size());
+  for (size_t t = 0; t < used.size(); t++) {
+    auto &r = _resources[used[t]];
+    VkImageCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.format = r.format;
+    info.extent = {r.width, r.height, 1};
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = r.usage;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK_RESULT(vkCreateImage(dev, &info, nullptr, &_transients[t].image));
+    vkGetImageMemoryRequirements(dev, _transients[t].image, &reqs[t]);
+    _transients[t].first = uint32_t(first[used[t]]);
+    _transients[t].last = uint32_t(last[used[t]]);
+    _stats.transient_bytes += reqs[t].size;
+  }
+
+  // largest first, each goes into the first slot it fits in without overlapping another lifetime
+  struct Slot {
+    VkMemoryRequirements reqs;
+    std::vector<uint32_t> members;
+  };
+  std::vector<Slot> slots;
+  std::vector<uint32_t> by_size(used.size());
+  for (uint32_t t = 0; t < by_size.size(); t++)
+    by_size[t] = t;
+  std::stable_sort(by_size.begin(), by_size.end(), [&](uint32_t a, uint32_t b) { return reqs[a].size > reqs[b].size; });
+
+  for (auto t : by_size) {
+    auto &tr = _transients[t];
+    int32_t found = -1;
+    for (uint32_t s = 0; s < slots.size() && found < 0; s++) {
+      if (!(slots[s].reqs.memoryTypeBits & reqs[t].memoryTypeBits))
+        continue;
+      bool overlap = false;
+      for (auto m : slots[s].members)
+        overlap |= !(_transients[m].last < tr.first || tr.last < _transients[m].first);
+      if (!overlap)
+        found = int32_t(s);
+    }
+    if (found < 0) {
+      slots.push_back({reqs[t], {}});
+      found = int32_t(slots.size() - 1);
+    }
+    auto &slot = slots[found];
+    slot.reqs.size = std::max(slot.reqs.size, reqs[t].size);
+    slot.reqs.alignment = std::max(slot.reqs.alignment, reqs[t].alignment);
+    slot.reqs.memoryTypeBits &= reqs[t].memoryTypeBits;
+    slot.members.push_back(t);
+    tr.slot = uint32_t(found);
+  }
+
+  auto allocator = _device->allocator();
+  _slots.resize(slots.size());
+  _slot_states.assign(slots.size(), State());
+  for (size_t s = 0; s < slots.size(); s++) {
+    _slots[s] = allocator->allocate(slots[s].reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::RenderTarget);
+    if (!_slots[s])
+      throw std::runtime_error("No proper memory type!");
+    _stats.allocated_bytes += slots[s].reqs.size;
+  }
+
+  for (size_t t = 0; t < used.size(); t++) {
+    auto &r = _resources[used[t]];
+    auto &tr = _transients[t];
+    VK_CHECK_RESULT(vkBindImageMemory(dev, tr.image, _slots[tr.slot].memory, _slots[tr.slot].offset));
+
+    VkImageViewCreateInfo view = {};
+    view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view.format = r.format;
+    view.subresourceRange = {vks::tools::formatAspect(r.format), 0, 1, 0, 1};
+    view.image = tr.image;
+    VK_CHECK_RESULT(vkCreateImageView(dev, &view, nullptr, &tr.view));
+  }
+}
+
+void FrameGraph::release_transients()
+{
+  if (_transients.empty() && _slots.empty())
+    return;
+
+  VkDevice dev = *_device;
+  auto allocator = _device->allocator();
+  _device->retire([dev, allocator, transients = _transients, slots = _slots]() mutable {
+    for (auto &t : transients) {
+      vkDestroyImageView(dev, t.view, nullptr);
+      vkDestroyImage(dev, t.image, nullptr);
+    }
+    for (auto &mem : slots)
+      allocator->free(mem);
+  });
+  _transients.clear();
+  _slots.clear();
+  _slot_states.clear();
+  _transient_key.clear();
+}
+
+VkRenderPass FrameGraph::render_pass(const Pass &pass)
+{
+  std::vector<VkAttachmentDescription> attachments;
+  std::vector<VkAttachmentReference> colors;
+  VkAttachmentReference depth = {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+  std::vector<uint64_t> key;
+
+  for (auto &use : pass.uses) {
+    if (use.access == Access::Sample)
+      continue;
+    auto &r = _resources[use.res];
+    VkImageLayout layout = use.access == Access::Color ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    // layouts are changed by the graph's barriers, the render pass keeps them as they are
+    VkAttachmentDescription attachment = {};
+    attachment.format = r.format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = use.load;
+    attachment.storeOp = use.store;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = layout;
+    attachment.finalLayout = layout;
+
+    VkAttachmentReference ref = {uint32_t(attachments.size()), layout};
+    if (use.access == Access::Color)
+      colors.push_back(ref);
+    else
+      depth = ref;
+    attachments.push_back(attachment);
+    key.insert(key.end(), {uint64_t(use.access), uint64_t(r.format), uint64_t(use.load), uint64_t(use.store)});
+  }
+
+  auto it = _render_passes.find(key);
+  if (it != _render_passes.end())
+    return it->second;
+
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = uint32_t(colors.size());
+  subpass.pColorAttachments = colors.data();
+  subpass.pDepthStencilAttachment = depth.attachment != VK_ATTACHMENT_UNUSED ? &depth : nullptr;
+
+  VkRenderPassCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  info.attachmentCount = uint32_t(attachments.size());
+  info.pAttachments = attachments.data();
+  info.subpassCount = 1;
+  info.pSubpasses = &subpass;
+
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateRenderPass(*_device, &info, nullptr, &render_pass));
+  _render_passes[key] = render_pass;
+  return render_pass;
+}
+
+VkFramebuffer FrameGraph::framebuffer(const Pass &pass, uint32_t image)
+{
+  std::vector<VkImageView> views;
+  std::vector<uint64_t> key = {(uint64_t)pass.render_pass, pass.extent.width, pass.extent.height};
+  for (auto &use : pass.uses) {
+    if (use.access == Access::Sample)
+      continue;
+    views.push_back(view_of(use.res, image));
+    key.push_back((uint64_t)views.back());
+  }
+
+  auto it = _framebuffers.find(key);
+  if (it != _framebuffers.end())
+    return it->second;
+
+  VkFramebufferCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  info.renderPass = pass.render_pass;
+  info.attachmentCount = uint32_t(views.size());
+  info.pAttachments = views.data();
+  info.width = pass.extent.width;
+  info.height = pass.extent.height;
+  info.layers = 1;
+
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &info, nullptr, &framebuffer));
+  _framebuffers[key] = framebuffer;
+  return framebuffer;
+}
+
+void FrameGraph::execute(VkCommandBuffer cmd, uint32_t image, uint32_t frame)
+{
+  _stats.barriers = 0;
+
+  // transients start every frame undefined, hazards carry over through their memory slot
+  std::vector<bool> touched(_transients.size(), false);
+  auto state_of = [&](Handle h) -> State & {
+    auto &r = _resources[h];
+    if (r.kind != Kind::Transient)
+      return _states[image_of(h, image)];
+    auto &s = _slot_states[_transients[r.transient].slot];
+    if (!touched[r.transient]) {
+      touched[r.transient] = true;
+      s.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    return s;
+  };
+
+  std::vector<VkImageMemoryBarrier> barriers;
+  VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+  auto transition = [&](Handle h, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access, bool write, bool discard) {
+    auto &s = state_of(h);
+    // reads of an image already in the right layout need nothing
+    if (s.layout == layout && !s.dirty && !write) {
+      s.stage |= stage;
+      return;
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = s.dirty ? s.access : 0;
+    barrier.dstAccessMask = access;
+    barrier.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : s.layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image_of(h, image);
+    barrier.subresourceRange = {vks::tools::formatAspect(_resources[h].format), 0, 1, 0, 1};
+    barriers.push_back(barrier);
+    src_stages |= s.stage ? s.stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    dst_stages |= stage;
+
+    s.layout = layout;
+    s.stage = stage;
+    s.access = access;
+    s.dirty = write;
+  };
+  auto flush = [&]() {
+    if (barriers.empty())
+      return;
+    vkCmdPipelineBarrier(cmd, src_stages, dst_stages, 0, 0, nullptr, 0, nullptr, uint32_t(barriers.size()), barriers.data());
+    _stats.barriers += uint32_t(barriers.size());
+    barriers.clear();
+    src_stages = dst_stages = 0;
+  };
+
+  for (auto &pass : _passes) {
+    if (pass.culled)
+      continue;
+
+    GpuScope scope(_profiler, cmd, pass.name.c_str());
+
+    std::vector<VkClearValue> clears;
+    for (auto &use : pass.uses) {
+      bool discard = use.load != VK_ATTACHMENT_LOAD_OP_LOAD;
+      if (use.access == Access::Color) {
+        VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (discard ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+        transition(use.res, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, access, true, discard);
+        clears.push_back(use.clear);
+      } else if (use.access == Access::Depth) {
+        transition(use.res, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true, discard);
+        clears.push_back(use.clear);
+      } else {
+        transition(use.res, vks::tools::sampledLayout(_resources[use.res].format), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false, false);
+      }
+    }
+    flush();
+
+    Context ctx = {cmd, image, frame, pass.render_pass, VK_NULL_HANDLE, pass.extent, nullptr};
+    if (!pass.attachments) {
+      pass.fn(ctx);
+      continue;
+    }
+
+    if (_dynamic) {
+      // the barriers above already left the attachments in their layouts, as with the render passes
+      std::vector<VkRenderingAttachmentInfo> colors;
+      VkRenderingAttachmentInfo depth = {}, stencil = {};
+      for (auto &use : pass.uses) {
+        if (use.access == Access::Sample)
+          continue;
+        VkRenderingAttachmentInfo attachment = {};
+        attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        attachment.imageView = view_of(use.res, image);
+        attachment.loadOp = use.load;
+        attachment.storeOp = use.store;
+        attachment.clearValue = use.clear;
+        if (use.access == Access::Color) {
+          attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+          colors.push_back(attachment);
+        } else {
+          attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+          depth = attachment;
+        }
+      }
+
+      VkRenderingInfo rendering = {};
+      rendering.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+      rendering.flags = pass.secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+      rendering.renderArea.extent = pass.extent;
+      rendering.layerCount = 1;
+      rendering.colorAttachmentCount = uint32_t(colors.size());
+      rendering.pColorAttachments = colors.data();
+      if (depth.imageView) {
+        rendering.pDepthAttachment = &depth;
+        // pipelines of a combined format expect the stencil aspect bound too, its contents are not kept
+        if (pass.inherit.stencilAttachmentFormat != VK_FORMAT_UNDEFINED) {
+          stencil = depth;
+          stencil.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+          stencil.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+          rendering.pStencilAttachment = &stencil;
+        }
+      }
+
+      ctx.rendering = &pass.inherit;
+      vkCmdBeginRendering(cmd, &rendering);
+      pass.fn(ctx);
+      vkCmdEndRendering(cmd);
+      continue;
+    }
+
+    ctx.framebuffer = framebuffer(pass, image);
+
+    VkRenderPassBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    begin.renderPass = pass.render_pass;
+    begin.framebuffer = ctx.framebuffer;
+    begin.renderArea.extent = pass.extent;
+    begin.clearValueCount = uint32_t(clears.size());
+    begin.pClearValues = clears.data();
+    vkCmdBeginRenderPass(cmd, &begin, pass.secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    pass.fn(ctx);
+    vkCmdEndRenderPass(cmd);
+  }
+
+  // the acquired image goes back to present, the next acquire's semaphore waits at color output
+  for (Handle h = 0; h < _resources.size(); h++) {
+    if (_resources[h].kind != Kind::Swapchain || !_states.count(image_of(h, image)))
+      continue;
+    transition(h, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false, false);
+    auto &s = state_of(h);
+    s.stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    s.dirty = false;
+  }
+  flush();
+}
+
+VkImageView FrameGraph::view(Handle h) const
+{
+  return view_of(h, 0);
+}
+
+VkImage FrameGraph::image_of(Handle h, uint32_t image) const
+{
+  auto &r = _resources[h];
+  switch (r.kind) {
+    case Kind::Imported:
+      return r.image->image();
+    case Kind::Swapchain:
+      return r.swapchain->image(image);
+    default:
+      return r.transient >= 0 ? _transients[r.transient].image : VK_NULL_HANDLE;
+  }
+}
+
+VkImageView FrameGraph::view_of(Handle h, uint32_t image) const
+{
+  auto &r = _resources[h];
+  switch (r.kind) {
+    case Kind::Imported:
+      return r.image->image_view();
+    case Kind::Swapchain:
+      return r.swapchain->image_view(image);
+    default:
+      return r.transient >= 0 ? _transients[r.transient].view : VK_NULL_HANDLE;
+  }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+class VulkanImage;
+class VulkanSwapChain;
+class GpuProfiler;
+
+// passes declare the images they write as attachments and the images they sample, the graph does the rest:
+// passes whose results nobody uses are culled, render passes and framebuffers come from a cache,
+// layout transitions and hazards are resolved with one merged barrier in front of each pass, and
+// transient attachments whose lifetimes do not overlap share memory.
+// the graph is declared again every frame (reset, import/create, add_pass, compile, execute), the
+// vulkan objects behind it are only recreated when the declaration actually changes.
+class FrameGraph {
+public:
+  using Handle = uint32_t;
+
+  struct Context {
+    VkCommandBuffer cmd;
+    uint32_t image;
+    uint32_t frame;
+    // the pass is begun on these, null for passes without attachments
+    VkRenderPass render_pass;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    // dynamic rendering only, what secondaries recorded inside the pass inherit
+    const VkCommandBufferInheritanceRenderingInfo *rendering;
+  };
+  using ExecuteFn = std::function<void(const Context &)>;
+
+  class Builder {
+  public:
+    // written as color attachment, cleared unless load says otherwise. LOAD also counts as a read.
+    void color(Handle h, VkClearColorValue clear = {}, VkAttachmentLoadOp load = VK_ATTACHMENT_LOAD_OP_CLEAR);
+    void depth(Handle h, VkClearDepthStencilValue clear = {1.f, 0}, VkAttachmentLoadOp load = VK_ATTACHMENT_LOAD_OP_CLEAR);
+    // read in the fragment shader through a combined image sampler, in vks::tools::sampledLayout of its format
+    void sample(Handle h);
+    // the render pass is begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+    void secondary();
+    // kept even when nothing reads what it writes
+    void side_effect();
+
+  private:
+    friend class FrameGraph;
+    Builder(FrameGraph *graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+    FrameGraph *_graph;
+    uint32_t _pass;
+  };
+
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culled = 0;
+    // image barriers recorded by the last execute
+    uint32_t barriers = 0;
+    // what the transients would take on their own and what they take aliased
+    VkDeviceSize transient_bytes = 0;
+    VkDeviceSize allocated_bytes = 0;
+  };
+
+  FrameGraph(VulkanDevice *dev);
+  ~FrameGraph();
+
+  // starts a new declaration, handles of the previous one are invalid afterwards
+  void reset();
+
+  // an image owned elsewhere, its layout is tracked across frames
+  Handle import_image(const std::string &name, VulkanImage *image);
+  // the image acquired for the frame, left in PRESENT_SRC at the end of the graph
+  Handle import_swapchain(const std::string &name, VulkanSwapChain *swapchain);
+  // lives only inside the graph, memory may be shared with other transients
+  Handle create_image(const std::string &name, uint32_t w, uint32_t h, VkFormat format);
+
+  // the image is needed after the graph, passes writing it are never culled
+  void mark_output(Handle h);
+
+  void add_pass(const std::string &name, const std::function<void(Builder &)> &setup, ExecuteFn fn);
+
+  void compile();
+
+  void execute(VkCommandBuffer cmd, uint32_t image, uint32_t frame);
+
+  // view of a transient for descriptor writes, valid until the next compile that changes the transients
+  VkImageView view(Handle h) const;
+
+  // passes are timestamped under their names
+  void set_profiler(GpuProfiler *profiler) { _profiler = profiler; }
+
+  // passes are begun with vkCmdBeginRendering, no render pass or framebuffer objects are made.
+  // the pipelines have to be built against the attachment formats then, see VulkanPass::set_dynamic.
+  void set_dynamic_rendering(bool dynamic) { _dynamic = dynamic; }
+  bool dynamic_rendering() const { return _dynamic; }
+
+  const Stats &stats() const { return _stats; }
+
+private:
+  enum class Kind : uint8_t { Imported, Swapchain, Transient };
+  enum class Access : uint8_t { Color, Depth, Sample };
+
+  struct Resource {
+    std::string name;
+    Kind kind;
+    VulkanImage *image = nullptr;
+    VulkanSwapChain *swapchain = nullptr;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0, height = 0;
+    VkImageUsageFlags usage = 0;
+    bool output = false;
+    // index into _transients after compile
+    int32_t transient = -1;
+  };
+
+  struct Use {
+    Handle res;
+    Access access;
+    VkAttachmentLoadOp load;
+    VkClearValue clear;
+    VkAttachmentStoreOp store = VK_ATTACHMENT_STORE_OP_STORE;
+  };
+
+  struct Pass {
+    std::string name;
+    std::vector<Use> uses;
+    ExecuteFn fn;
+    bool secondary = false;
+    bool side_effect = false;
+    bool culled = false;
+    // writes at least one attachment, the pass is begun around fn
+    bool attachments = false;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    VkExtent2D extent = {};
+    std::vector<VkFormat> color_formats;
+    VkFormat depth_format = VK_FORMAT_UNDEFINED;
+    VkCommandBufferInheritanceRenderingInfo inherit = {};
+  };
+
+  // what the last access to an image left behind
+  struct State {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stage = 0;
+    VkAccessFlags access = 0;
+    // the last access wrote, anything after it needs a barrier
+    bool dirty = false;
+  };
+
+  struct Transient {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    uint32_t slot = 0;
+    // first and last kept pass using it
+    uint32_t first = 0, last = 0;
+  };
+
+  void cull();
+  // sets recreated when the images were created again, framebuffers using them are stale then
+  void realize_transients(bool &recreated);
+  void release_transients();
+  VkRenderPass render_pass(const Pass &pass);
+  VkFramebuffer framebuffer(const Pass &pass, uint32_t image);
+
+  VkImage image_of(Handle h, uint32_t image) const;
+  VkImageView view_of(Handle h, uint32_t image) const;
+
+private:
+  VulkanDevice *_device = nullptr;
+  GpuProfiler *_profiler = nullptr;
+  bool _dynamic = false;
+
+  std::vector<Resource> _resources;
+  std::vector<Pass> _passes;
+
+  std::vector<Transient> _transients;
+  // one allocation per alias slot, shared by the transients assigned to it
+  std::vector<MemoryAllocation> _slots;
+  std::vector<State> _slot_states;
+  // sizes, formats, usage and lifetimes the transients were created for
+  std::vector<uint64_t> _transient_key;
+
+  std::map<std::vector<uint64_t>, VkRenderPass> _render_passes;
+  std::map<std::vector<uint64_t>, VkFramebuffer> _framebuffers;
+  // imported views the framebuffers were created against
+  std::vector<uint64_t> _import_key;
+
+  std::map<VkImage, State> _states;
+
+  Stats _stats;
+};
@@ -9,8 +9,86 @@
 #include "VulkanTexture.h"
 #include "tmath.h"
 #include "RenderData.h"
+#include "MeshoptDecoder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 #include <set>
+#include <thread>
+
+namespace {
+
+const char *meshopt_ext = "EXT_meshopt_compression";
+const char *draco_ext = "KHR_draco_mesh_compression";
+
+const uint32_t glb_magic = 0x46546C67;
+const uint32_t glb_json = 0x4E4F534A;
+const uint32_t glb_bin = 0x004E4942;
+
+uint32_t read_u32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+void write_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+  auto p = reinterpret_cast<const uint8_t *>(&v);
+  out.insert(out.end(), p, p + sizeof(v));
+}
+
+// meshopt fallback buffers carry no data by design, tiny_gltf wants a uri (or the glb chunk) for every buffer
+bool strip_fallback_buffers(nlohmann::json &doc)
+{
+  auto buffers = doc.find("buffers");
+  if (buffers == doc.end() || !buffers->is_array())
+    return false;
+
+  bool changed = false;
+  for (auto &buf : *buffers) {
+    if (buf.contains("uri"))
+      continue;
+    auto ext = buf.find("extensions");
+    if (ext == buf.end() || !ext->contains(meshopt_ext))
+      continue;
+    buf["uri"] = "data:application/octet-stream;base64,AAAAAA==";
+    buf["byteLength"] = 4;
+    changed = true;
+  }
+  return changed;
+}
+
+// min/max are stored in the accessor component space, apply the same normalization as the data
+float component_value(const tinygltf::Accessor &acc, double v)
+{
+  if (!acc.normalized)
+    return float(v);
+  switch (acc.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+      return std::max(float(v) / 127.f, -1.f);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return float(v) / 255.f;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+      return std::max(float(v) / 32767.f, -1.f);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return float(v) / 65535.f;
+  }
+  return float(v);
+}
+
+bool requires_extension(const nlohmann::json &doc, const char *ext)
+{
+  auto required = doc.find("extensionsRequired");
+  if (required == doc.end() || !required->is_array())
+    return false;
+  return std::find(required->begin(), required->end(), ext) != required->end();
+}
+
+}
 
 GLTFLoader::GLTFLoader() 
 {
@@ -20,12 +98,267 @@ GLTFLoader::~GLTFLoader()
 {
 }
 
-std::shared_ptr<MeshInstance> GLTFLoader::load_file(const std::string& file)
+std::shared_future<std::shared_ptr<MeshInstance>> GLTFLoader::load_file_async(const std::string &file)
+{
+  // every task gets its own loader, the parsed model is loader state
+  return std::async(std::launch::async, [file]() {
+    GLTFLoader loader;
+    return loader.load_file(file);
+  }).share();
+}
+
+bool GLTFLoader::parse(const std::string &file)
 {
+  std::ifstream is(file, std::ios::binary);
+  if (!is) {
+    std::cerr << "Could not open " << file << std::endl;
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+  const uint8_t *bin = nullptr;
+  size_t bin_size = 0;
+  std::string text;
+  bool binary = bytes.size() >= 20 && read_u32(bytes.data()) == glb_magic;
+  if (binary) {
+    uint32_t json_size = read_u32(bytes.data() + 12);
+    if (read_u32(bytes.data() + 16) != glb_json || 20 + size_t(json_size) > bytes.size()) {
+      std::cerr << file << ": broken glb header" << std::endl;
+      return false;
+    }
+    text.assign(reinterpret_cast<const char *>(bytes.data() + 20), json_size);
+    size_t bin_chunk = 20 + size_t(json_size);
+    if (bin_chunk + 8 <= bytes.size() && read_u32(bytes.data() + bin_chunk + 4) == glb_bin) {
+      bin = bytes.data() + bin_chunk + 8;
+      bin_size = std::min<size_t>(read_u32(bytes.data() + bin_chunk), bytes.size() - bin_chunk - 8);
+    }
+  } else {
+    text.assign(bytes.begin(), bytes.end());
+  }
+
+  // only documents that mention the compression extensions need a look before tiny_gltf gets them
+  if (text.find(meshopt_ext) != std::string::npos || text.find(draco_ext) != std::string::npos) {
+    auto doc = nlohmann::json::parse(text, nullptr, false);
+    if (doc.is_discarded()) {
+      std::cerr << file << ": invalid json" << std::endl;
+      return false;
+    }
+    if (requires_extension(doc, draco_ext)) {
+      std::cerr << file << ": draco compressed geometry is not supported" << std::endl;
+      return false;
+    }
+    if (strip_fallback_buffers(doc))
+      text = doc.dump();
+  }
+
   tinygltf::TinyGLTF gltf;
   std::string err, warn;
+  std::string base_dir = tinygltf::GetBaseDir(file);
   _m = std::make_shared<tinygltf::Model>();
-  if (!gltf.LoadASCIIFromFile(_m.get(), &err, &warn, file))
+
+  bool ok = false;
+  if (binary) {
+    while (text.size() % 4)
+      text.push_back(' ');
+    std::vector<uint8_t> glb;
+    glb.reserve(28 + text.size() + bin_size);
+    write_u32(glb, glb_magic);
+    write_u32(glb, 2);
+    write_u32(glb, uint32_t(20 + text.size() + (bin ? 8 + bin_size : 0)));
+    write_u32(glb, uint32_t(text.size()));
+    write_u32(glb, glb_json);
+    glb.insert(glb.end(), text.begin(), text.end());
+    if (bin) {
+      write_u32(glb, uint32_t(bin_size));
+      write_u32(glb, glb_bin);
+      glb.insert(glb.end(), bin, bin + bin_size);
+    }
+    ok = gltf.LoadBinaryFromMemory(_m.get(), &err, &warn, glb.data(), uint32_t(glb.size()), base_dir);
+  } else {
+    ok = gltf.LoadASCIIFromString(_m.get(), &err, &warn, text.data(), uint32_t(text.size()), base_dir);
+  }
+
+  if (!ok) {
+    std::cerr << file << ": " << err << std::endl;
+    return false;
+  }
+
+  return decode_meshopt();
+}
+
+bool GLTFLoader::decode_meshopt()
+{
+  _views.assign(_m->bufferViews.size(), {});
+
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < _m->bufferViews.size(); i++) {
+    if (_m->bufferViews[i].extensions.count(meshopt_ext))
+      pending.push_back(i);
+  }
+  if (pending.empty())
+    return true;
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> ok{true};
+  auto worker = [&]() {
+    for (size_t k = next++; k < pending.size(); k = next++) {
+      size_t view = pending[k];
+      if (!decode_view(view, _m->bufferViews[view].extensions.at(meshopt_ext)))
+        ok = false;
+    }
+  };
+
+  size_t nthreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), pending.size());
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < nthreads; t++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers)
+    w.join();
+
+  return ok;
+}
+
+bool GLTFLoader::decode_view(size_t view, const tinygltf::Value &ext)
+{
+  auto num = [&](const char *key) -> size_t {
+    return ext.Has(key) && ext.Get(key).IsNumber() ? size_t(ext.Get(key).GetNumberAsInt()) : 0;
+  };
+  auto str = [&](const char *key, const char *def) -> std::string {
+    return ext.Has(key) && ext.Get(key).IsString() ? ext.Get(key).Get<std::string>() : def;
+  };
+
+  size_t buffer = num("buffer");
+  size_t offset = num("byteOffset");
+  size_t length = num("byteLength");
+  size_t stride = num("byteStride");
+  size_t count = num("count");
+  std::string mode = str("mode", "");
+  std::string filter = str("filter", "NONE");
+
+  if (buffer >= _m->buffers.size() || offset + length > _m->buffers[buffer].data.size() || stride == 0) {
+    std::cerr << "meshopt buffer view " << view << " is out of range" << std::endl;
+    return false;
+  }
+
+  const uint8_t *src = _m->buffers[buffer].data.data() + offset;
+  auto &out = _views[view];
+  out.resize(count * stride);
+
+  bool ok = false;
+  if (mode == "ATTRIBUTES") {
+    meshopt::Filter f = meshopt::Filter::None;
+    if (filter == "OCTAHEDRAL")
+      f = meshopt::Filter::Octahedral;
+    else if (filter == "QUATERNION")
+      f = meshopt::Filter::Quaternion;
+    else if (filter == "EXPONENTIAL")
+      f = meshopt::Filter::Exponential;
+    ok = meshopt::decode_vertex_buffer(out.data(), count, stride, src, length) &&
+         meshopt::apply_filter(f, out.data(), count, stride);
+  } else if (mode == "TRIANGLES") {
+    ok = meshopt::decode_index_buffer(out.data(), count, stride, src, length);
+  } else if (mode == "INDICES") {
+    ok = meshopt::decode_index_sequence(out.data(), count, stride, src, length);
+  }
+
+  if (!ok) {
+    std::cerr << "failed to decode meshopt buffer view " << view << " (" << mode << ")" << std::endl;
+    out.clear();
+  }
+  return ok;
+}
+
+const uint8_t *GLTFLoader::view_data(int view)
+{
+  if (!_views[view].empty())
+    return _views[view].data();
+  auto &bufview = _m->bufferViews[view];
+  return _m->buffers[bufview.buffer].data.data() + bufview.byteOffset;
+}
+
+const uint8_t *GLTFLoader::accessor_data(int accessor, size_t elem_size, int &stride)
+{
+  if (accessor < 0 || size_t(accessor) >= _m->accessors.size())
+    return nullptr;
+  auto &acc = _m->accessors[accessor];
+  if (acc.bufferView < 0 || size_t(acc.bufferView) >= _m->bufferViews.size())
+    return nullptr;
+  auto &bufview = _m->bufferViews[acc.bufferView];
+  stride = acc.ByteStride(bufview);
+  if (stride <= 0)
+    return nullptr;
+
+  // a decoded meshopt view is count * byteStride bytes, a plain one byteLength bytes of its buffer
+  size_t size = _views[acc.bufferView].size();
+  if (size == 0) {
+    if (bufview.buffer < 0 || size_t(bufview.buffer) >= _m->buffers.size() ||
+        bufview.byteOffset + bufview.byteLength > _m->buffers[bufview.buffer].data.size())
+      return nullptr;
+    size = bufview.byteLength;
+  }
+  if (acc.count > 0 && acc.byteOffset + (acc.count - 1) * size_t(stride) + elem_size > size) {
+    std::cerr << "accessor " << accessor << " reads past its buffer view" << std::endl;
+    return nullptr;
+  }
+  return view_data(acc.bufferView) + acc.byteOffset;
+}
+
+bool GLTFLoader::read_floats(int accessor, int comps, std::vector<float> &out)
+{
+  if (accessor < 0 || size_t(accessor) >= _m->accessors.size())
+    return false;
+  auto &acc = _m->accessors[accessor];
+  int comp_size = tinygltf::GetComponentSizeInBytes(acc.componentType);
+  if (comp_size <= 0)
+    return false;
+  int stride = 0;
+  const uint8_t *data = accessor_data(accessor, size_t(comps) * comp_size, stride);
+  if (!data)
+    return false;
+
+  out.resize(acc.count * comps);
+  for (size_t i = 0; i < acc.count; i++) {
+    const uint8_t *e = data + i * stride;
+    float *o = out.data() + i * comps;
+    for (int c = 0; c < comps; c++) {
+      float v = 0;
+      switch (acc.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+          memcpy(&v, e + c * 4, 4);
+          break;
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+          v = float(int8_t(e[c]));
+          if (acc.normalized) v = std::max(v / 127.f, -1.f);
+          break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+          v = float(e[c]);
+          if (acc.normalized) v /= 255.f;
+          break;
+        case TINYGLTF_COMPONENT_TYPE_SHORT: {
+          int16_t x;
+          memcpy(&x, e + c * 2, 2);
+          v = float(x);
+          if (acc.normalized) v = std::max(v / 32767.f, -1.f);
+        } break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+          uint16_t x;
+          memcpy(&x, e + c * 2, 2);
+          v = float(x);
+          if (acc.normalized) v /= 65535.f;
+        } break;
+        default:
+          return false;
+      }
+      o[c] = v;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<MeshInstance> GLTFLoader::load_file(const std::string& file)
+{
+  if (!parse(file))
     return nullptr;
   //_m->scenes;
 
@@ -72,13 +405,18 @@ std::shared_ptr<MeshInstance> GLTFLoader::load_file(const std::string& file)
     r.identity(); if(!node.rotation.empty()) r = tg::mat4d(tg::dmat3(tg::quatd(tg::vec4d(node.rotation.data()))));
     s.identity(); if(!node.scale.empty()) s = tg::scale(tg::vec3d(node.scale.data()));
 
-    auto mesh = _m->meshes[node.mesh];
+    if (node.mesh < 0)
+      continue;
+    auto &mesh = _m->meshes[node.mesh];
     for (auto &pri : mesh.primitives) {
       auto mesh_pri = create_primitive(&pri);
+      if (!mesh_pri)
+        continue;
       auto dm = m * t *s * r;
       mesh_pri->set_transform(tg::mat4(dm));
 
-      mesh_pri->set_material(materials[pri.material]);
+      if (pri.material >= 0)
+        mesh_pri->set_material(materials[pri.material]);
 
       meshInst->add_primitive(mesh_pri);
     }
@@ -93,54 +431,81 @@ GLTFLoader::create_primitive(const tinygltf::Primitive *pri)
   auto mesh_pri = std::make_shared<MeshPrimitive>();
 
   for (auto &attr : pri->attributes) {
-    VkVertexInputBindingDescription vkinput;
-    VkVertexInputAttributeDescription vkattr;
-    auto &acc = _m->accessors[attr.second];
-    auto &bufview = _m->bufferViews[acc.bufferView];
-    auto &buf = _m->buffers[bufview.buffer];
+    std::vector<float> data;
+    // an attribute that cannot be read means a broken file, the primitive is left out
     if (attr.first.compare("POSITION") == 0) {
-      vkattr.location = 0;
-      vkattr.binding = 0;
-      mesh_pri->set_vertex(buf.data.data() + bufview.byteOffset, bufview.byteLength);
+      if (!read_floats(attr.second, 3, data))
+        return nullptr;
+      mesh_pri->set_vertex((uint8_t *)data.data(), data.size() * sizeof(float));
+
+      // min/max are required on POSITION by the spec, only scan the data when a file leaves them out
+      tg::boundingbox box;
+      auto &acc = _m->accessors[attr.second];
+      if (acc.minValues.size() == 3 && acc.maxValues.size() == 3) {
+        float lo[3], hi[3];
+        for (int c = 0; c < 3; c++) {
+          lo[c] = component_value(acc, acc.minValues[c]);
+          hi[c] = component_value(acc, acc.maxValues[c]);
+        }
+        box = tg::boundingbox(tg::vec3(lo[0], lo[1], lo[2]), tg::vec3(hi[0], hi[1], hi[2]));
+      } else {
+        for (size_t i = 0; i + 2 < data.size(); i += 3)
+          box.expand(tg::vec3(data[i], data[i + 1], data[i + 2]));
+      }
+      mesh_pri->set_bound(box);
     } else if (attr.first.compare("NORMAL") == 0) {
-      vkattr.location = 1;
-      vkattr.binding = 1;
-      mesh_pri->set_normal(buf.data.data() + bufview.byteOffset, bufview.byteLength);
+      if (!read_floats(attr.second, 3, data))
+        return nullptr;
+      mesh_pri->set_normal((uint8_t *)data.data(), data.size() * sizeof(float));
     } else if (attr.first.compare("TEXCOORD_0") == 0) {
-      vkattr.location = 2;
-      vkattr.binding = 2;
-      mesh_pri->set_uvs(buf.data.data() + bufview.byteOffset, bufview.byteLength);
-    } else if (attr.first.compare("TEXCOORD_1") == 1) {
-      vkattr.location = 3;
-      vkattr.binding = 3;
-    } else
-      continue;
-
-    //vkattr.format = attr_format(&acc);
-    //vkattr.offset = 0;
-    //vkinput.binding = vkattr.binding;
-    //vkinput.stride = acc.ByteStride(_m->bufferViews[acc.bufferView]);
-    //vkinput.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+      if (!read_floats(attr.second, 2, data))
+        return nullptr;
+      mesh_pri->set_uvs((uint8_t *)data.data(), data.size() * sizeof(float));
+    }
   }
   //if (pri->mode == TINYGLTF_MODE_LINE_LOOP)
   //else if (pri->mode == TINYGLTF_MODE_TRIANGLES)
   //else return nullptr;
 
   if (pri->indices >= 0) {
+    if (size_t(pri->indices) >= _m->accessors.size())
+      return nullptr;
     auto &idx_acc = _m->accessors[pri->indices];
-    auto ty = idx_acc.componentType;
-    auto &bufview = _m->bufferViews[idx_acc.bufferView];
-    auto &buf = _m->buffers[bufview.buffer];
-
-    if (ty == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-      mesh_pri->_index_type = VK_INDEX_TYPE_UINT16;
-      mesh_pri->set_index(buf.data.data() + bufview.byteOffset, bufview.byteLength);
-    }
-    else if (ty == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-      mesh_pri->_index_type = VK_INDEX_TYPE_UINT32;
-    else
+    int comp_size = tinygltf::GetComponentSizeInBytes(idx_acc.componentType);
+    if (comp_size <= 0)
+      return nullptr;
+    int stride = 0;
+    const uint8_t *data = accessor_data(pri->indices, comp_size, stride);
+    if (!data)
       return nullptr;
 
+    std::vector<uint16_t> indices(idx_acc.count);
+    for (size_t i = 0; i < idx_acc.count; i++) {
+      uint32_t v = 0;
+      switch (idx_acc.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+          v = data[i * stride];
+          break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+          uint16_t x;
+          memcpy(&x, data + i * stride, 2);
+          v = x;
+        } break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+          memcpy(&v, data + i * stride, 4);
+          break;
+        default:
+          return nullptr;
+      }
+      // the primitive stores 16 bit indices only
+      if (v > 0xffff) {
+        std::cerr << "primitive needs 32 bit indices, skipped" << std::endl;
+        return nullptr;
+      }
+      indices[i] = uint16_t(v);
+    }
+    mesh_pri->_index_type = VK_INDEX_TYPE_UINT16;
+    mesh_pri->set_index((uint8_t *)indices.data(), indices.size() * sizeof(uint16_t));
   }
 
   return mesh_pri; 
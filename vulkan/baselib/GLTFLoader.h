@@ -2,6 +2,8 @@
 
 #include <string>
 #include <memory>
+#include <future>
+#include <vector>
 #include <vulkan/vulkan_core.h>
 
 #include "tvec.h"
@@ -11,6 +13,7 @@ namespace tinygltf{
   class Accessor;
   class BufferView;
   class Primitive;
+  class Value;
 } 
 
 class VulkanDevice;
@@ -25,12 +28,33 @@ public:
 
   std::shared_ptr<MeshInstance> load_file(const std::string &file);
 
+  // parses and decodes on a worker thread, realize the mesh once the future is ready
+  static std::shared_future<std::shared_ptr<MeshInstance>> load_file_async(const std::string &file);
+
 private:
 
+  bool parse(const std::string &file);
+
+  // decodes every EXT_meshopt_compression buffer view, spread over worker threads
+  bool decode_meshopt();
+
+  bool decode_view(size_t view, const tinygltf::Value &ext);
+
+  const uint8_t *view_data(int view);
+
+  // first element of the accessor, null unless every element of elem_size bytes lies inside its view
+  const uint8_t *accessor_data(int accessor, size_t elem_size, int &stride);
+
+  // accessor converted to tightly packed floats, normalized and quantized components included
+  bool read_floats(int accessor, int comps, std::vector<float> &out);
+
   std::shared_ptr<MeshPrimitive> create_primitive(const tinygltf::Primitive *pri);
 
   VkFormat attr_format(const tinygltf::Accessor *acc);
 
 private:
   std::shared_ptr<tinygltf::Model> _m;
+
+  // decoded payload per buffer view, empty when the view is stored plain
+  std::vector<std::vector<uint8_t>> _views;
 };
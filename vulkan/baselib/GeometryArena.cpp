@@ -0,0 +1,132 @@
+#include "GeometryArena.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include "tvec.h"
+
+bool GeometryArena::FreeList::allocate(uint32_t count, uint32_t &first)
+{
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    if (it->second < count)
+      continue;
+    first = it->first;
+    uint32_t rest = it->second - count;
+    ranges.erase(it);
+    if (rest)
+      ranges[first + count] = rest;
+    return true;
+  }
+  return false;
+}
+
+void GeometryArena::FreeList::release(uint32_t first, uint32_t count)
+{
+  auto next = ranges.lower_bound(first);
+  if (next != ranges.end() && first + count == next->first) {
+    count += next->second;
+    next = ranges.erase(next);
+  }
+  if (next != ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == first) {
+      prev->second += count;
+      return;
+    }
+  }
+  ranges[first] = count;
+}
+
+GeometryArena::GeometryArena(VulkanDevice *dev, uint32_t vertex_capacity, uint32_t index_capacity)
+  : _device(dev), _vertex_capacity(vertex_capacity), _index_capacity(index_capacity)
+{
+}
+
+GeometryArena::~GeometryArena()
+{
+  for (auto &page : _pages) {
+    for (uint32_t s = 0; s < StreamCount; s++)
+      vkDestroyBuffer(*_device, page->streams[s], nullptr);
+    vkDestroyBuffer(*_device, page->indices, nullptr);
+    for (auto &mem : page->memory)
+      _device->allocator()->free(mem);
+  }
+}
+
+VkDeviceSize GeometryArena::stride(Stream s)
+{
+  return s == UV ? sizeof(tg::vec2) : sizeof(tg::vec3);
+}
+
+VkBuffer GeometryArena::create(VkDeviceSize size, VkBufferUsageFlags usage, MemoryAllocation &mem)
+{
+  VkBufferCreateInfo info = vks::initializers::bufferCreateInfo(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size);
+  info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkBuffer buf = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateBuffer(*_device, &info, nullptr, &buf));
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(*_device, buf, &reqs);
+  MemoryCategory category = (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ? MemoryCategory::Index : MemoryCategory::Vertex;
+  mem = _device->allocator()->allocate(reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, category);
+  if (!mem)
+    throw std::runtime_error("No proper memory type!");
+  VK_CHECK_RESULT(vkBindBufferMemory(*_device, buf, mem.memory, mem.offset));
+  return buf;
+}
+
+void GeometryArena::add_page()
+{
+  auto page = std::make_unique<Page>();
+  for (uint32_t s = 0; s < StreamCount; s++)
+    page->streams[s] = create(_vertex_capacity * stride(Stream(s)), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, page->memory[s]);
+  page->indices = create(_index_capacity * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, page->memory[StreamCount]);
+  page->vertices.ranges[0] = _vertex_capacity;
+  page->index_list.ranges[0] = _index_capacity;
+  _pages.push_back(std::move(page));
+}
+
+bool GeometryArena::allocate(uint32_t vertex_count, uint32_t index_count, Range &vertices, Range &indices)
+{
+  vertices = indices = Range();
+  if (vertex_count == 0 || index_count == 0 || vertex_count > _vertex_capacity || index_count > _index_capacity)
+    return false;
+
+  auto place = [&](uint32_t p) {
+    auto &page = *_pages[p];
+    if (!page.vertices.allocate(vertex_count, vertices.first))
+      return false;
+    if (!page.index_list.allocate(index_count, indices.first)) {
+      page.vertices.release(vertices.first, vertex_count);
+      return false;
+    }
+    vertices.page = indices.page = p;
+    vertices.count = vertex_count;
+    indices.count = index_count;
+    return true;
+  };
+
+  for (uint32_t p = 0; p < _pages.size(); p++) {
+    if (place(p))
+      return true;
+  }
+  // a fresh page always has room for counts within capacity
+  add_page();
+  return place(uint32_t(_pages.size() - 1));
+}
+
+void GeometryArena::free(Range &vertices, Range &indices)
+{
+  if (vertices)
+    _pages[vertices.page]->vertices.release(vertices.first, vertices.count);
+  if (indices)
+    _pages[indices.page]->index_list.release(indices.first, indices.count);
+  vertices = indices = Range();
+}
+
+void GeometryArena::bind(VkCommandBuffer cmd, uint32_t page, uint32_t stream_count)
+{
+  VkDeviceSize offsets[StreamCount] = {};
+  vkCmdBindVertexBuffers(cmd, 0, stream_count, _pages[page]->streams, offsets);
+  vkCmdBindIndexBuffer(cmd, _pages[page]->indices, 0, VK_INDEX_TYPE_UINT16);
+}
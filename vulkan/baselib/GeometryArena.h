@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+
+// shared device local vertex and index storage for all mesh primitives.
+// vertices live in three streams (position, normal, uv) that share one vertex index, so a
+// primitive is just a vertex range plus an index range drawn with vertexOffset/firstIndex.
+// pages are added when a page runs full, draws only rebind when the page changes.
+class GeometryArena {
+public:
+  enum Stream { Position, Normal, UV, StreamCount };
+
+  struct Range {
+    uint32_t page = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    explicit operator bool() const { return count != 0; }
+  };
+
+  GeometryArena(VulkanDevice *dev, uint32_t vertex_capacity = 1u << 20, uint32_t index_capacity = 4u << 20);
+  ~GeometryArena();
+
+  // a vertex and an index range on the same page, a page is added when none has room for both.
+  // false when the counts exceed a page
+  bool allocate(uint32_t vertex_count, uint32_t index_count, Range &vertices, Range &indices);
+
+  void free(Range &vertices, Range &indices);
+
+  VkBuffer stream(uint32_t page, Stream s) const { return _pages[page]->streams[s]; }
+  VkBuffer index_buffer(uint32_t page) const { return _pages[page]->indices; }
+
+  static VkDeviceSize stride(Stream s);
+
+  // binds the first stream_count streams and the uint16 index buffer of the page
+  void bind(VkCommandBuffer cmd, uint32_t page, uint32_t stream_count);
+
+private:
+  // first fit over sorted free ranges, neighbours merge when a range comes back
+  struct FreeList {
+    std::map<uint32_t, uint32_t> ranges;
+
+    bool allocate(uint32_t count, uint32_t &first);
+    void release(uint32_t first, uint32_t count);
+  };
+
+  struct Page {
+    VkBuffer streams[StreamCount] = {};
+    VkBuffer indices = VK_NULL_HANDLE;
+    MemoryAllocation memory[StreamCount + 1];
+
+    FreeList vertices, index_list;
+  };
+
+  VkBuffer create(VkDeviceSize size, VkBufferUsageFlags usage, MemoryAllocation &mem);
+  void add_page();
+
+private:
+  VulkanDevice *_device = nullptr;
+  uint32_t _vertex_capacity = 0, _index_capacity = 0;
+
+  std::vector<std::unique_ptr<Page>> _pages;
+};
@@ -0,0 +1,191 @@
+#include "GpuProfiler.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include "imgui/imgui.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// samples in the rolling average
+const size_t history_size = 64;
+// trace events kept for export, a few seconds worth
+const size_t trace_size = 16384;
+
+}
+
+GpuProfiler::GpuProfiler(VulkanDevice *dev, uint32_t frames, uint32_t max_scopes)
+  : _device(dev), _frames(frames), _max_scopes(max_scopes)
+{
+  _armed.assign(frames, false);
+  _in_flight.assign(frames, false);
+
+  auto &limits = _device->device_properties().limits;
+  uint32_t valid_bits = _device->queue_family_properties()[_device->graphics_family()].timestampValidBits;
+  if (!limits.timestampComputeAndGraphics || valid_bits == 0) {
+    std::cout << "gpu profiler: no timestamp support on the graphics queue" << std::endl;
+    return;
+  }
+  _period_ns = limits.timestampPeriod;
+  _mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  info.queryCount = frames * max_scopes * 2;
+  VK_CHECK_RESULT(vkCreateQueryPool(*_device, &info, nullptr, &_pool));
+}
+
+GpuProfiler::~GpuProfiler()
+{
+  if (_pool)
+    vkDestroyQueryPool(*_device, _pool, nullptr);
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, uint32_t frame)
+{
+  if (!_pool)
+    return;
+  _cmd_frames[cmd] = frame;
+  vkCmdResetQueryPool(cmd, _pool, frame * _max_scopes * 2, _max_scopes * 2);
+  _armed[frame] = true;
+  _in_flight[frame] = true;
+}
+
+void GpuProfiler::attach(VkCommandBuffer cmd, uint32_t frame)
+{
+  if (_pool)
+    _cmd_frames[cmd] = frame;
+}
+
+int32_t GpuProfiler::begin_query(VkCommandBuffer cmd, const char *name)
+{
+  auto frame = _cmd_frames.find(cmd);
+  if (!_pool || frame == _cmd_frames.end() || !_armed[frame->second])
+    return -1;
+
+  auto it = _scopes.find(name);
+  if (it == _scopes.end()) {
+    if (_passes.size() >= _max_scopes)
+      return -1;
+    it = _scopes.emplace(name, uint32_t(_passes.size())).first;
+    _passes.push_back({name});
+    _history.emplace_back();
+  }
+
+  int32_t query = int32_t((frame->second * _max_scopes + it->second) * 2);
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _pool, query);
+  return query;
+}
+
+void GpuProfiler::collect(uint32_t frame)
+{
+  if (!_pool)
+    return;
+
+  uint32_t n = uint32_t(_passes.size());
+  if (_in_flight[frame] && n > 0) {
+    // value and availability of begin and end for every scope
+    std::vector<uint64_t> data(n * 4);
+    uint64_t first = ~0ull, last = 0;
+    vkGetQueryPoolResults(*_device, _pool, frame * _max_scopes * 2, n * 2, data.size() * sizeof(uint64_t), data.data(),
+                          2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    for (uint32_t s = 0; s < n; s++) {
+      const uint64_t *q = &data[s * 4];
+      // scopes not recorded into this frame stay unavailable after the reset
+      if (!q[1] || !q[3])
+        continue;
+      uint64_t begin = q[0] & _mask, end = q[2] & _mask;
+      double ms = double((end - begin) & _mask) * _period_ns / 1e6;
+
+      auto &history = _history[s];
+      history.push_back(ms);
+      if (history.size() > history_size)
+        history.pop_front();
+      double sum = 0;
+      for (auto v : history)
+        sum += v;
+      _passes[s].last_ms = ms;
+      _passes[s].avg_ms = sum / history.size();
+
+      first = std::min(first, begin);
+      last = std::max(last, end);
+
+      if (!_trace_origin)
+        _trace_origin = begin;
+      _trace.push_back({s, begin, end});
+      if (_trace.size() > trace_size)
+        _trace.pop_front();
+    }
+
+    if (first <= last) {
+      _span_ms = double((last - first) & _mask) * _period_ns / 1e6;
+      _collected++;
+    }
+  }
+  _in_flight[frame] = false;
+}
+
+double GpuProfiler::frame_ms() const
+{
+  double ms = 0;
+  for (auto &p : _passes)
+    ms += p.avg_ms;
+  return ms;
+}
+
+void GpuProfiler::draw()
+{
+  ImGui::SetNextWindowSize(ImVec2(300, 160), ImGuiCond_Once);
+  ImGui::Begin("gpu");
+  if (!_pool)
+    ImGui::Text("no timestamp queries");
+  for (auto &p : _passes)
+    ImGui::Text("%-14s %7.3f ms  avg %7.3f", p.name.c_str(), p.last_ms, p.avg_ms);
+  ImGui::Separator();
+  ImGui::Text("%-14s %7.3f ms", "total", frame_ms());
+  ImGui::End();
+}
+
+std::string GpuProfiler::chrome_trace() const
+{
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  bool first = true;
+  for (auto &s : _trace) {
+    double ts = double((s.begin - _trace_origin) & _mask) * _period_ns / 1e3;
+    double dur = double((s.end - s.begin) & _mask) * _period_ns / 1e3;
+    out << (first ? "\n" : ",\n") << "  {\"name\": \"" << _passes[s.pass].name << "\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": "
+        << ts << ", \"dur\": " << dur << "}";
+    first = false;
+  }
+  out << "\n]}\n";
+  return out.str();
+}
+
+bool GpuProfiler::export_trace(const std::string &file) const
+{
+  std::ofstream out(file, std::ios::trunc);
+  if (!out)
+    return false;
+  out << chrome_trace();
+  return bool(out);
+}
+
+GpuScope::GpuScope(GpuProfiler *profiler, VkCommandBuffer cmd, const char *name) : _profiler(profiler), _cmd(cmd)
+{
+  if (_profiler)
+    _query = _profiler->begin_query(cmd, name);
+}
+
+GpuScope::~GpuScope()
+{
+  if (_query >= 0)
+    vkCmdWriteTimestamp(_cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _profiler->_pool, uint32_t(_query + 1));
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+class VulkanDevice;
+
+// timestamp queries around named scopes, one range of queries per frame in flight.
+// every scope name gets a fixed pair of queries, so command buffers recorded once and replayed
+// every frame keep writing the same slots. a frame's results are read when its fence has
+// signalled, right before the frame is submitted again, so nothing ever waits on the gpu.
+class GpuProfiler {
+public:
+  struct Pass {
+    std::string name;
+    double last_ms = 0;
+    double avg_ms = 0;
+  };
+
+  GpuProfiler(VulkanDevice *dev, uint32_t frames, uint32_t max_scopes = 32);
+  ~GpuProfiler();
+
+  // records the query reset, must come first in the frame's first command buffer, outside a render pass
+  void begin_frame(VkCommandBuffer cmd, uint32_t frame);
+  // other command buffers of the same frame, submitted after the one passed to begin_frame
+  void attach(VkCommandBuffer cmd, uint32_t frame);
+
+  // the frame's fence has signalled, reads the results of its last submit
+  void collect(uint32_t frame);
+
+  // scopes in the order they were first seen, averaged over the last samples
+  const std::vector<Pass> &passes() const { return _passes; }
+  double frame_ms() const;
+
+  // first begin to last end of the last collected frame, and how many frames were collected so far
+  double span_ms() const { return _span_ms; }
+  uint64_t collected() const { return _collected; }
+
+  // imgui window, call between NewFrame and Render
+  void draw();
+
+  // chrome://tracing / perfetto json of the frames collected so far
+  std::string chrome_trace() const;
+  bool export_trace(const std::string &file) const;
+
+  bool enabled() const { return _pool != VK_NULL_HANDLE; }
+
+private:
+  friend class GpuScope;
+
+  // query index of the scope's begin timestamp in the frame of cmd, -1 when cmd is unknown or the pool is full
+  int32_t begin_query(VkCommandBuffer cmd, const char *name);
+
+  struct Sample {
+    uint32_t pass;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+private:
+  VulkanDevice *_device = nullptr;
+  VkQueryPool _pool = VK_NULL_HANDLE;
+  uint32_t _frames = 0;
+  uint32_t _max_scopes = 0;
+  double _period_ns = 1;
+  uint64_t _mask = ~0ull;
+
+  std::map<VkCommandBuffer, uint32_t> _cmd_frames;
+  std::map<std::string, uint32_t> _scopes;
+  std::vector<Pass> _passes;
+  // a reset was recorded for the frame, scopes may write its queries
+  std::vector<bool> _armed;
+  // begin_frame ran since the last collect, the frame's results are pending. a frame that returned
+  // before recording is not submitted and must not be read twice
+  std::vector<bool> _in_flight;
+
+  std::vector<std::deque<double>> _history;
+  double _span_ms = 0;
+  uint64_t _collected = 0;
+
+  // trace events, oldest dropped first
+  std::deque<Sample> _trace;
+  uint64_t _trace_origin = 0;
+};
+
+// timestamps the commands recorded while it lives, no-op without a profiler
+class GpuScope {
+public:
+  GpuScope(GpuProfiler *profiler, VkCommandBuffer cmd, const char *name);
+  ~GpuScope();
+
+  GpuScope(const GpuScope &) = delete;
+  GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+  GpuProfiler *_profiler = nullptr;
+  VkCommandBuffer _cmd = VK_NULL_HANDLE;
+  int32_t _query = -1;
+};
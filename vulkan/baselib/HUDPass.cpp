@@ -4,6 +4,7 @@
 
 HUDPass::HUDPass(const std::shared_ptr<VulkanDevice> &dev) : VulkanPass(dev)
 {
+  _depth_format = VK_FORMAT_UNDEFINED;
 }
 
 HUDPass::~HUDPass()
@@ -15,7 +16,7 @@ void HUDPass::initialize()
   VkRenderPass render_pass = VK_NULL_HANDLE;
 
   VkAttachmentDescription attachment = {};
-  attachment.format = VK_FORMAT_B8G8R8A8_UNORM;
+  attachment.format = _color_format;
   attachment.samples = VK_SAMPLE_COUNT_1_BIT;
   attachment.loadOp = VK_ATTACHMENT_LOAD_OP_NONE_EXT;
   attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -26,10 +26,12 @@ HUDPipeline::~HUDPipeline()
 
 void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
 {
+  _pass = render_pass;
+  _subpass = subpass;
+
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_layout();
-  pipelineCreateInfo.renderPass = *render_pass;
 
   std::vector<VkDynamicState> dynamicStateEnables;
   dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
@@ -112,13 +114,13 @@ void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/hud.vert.spv");
+  shaderStages[0].module = shader("hud.vert");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/hud.frag.spv");
+  shaderStages[1].module = shader("hud.frag");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -133,12 +135,9 @@ void HUDPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pDepthStencilState = &depthStencilState;
   pipelineCreateInfo.pDynamicState = &dynamicState;
   pipelineCreateInfo.pViewportState = &viewportState;
-  pipelineCreateInfo.subpass = 0;
-
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+  render_pass->attach(pipelineCreateInfo, subpass);
 
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo, "hud");
 }
 
 VkDescriptorSetLayout HUDPipeline::texture_layout()
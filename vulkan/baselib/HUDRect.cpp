@@ -34,21 +34,14 @@ void HUDRect::setGeometry(float x, float y, float w, float h)
 
   auto dst = _device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, n, 0);
   auto ori = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, n, vs.data());
-  _device->copy_buffer(ori.get(), dst.get(), _device->transfer_queue());
+  _device->copy_buffer(ori.get(), dst.get(), _device->graphic_queue());
 
   _buffer = dst;
 }
 
-void HUDRect::setTexture(HUDPipeline *pipeline, VulkanTexture *tex, VkDescriptorPool pool)
+void HUDRect::setTexture(HUDPipeline *pipeline, VulkanTexture *tex, DescriptorAllocator *descriptors)
 {
-  auto des_layout = pipeline->texture_layout();
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = pool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &des_layout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*_device, &allocInfo, &_set));
+  _set = descriptors->allocate(pipeline->texture_layout());
 
   auto descriptor = tex->descriptor();
 
@@ -12,7 +12,7 @@ public:
 
   void setGeometry(float x, float y, float w, float h);
 
-  void setTexture(HUDPipeline *pipeline, VulkanTexture *tex, VkDescriptorPool pool);
+  void setTexture(HUDPipeline *pipeline, VulkanTexture *tex, DescriptorAllocator *descriptors);
 
   void fill_command(VkCommandBuffer cmdbuf, HUDPipeline *pipeline);
 
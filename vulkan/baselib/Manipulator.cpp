@@ -35,10 +35,7 @@ Manipulator::~Manipulator()
 
 void Manipulator::set_home(const tg::vec3& eye, const tg::vec3 &pos, const tg::vec3 &up)
 {
-  _eye = eye;
-  _pos = pos;
-  _up = tg::cross(eye - pos, tg::cross(up, eye - pos));
-  _up = tg::normalize(_up);
+  look_at(eye, pos, up);
 
   _home[0] = _eye;
   _home[1] = _pos;
@@ -52,6 +49,14 @@ void Manipulator::home()
   _up = _home[2];
 }
 
+void Manipulator::look_at(const tg::vec3 &eye, const tg::vec3 &pos, const tg::vec3 &up)
+{
+  _eye = eye;
+  _pos = pos;
+  _up = tg::cross(eye - pos, tg::cross(up, eye - pos));
+  _up = tg::normalize(_up);
+}
+
 void Manipulator::rotate(int x, int y)
 {
   vec3d tmp = _eye - _pos;
@@ -11,6 +11,9 @@ public:
 
   void home();
 
+  // moves the camera without touching home, up is made orthogonal to the view direction
+  void look_at(const tg::vec3 &eye, const tg::vec3 &pos, const tg::vec3 &up);
+
   void rotate(int x, int y);
 
   void translate(int x, int y);
@@ -18,6 +21,8 @@ public:
   void zoom(float in);
 
   const tg::vec3d & eye() const { return _eye; }
+  const tg::vec3d & pos() const { return _pos; }
+  const tg::vec3d & up() const { return _up; }
 
   tg::mat4 view_matrix();
 
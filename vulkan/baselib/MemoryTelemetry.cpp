@@ -0,0 +1,152 @@
+#include "MemoryTelemetry.h"
+#include "VulkanDevice.h"
+
+#include "imgui/imgui.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// how long the staging rate is averaged over
+const int64_t rate_window_ms = 1000;
+
+int64_t now_ms()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float mb(VkDeviceSize bytes)
+{
+  return float(bytes) / (1024.f * 1024.f);
+}
+
+}
+
+MemoryTelemetry::MemoryTelemetry(VulkanDevice *dev) : _device(dev)
+{
+  _has_budget = _device->memory_budget_supported();
+  _window_start = now_ms();
+}
+
+void MemoryTelemetry::sample()
+{
+  auto allocator = _device->allocator();
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 props = {};
+  props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  if (_has_budget) {
+    props.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(_device->physical_device(), &props);
+  }
+
+  auto reserved = allocator->heap_reserved();
+  _heaps.resize(allocator->memory_heap_count());
+  for (uint32_t i = 0; i < _heaps.size(); i++) {
+    auto &heap = _heaps[i];
+    heap.size = allocator->memory_heap(i).size;
+    heap.device_local = allocator->memory_heap(i).flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    heap.reserved = reserved[i];
+    heap.budget = _has_budget ? budget.heapBudget[i] : 0;
+    heap.usage = _has_budget ? budget.heapUsage[i] : 0;
+  }
+
+  for (size_t c = 0; c < size_t(MemoryCategory::Count); c++)
+    _categories[c] = allocator->stats(MemoryCategory(c));
+  _staging_in_flight = _device->staging_ring()->in_flight();
+
+  int64_t now = now_ms();
+  uint64_t staged = category(MemoryCategory::Staging).total_allocations;
+  if (now - _window_start >= rate_window_ms) {
+    _staging_rate = double(staged - _window_staging) * 1000.0 / double(now - _window_start);
+    _window_start = now;
+    _window_staging = staged;
+  }
+}
+
+uint32_t MemoryTelemetry::live_allocations() const
+{
+  uint32_t n = 0;
+  for (auto &c : _categories)
+    n += c.allocations;
+  return n;
+}
+
+void MemoryTelemetry::draw()
+{
+  ImGui::SetNextWindowSize(ImVec2(420, 300), ImGuiCond_Once);
+  ImGui::Begin("memory");
+
+  ImGui::Text("%s", _has_budget ? "heaps (VK_EXT_memory_budget)" : "heaps (no budget extension, own reservations only)");
+  for (uint32_t i = 0; i < _heaps.size(); i++) {
+    auto &h = _heaps[i];
+    VkDeviceSize used = _has_budget ? h.usage : h.reserved;
+    VkDeviceSize limit = _has_budget ? h.budget : h.size;
+    char label[64];
+    snprintf(label, sizeof(label), "%.1f / %.1f MB", mb(used), mb(limit));
+    ImGui::Text("%u %s", i, h.device_local ? "device" : "host");
+    ImGui::SameLine(80);
+    ImGui::ProgressBar(limit ? float(used) / float(limit) : 0.f, ImVec2(-1, 0), label);
+  }
+
+  ImGui::Separator();
+  ImGui::Text("%u live allocations", live_allocations());
+  for (size_t c = 0; c < size_t(MemoryCategory::Count); c++) {
+    auto &s = _categories[c];
+    if (!s.total_allocations)
+      continue;
+    ImGui::Text("%-14s %5u  %8.2f MB", category_name(MemoryCategory(c)), s.allocations, mb(s.bytes));
+  }
+
+  ImGui::Separator();
+  ImGui::Text("staging ring in flight %.2f MB", mb(_staging_in_flight));
+  if (staging_churn())
+    ImGui::TextColored(ImVec4(0.9f, 0.2f, 0.1f, 1.f), "staging churn: %.1f buffers/s", _staging_rate);
+  else
+    ImGui::Text("staging buffers %.1f/s", _staging_rate);
+
+  ImGui::End();
+}
+
+std::string MemoryTelemetry::to_json() const
+{
+  std::ostringstream out;
+  out << "{\n  \"budget_extension\": " << (_has_budget ? "true" : "false") << ",\n";
+
+  out << "  \"heaps\": [";
+  for (uint32_t i = 0; i < _heaps.size(); i++) {
+    auto &h = _heaps[i];
+    out << (i ? ",\n" : "\n") << "    {\"index\": " << i << ", \"device_local\": " << (h.device_local ? "true" : "false")
+        << ", \"size\": " << h.size << ", \"budget\": " << h.budget << ", \"usage\": " << h.usage
+        << ", \"reserved\": " << h.reserved << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"categories\": {";
+  for (size_t c = 0; c < size_t(MemoryCategory::Count); c++) {
+    auto &s = _categories[c];
+    out << (c ? ",\n" : "\n") << "    \"" << category_name(MemoryCategory(c)) << "\": {\"live\": " << s.allocations
+        << ", \"bytes\": " << s.bytes << ", \"total_allocations\": " << s.total_allocations
+        << ", \"total_bytes\": " << s.total_bytes << "}";
+  }
+  out << "\n  },\n";
+
+  out << "  \"live_allocations\": " << live_allocations() << ",\n";
+  out << "  \"staging\": {\"ring_in_flight\": " << _staging_in_flight << ", \"allocations_per_second\": " << _staging_rate
+      << ", \"churn\": " << (staging_churn() ? "true" : "false") << "}\n";
+  out << "}\n";
+  return out.str();
+}
+
+bool MemoryTelemetry::dump(const std::string &file) const
+{
+  std::ofstream out(file, std::ios::trunc);
+  if (!out)
+    return false;
+  out << to_json();
+  return bool(out);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+
+// gpu memory at a glance: per heap budget and usage (VK_EXT_memory_budget when the device has it,
+// otherwise only what this process reserved), the allocator's live allocations by category and
+// how fast staging buffers come and go. sample() once a frame, then draw() or to_json().
+class MemoryTelemetry {
+public:
+  struct Heap {
+    VkDeviceSize size = 0;
+    // what the driver says this process may use and uses, 0 without the extension
+    VkDeviceSize budget = 0;
+    VkDeviceSize usage = 0;
+    // blocks and dedicated allocations of the allocator
+    VkDeviceSize reserved = 0;
+    bool device_local = false;
+  };
+
+  MemoryTelemetry(VulkanDevice *dev);
+
+  void sample();
+
+  bool has_budget() const { return _has_budget; }
+  const std::vector<Heap> &heaps() const { return _heaps; }
+  const CategoryStats &category(MemoryCategory c) const { return _categories[size_t(c)]; }
+  uint32_t live_allocations() const;
+
+  // staging allocations per second, averaged over the last sample window
+  double staging_rate() const { return _staging_rate; }
+  // uploads that miss the staging ring create and drop a buffer each, a steady stream of them is churn
+  bool staging_churn() const { return _staging_rate > _churn_limit; }
+  void set_churn_limit(double per_second) { _churn_limit = per_second; }
+
+  // imgui window, call between NewFrame and Render
+  void draw();
+
+  std::string to_json() const;
+  bool dump(const std::string &file) const;
+
+private:
+  VulkanDevice *_device = nullptr;
+  bool _has_budget = false;
+
+  std::vector<Heap> _heaps;
+  CategoryStats _categories[size_t(MemoryCategory::Count)];
+  VkDeviceSize _staging_in_flight = 0;
+
+  int64_t _window_start = 0;
+  uint64_t _window_staging = 0;
+  double _staging_rate = 0;
+  double _churn_limit = 8;
+};
@@ -8,6 +8,7 @@
 #include "VulkanInitializers.hpp"
 #include "TexturePipeline.h"
 #include "DepthPersPipeline.h"
+#include "UploadBatch.h"
 
 #include "tvec.h"
 #include "config.h"
@@ -23,18 +24,50 @@ MeshInstance::MeshInstance()
 MeshInstance::~MeshInstance()
 {
   if(_pbr_set) {
-    vkFreeDescriptorSets(*_device, _device->get_or_create_descriptor_pool(), 1, &_pbr_set);
+    // frames still in flight may have the set bound
+    auto descriptors = _device->descriptors();
+    _device->retire([descriptors, set = _pbr_set]() { descriptors->free(set); });
     _pbr_set = VK_NULL_HANDLE;
   }
 }
 
 void MeshInstance::set_transform(const tg::mat4 &transform)
 {
+  if (memcmp(&_transform, &transform, sizeof(tg::mat4)) == 0)
+    return;
   _transform = transform;
+  _bound_dirty = true;
+}
+
+const tg::boundingbox &MeshInstance::world_bound()
+{
+  if (_bound_dirty) {
+    _world_bound = tg::boundingbox();
+    for (auto &pri : _pris) {
+      auto &box = pri->bound();
+      // planar primitives have a zero extent on one axis and still count
+      if (box.empty())
+        continue;
+      auto m = _transform * pri->transform();
+      for (uint32_t i = 0; i < 8; i++)
+        _world_bound.expand(m * box.corner(i));
+    }
+    _world_sphere.center = _world_bound.center();
+    _world_sphere.radius = _world_bound.empty() ? 0 : _world_bound.radius();
+    _bound_dirty = false;
+  }
+  return _world_bound;
+}
+
+const BoundingSphere &MeshInstance::world_sphere()
+{
+  world_bound();
+  return _world_sphere;
 }
 
 void MeshInstance::add_primitive(std::shared_ptr<MeshPrimitive>& pri) {
   _pris.emplace_back(pri);
+  _bound_dirty = true;
 
   auto &m = pri->material();
   //if (m.tex) {
@@ -62,22 +95,52 @@ void MeshInstance::add_primitive(std::shared_ptr<MeshPrimitive>& pri) {
 }
 
 void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev)
+{
+  realize_async(dev);
+  _upload->wait();
+  _upload.reset();
+}
+
+void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline)
+{
+  realize_async(dev, pipeline);
+  _upload->wait();
+  _upload.reset();
+}
+
+void MeshInstance::realize_async(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline)
 {
   _device = dev;
+  vkCmdPushDescriptorSetKHR = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(*dev, "vkCmdPushDescriptorSetKHR");
+
+  _upload = std::make_shared<UploadBatch>(dev);
+  record_uploads(dev, pipeline);
+  _upload->submit();
+}
+
+bool MeshInstance::resident()
+{
+  if (!_device)
+    return false;
+  if (_upload) {
+    if (!_upload->finished())
+      return false;
+    _upload.reset();
+  }
+  return true;
+}
 
+void MeshInstance::record_uploads(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline)
+{
   for (auto &pri : _pris) {
-    pri->realize(dev);
+    pri->realize(dev, *_upload);
     auto &tex = pri->material().albedo_tex;
     if (tex)
-      tex->realize(dev);
+      tex->realize(dev, *_upload);
   }
 
-  vkCmdPushDescriptorSetKHR = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(*dev, "vkCmdPushDescriptorSetKHR");
-}
-
-void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline)
-{
-  realize(dev);
+  if (!pipeline || _pris.empty())
+    return;
 
   std::vector<PBRBase> pbrdata(_pris.size());
   for (int i = 0; i < _pris.size(); i++) {
@@ -86,19 +149,10 @@ void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::
     memcpy(&pbr, &m.pbrdata, sizeof(PBRBase));
   }
   uint32_t sz = pbrdata.size() * sizeof(PBRBase);
-  auto ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, sz, pbrdata.data());
-  auto dst_buf = dev->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sz, 0);
-  dev->copy_buffer(ori_buf.get(), dst_buf.get(), dev->transfer_queue());
-  _pbr_buf = dst_buf;
-
-  auto layout = pipeline->pbr_layout();
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = _device->get_or_create_descriptor_pool();
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &layout;
+  _pbr_buf = dev->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sz, 0);
+  _upload->copy(pbrdata.data(), sz, _pbr_buf.get());
 
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*_device, &allocInfo, &_pbr_set));
+  _pbr_set = _device->descriptors()->allocate(pipeline->pbr_layout());
 
   VkDescriptorBufferInfo descriptor = {};
   descriptor.buffer = *_pbr_buf;
@@ -117,36 +171,44 @@ void MeshInstance::realize(const std::shared_ptr<VulkanDevice> &dev, const std::
 
 void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline)
 {
-  if (!pipeline || !pipeline->valid())
+  if (!pipeline || !pipeline->valid() || !resident())
     return;
 
   vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
 
+  // primitives share the arena buffers, rebinding only happens across pages
+  auto arena = _device->geometry_arena();
+  uint32_t page = UINT32_MAX;
   for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
+    if (!pri->placed())
+      continue;
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
 
-    std::vector<VkBuffer> bufs(2);
-    bufs[0] = *pri->_vertex_buf;
-    bufs[1] = *pri->_normal_buf;
-    std::vector<VkDeviceSize> offset(bufs.size(), 0);
-    vkCmdBindVertexBuffers(cmd_buf, 0, bufs.size(), bufs.data(), offset.data());
-    vkCmdBindIndexBuffer(cmd_buf, *pri->_index_buf, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, 0, 0, 0);
+    if (pri->page() != page) {
+      page = pri->page();
+      arena->bind(cmd_buf, page, 2);
+    }
+    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, pri->first_index(), pri->vertex_offset(), 0);
   }
 }
 
 void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline)
 {
-  if (!pipeline || !pipeline->valid())
+  if (!pipeline || !pipeline->valid() || !resident())
     return;
 
 
   vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
 
+  // primitives share the arena buffers, rebinding only happens across pages
+  auto arena = _device->geometry_arena();
+  uint32_t page = UINT32_MAX;
   for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
+    if (!pri->placed())
+      continue;
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
 
@@ -163,26 +225,28 @@ void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shar
     texture_set.pImageInfo = &descriptor;
     vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipe_layout(), 3, 1, &texture_set);
 
-    std::vector<VkBuffer> bufs(3);
-    bufs[0] = *pri->_vertex_buf;
-    bufs[1] = *pri->_normal_buf;
-    bufs[2] = *pri->_uv_buf;
-    std::vector<VkDeviceSize> offset(bufs.size(), 0);
-    vkCmdBindVertexBuffers(cmd_buf, 0, bufs.size(), bufs.data(), offset.data());
-    vkCmdBindIndexBuffer(cmd_buf, *pri->_index_buf, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, 0, 0, 0);
+    if (pri->page() != page) {
+      page = pri->page();
+      arena->bind(cmd_buf, page, 3);
+    }
+    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, pri->first_index(), pri->vertex_offset(), 0);
   }
 }
 
 void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline)
 {
-  if (!pipeline || !pipeline->valid())
+  if (!pipeline || !pipeline->valid() || !resident())
     return;
 
   vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
 
+  // primitives share the arena buffers, rebinding only happens across pages
+  auto arena = _device->geometry_arena();
+  uint32_t page = UINT32_MAX;
   for (int i = 0; i < _pris.size(); i++) {
     auto &pri = _pris[i];
+    if (!pri->placed())
+      continue;
     auto m = _transform * pri->transform();
     vkCmdPushConstants(cmd_buf, pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m), &m);
 
@@ -196,14 +260,11 @@ void MeshInstance::build_command_buffer(VkCommandBuffer cmd_buf, const std::shar
     texture_set.pImageInfo = &descriptor;
     vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipe_layout(), 1, 1, &texture_set);
 
-    std::vector<VkBuffer> bufs(3);
-    bufs[0] = *pri->_vertex_buf;
-    bufs[1] = *pri->_normal_buf;
-    bufs[2] = *pri->_uv_buf;
-    std::vector<VkDeviceSize> offset(bufs.size(), 0);
-    vkCmdBindVertexBuffers(cmd_buf, 0, bufs.size(), bufs.data(), offset.data());
-    vkCmdBindIndexBuffer(cmd_buf, *pri->_index_buf, 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, 0, 0, 0);
+    if (pri->page() != page) {
+      page = pri->page();
+      arena->bind(cmd_buf, page, 3);
+    }
+    vkCmdDrawIndexed(cmd_buf, pri->index_count(), 1, pri->first_index(), pri->vertex_offset(), 0);
   }
 }
 
@@ -13,6 +13,7 @@ class VulkanBuffer;
 class VulkanPipeline;
 class TexturePipeline;
 class DepthPersPipeline;
+class UploadBatch;
 
 class MeshInstance{
 public:
@@ -23,10 +24,21 @@ public:
 
   void add_primitive(std::shared_ptr<MeshPrimitive> &pri);
 
+  // world space bounds of all primitives, recomputed only after the transform or the primitives change
+  const tg::boundingbox &world_bound();
+
+  const BoundingSphere &world_sphere();
+
   void realize(const std::shared_ptr<VulkanDevice> &dev);
 
   void realize(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline);
 
+  // records every upload into one batch on the transfer queue and returns without waiting
+  void realize_async(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline = nullptr);
+
+  // true once the uploads have landed, meshes that are not resident are skipped when recording
+  bool resident();
+
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<VulkanPipeline> &pipeline);
 
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<TexturePipeline> &pipeline);
@@ -34,14 +46,21 @@ public:
   void build_command_buffer(VkCommandBuffer cmd_buf, const std::shared_ptr<DepthPersPipeline> &pipeline);
 
 private:
+  void record_uploads(const std::shared_ptr<VulkanDevice> &dev, const std::shared_ptr<TexturePipeline> &pipeline);
 
 private:
   std::shared_ptr<VulkanDevice> _device;
 
+  std::shared_ptr<UploadBatch> _upload;
+
   PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR;
 
   tg::mat4 _transform;
 
+  tg::boundingbox _world_bound;
+  BoundingSphere _world_sphere;
+  bool _bound_dirty = true;
+
   std::vector<std::shared_ptr<MeshPrimitive>> _pris;
 
   std::shared_ptr<VulkanBuffer> _pbr_buf;
@@ -2,6 +2,7 @@
 #include "VulkanDevice.h"
 #include "VulkanTools.h"
 #include "VulkanBuffer.h"
+#include "UploadBatch.h"
 
 #include "config.h"
 #include "RenderData.h"
@@ -17,6 +18,13 @@ MeshPrimitive::MeshPrimitive()
 
 MeshPrimitive::~MeshPrimitive()
 {
+  if (!_device || !_vertex_range)
+    return;
+  // frames still in flight may draw from the ranges
+  auto arena = _device->geometry_arena();
+  _device->retire([arena, vertices = _vertex_range, indices = _index_range]() mutable {
+    arena->free(vertices, indices);
+  });
 }
 
 void MeshPrimitive::set_transform(const tg::mat4& m)
@@ -52,6 +60,13 @@ void MeshPrimitive::set_index(uint8_t* data, int n)
   memcpy(_indexs.data(), data, n);
 }
 
+void MeshPrimitive::set_bound(const tg::boundingbox& box)
+{
+  _bound = box;
+  _sphere.center = box.center();
+  _sphere.radius = box.radius();
+}
+
 uint32_t MeshPrimitive::index_count()
 {
   return _indexs.size();
@@ -64,19 +79,31 @@ void MeshPrimitive::set_material(const Material& m)
 
 void MeshPrimitive::realize(const std::shared_ptr<VulkanDevice>& dev)
 {
-  auto fun = [dev](uint8_t* data, int n) -> std::shared_ptr<VulkanBuffer> {
-    auto ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, n, data);
-    auto dst_buf = dev->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, n, 0);
-    dev->copy_buffer(ori_buf.get(), dst_buf.get(), dev->transfer_queue());
-    return dst_buf;
+  UploadBatch batch(dev);
+  realize(dev, batch);
+  batch.submit();
+  batch.wait();
+}
+
+void MeshPrimitive::realize(const std::shared_ptr<VulkanDevice>& dev, UploadBatch& batch)
+{
+  if (_device || _vertexs.empty() || _indexs.empty())
+    return;
+
+  auto arena = dev->geometry_arena();
+  if (!arena->allocate(uint32_t(_vertexs.size()), uint32_t(_indexs.size()), _vertex_range, _index_range))
+    throw std::runtime_error("primitive does not fit the geometry arena");
+  // draws bind one page for both, vertexOffset and firstIndex are relative to it
+  assert(_vertex_range.page == _index_range.page);
+  _device = dev;
+
+  auto page = _vertex_range.page;
+  auto fun = [&](const void* data, size_t n, GeometryArena::Stream s) {
+    auto stride = GeometryArena::stride(s);
+    batch.copy(data, std::min(n, _vertexs.size()) * stride, arena->stream(page, s), _vertex_range.first * stride);
   };
-  _vertex_buf = fun((uint8_t *)_vertexs.data(), _vertexs.size() * sizeof(vec3));
-  _normal_buf = fun((uint8_t *)_normals.data(), _normals.size() * sizeof(vec3));
-  _uv_buf = fun((uint8_t *)_uvs.data(), _uvs.size() * sizeof(vec2));
-
-  auto index_sz = _indexs.size() * sizeof(uint16_t);
-  auto index_ori_buf = dev->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_sz, (uint8_t *)_indexs.data());
-  auto index_buf = dev->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_sz, 0);
-  dev->copy_buffer(index_ori_buf.get(), index_buf.get(), dev->transfer_queue());
-  _index_buf = index_buf;
+  fun(_vertexs.data(), _vertexs.size(), GeometryArena::Position);
+  fun(_normals.data(), _normals.size(), GeometryArena::Normal);
+  fun(_uvs.data(), _uvs.size(), GeometryArena::UV);
+  batch.copy(_indexs.data(), _indexs.size() * sizeof(uint16_t), arena->index_buffer(page), _index_range.first * sizeof(uint16_t));
 }
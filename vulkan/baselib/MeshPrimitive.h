@@ -6,9 +6,11 @@
 
 #include "tvec.h"
 #include "RenderData.h"
+#include "GeometryArena.h"
 
 class VulkanBuffer;
 class VulkanDevice;
+class UploadBatch;
 
 class MeshPrimitive {
   friend class GLTFLoader;
@@ -30,14 +32,29 @@ public:
 
   void set_index(uint8_t *data, int n);
 
+  // local bounds, taken from the POSITION accessor min/max when the file has them
+  void set_bound(const tg::boundingbox &box);
+
+  const tg::boundingbox &bound() const { return _bound; }
+
+  const BoundingSphere &sphere() const { return _sphere; }
+
   uint32_t index_count();
 
+  // placement in the device geometry arena, valid after realize
+  bool placed() const { return bool(_index_range); }
+  uint32_t page() const { return _vertex_range.page; }
+  uint32_t first_index() const { return _index_range.first; }
+  int32_t vertex_offset() const { return int32_t(_vertex_range.first); }
+
   const Material &material() { return _material; }
 
   void set_material(const Material &m);
 
   void realize(const std::shared_ptr<VulkanDevice> &dev);
 
+  void realize(const std::shared_ptr<VulkanDevice> &dev, UploadBatch &batch);
+
 private:
 
 private:
@@ -51,7 +68,11 @@ private:
 
   std::vector<uint16_t> _indexs;
 
-  std::shared_ptr<VulkanBuffer> _vertex_buf, _normal_buf, _uv_buf, _index_buf;
+  tg::boundingbox _bound;
+  BoundingSphere _sphere;
+
+  std::shared_ptr<VulkanDevice> _device;
+  GeometryArena::Range _vertex_range, _index_range;
 
 
   Material _material = {};
@@ -0,0 +1,410 @@
+#include "MeshoptDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace meshopt {
+
+namespace {
+
+const uint8_t vertex_header = 0xa0;
+const uint8_t index_header = 0xe0;
+const uint8_t sequence_header = 0xd0;
+
+const size_t byte_group_size = 16;
+const size_t byte_group_decode_limit = 24;
+const size_t vertex_block_size_bytes = 8192;
+const size_t vertex_block_max_size = 256;
+const size_t tail_min_size = 32;
+
+size_t vertex_block_size(size_t vertex_size)
+{
+  size_t result = vertex_block_size_bytes / vertex_size;
+  result &= ~(byte_group_size - 1);
+  return std::min(result, vertex_block_max_size);
+}
+
+inline uint8_t unzigzag8(uint8_t v)
+{
+  return uint8_t(-(v & 1) ^ (v >> 1));
+}
+
+// one group of 16 bytes stored with 0, 2, 4 or 8 bits each, values that do not fit are escaped
+const uint8_t *decode_bytes_group(const uint8_t *data, uint8_t *out, int bitslog2)
+{
+  if (bitslog2 == 0) {
+    memset(out, 0, byte_group_size);
+    return data;
+  }
+  if (bitslog2 == 3) {
+    memcpy(out, data, byte_group_size);
+    return data + byte_group_size;
+  }
+
+  const int bits = bitslog2 == 1 ? 2 : 4;
+  const uint8_t escape = uint8_t((1 << bits) - 1);
+  const uint8_t *var = data + byte_group_size * bits / 8;
+  for (size_t i = 0; i < byte_group_size; i++) {
+    uint8_t byte = data[i * bits / 8];
+    uint8_t enc = uint8_t(byte << ((i * bits) & 7)) >> (8 - bits);
+    if (enc == escape)
+      out[i] = *var++;
+    else
+      out[i] = enc;
+  }
+  return var;
+}
+
+const uint8_t *decode_bytes(const uint8_t *data, const uint8_t *end, uint8_t *out, size_t n)
+{
+  const uint8_t *header = data;
+  size_t header_size = (n / byte_group_size + 3) / 4;
+  if (size_t(end - data) < header_size)
+    return nullptr;
+  data += header_size;
+
+  for (size_t i = 0; i < n; i += byte_group_size) {
+    if (size_t(end - data) < byte_group_decode_limit)
+      return nullptr;
+    size_t group = i / byte_group_size;
+    int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+    data = decode_bytes_group(data, out + i, bitslog2);
+  }
+  return data;
+}
+
+// bytes are stored channel by channel as zigzag deltas against the previous vertex
+const uint8_t *decode_vertex_block(const uint8_t *data, const uint8_t *end, uint8_t *dst, size_t count, size_t size,
+                                   uint8_t last[256])
+{
+  uint8_t buffer[vertex_block_max_size];
+  uint8_t transposed[vertex_block_size_bytes];
+  size_t aligned = (count + byte_group_size - 1) & ~(byte_group_size - 1);
+
+  for (size_t k = 0; k < size; k++) {
+    data = decode_bytes(data, end, buffer, aligned);
+    if (!data)
+      return nullptr;
+
+    uint8_t p = last[k];
+    uint8_t *t = transposed + k;
+    for (size_t i = 0; i < count; i++, t += size) {
+      p = uint8_t(unzigzag8(buffer[i]) + p);
+      *t = p;
+    }
+  }
+
+  memcpy(dst, transposed, count * size);
+  memcpy(last, transposed + size * (count - 1), size);
+  return data;
+}
+
+uint32_t decode_vbyte(const uint8_t *&data)
+{
+  uint8_t lead = *data++;
+  if (lead < 128)
+    return lead;
+
+  uint32_t result = lead & 127;
+  uint32_t shift = 7;
+  for (int i = 0; i < 4; i++) {
+    uint8_t group = *data++;
+    result |= uint32_t(group & 127) << shift;
+    shift += 7;
+    if (group < 128)
+      break;
+  }
+  return result;
+}
+
+inline uint32_t decode_index(const uint8_t *&data, uint32_t last)
+{
+  uint32_t v = decode_vbyte(data);
+  uint32_t d = (v >> 1) ^ uint32_t(-int32_t(v & 1));
+  return last + d;
+}
+
+inline void write_index(void *dst, size_t i, size_t index_size, uint32_t v)
+{
+  if (index_size == 2)
+    static_cast<uint16_t *>(dst)[i] = uint16_t(v);
+  else
+    static_cast<uint32_t *>(dst)[i] = v;
+}
+
+inline void write_triangle(void *dst, size_t i, size_t index_size, uint32_t a, uint32_t b, uint32_t c)
+{
+  write_index(dst, i + 0, index_size, a);
+  write_index(dst, i + 1, index_size, b);
+  write_index(dst, i + 2, index_size, c);
+}
+
+struct Fifo {
+  uint32_t edges[16][2];
+  uint32_t verts[16];
+  size_t edge_offset = 0, vert_offset = 0;
+
+  Fifo()
+  {
+    memset(edges, -1, sizeof(edges));
+    memset(verts, -1, sizeof(verts));
+  }
+
+  void push_edge(uint32_t a, uint32_t b)
+  {
+    edges[edge_offset][0] = a;
+    edges[edge_offset][1] = b;
+    edge_offset = (edge_offset + 1) & 15;
+  }
+
+  void push_vert(uint32_t v, bool cond = true)
+  {
+    verts[vert_offset] = v;
+    vert_offset = (vert_offset + cond) & 15;
+  }
+};
+
+template <typename T>
+void decode_oct(T *data, size_t count)
+{
+  const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+  for (size_t i = 0; i < count; i++) {
+    T *v = data + i * 4;
+    // z is stored so that |x| + |y| + |z| is one, reconstruct it and unfold the lower hemisphere
+    float x = float(v[0]);
+    float y = float(v[1]);
+    float z = float(v[2]) - std::fabs(x) - std::fabs(y);
+    float t = std::min(z, 0.f);
+    x += x >= 0.f ? t : -t;
+    y += y >= 0.f ? t : -t;
+
+    float s = max / std::sqrt(x * x + y * y + z * z);
+    v[0] = T(int(x * s + (x >= 0.f ? 0.5f : -0.5f)));
+    v[1] = T(int(y * s + (y >= 0.f ? 0.5f : -0.5f)));
+    v[2] = T(int(z * s + (z >= 0.f ? 0.5f : -0.5f)));
+  }
+}
+
+void decode_quat(int16_t *data, size_t count)
+{
+  const float scale = 1.f / std::sqrt(2.f);
+  for (size_t i = 0; i < count; i++) {
+    int16_t *v = data + i * 4;
+    // the last component holds the scale in its high bits and the index of the dropped component in the low two
+    int sf = v[3] | 3;
+    float ss = scale / float(sf);
+    float x = float(v[0]) * ss;
+    float y = float(v[1]) * ss;
+    float z = float(v[2]) * ss;
+    float ww = 1.f - x * x - y * y - z * z;
+    float w = std::sqrt(std::max(ww, 0.f));
+
+    int qc = v[3] & 3;
+    v[(qc + 1) & 3] = int16_t(int(x * 32767.f + (x >= 0.f ? 0.5f : -0.5f)));
+    v[(qc + 2) & 3] = int16_t(int(y * 32767.f + (y >= 0.f ? 0.5f : -0.5f)));
+    v[(qc + 3) & 3] = int16_t(int(z * 32767.f + (z >= 0.f ? 0.5f : -0.5f)));
+    v[(qc + 0) & 3] = int16_t(int(w * 32767.f + 0.5f));
+  }
+}
+
+void decode_exp(uint32_t *data, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    // 24 bit signed mantissa, 8 bit signed exponent
+    int32_t m = int32_t(data[i] << 8) >> 8;
+    int32_t e = int32_t(data[i]) >> 24;
+    float f = std::ldexp(float(m), e);
+    memcpy(&data[i], &f, sizeof(f));
+  }
+}
+
+}
+
+bool decode_vertex_buffer(void *dst, size_t count, size_t size, const uint8_t *buf, size_t n)
+{
+  if (size == 0 || size > 256 || size % 4 != 0)
+    return false;
+  if (n < 1 || (buf[0] & 0xf0) != vertex_header || (buf[0] & 0x0f) != 0)
+    return false;
+
+  const uint8_t *data = buf + 1;
+  const uint8_t *end = buf + n;
+
+  // the tail holds the first baseline, padded to at least tail_min_size
+  size_t tail_size = std::max(size, tail_min_size);
+  if (size_t(end - data) < tail_size)
+    return false;
+
+  uint8_t last[256];
+  memcpy(last, end - size, size);
+
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  size_t block_size = vertex_block_size(size);
+  for (size_t offset = 0; offset < count; offset += block_size) {
+    size_t block = std::min(block_size, count - offset);
+    data = decode_vertex_block(data, end, out + offset * size, block, size, last);
+    if (!data)
+      return false;
+  }
+
+  return size_t(end - data) == tail_size;
+}
+
+bool decode_index_buffer(void *dst, size_t count, size_t index_size, const uint8_t *buf, size_t n)
+{
+  if (count % 3 != 0 || (index_size != 2 && index_size != 4))
+    return false;
+  if (n < 1 + count / 3 + 16 || (buf[0] & 0xf0) != index_header)
+    return false;
+  int version = buf[0] & 0x0f;
+  if (version > 1)
+    return false;
+
+  Fifo fifo;
+  uint32_t next = 0, last = 0;
+  const int fecmax = version >= 1 ? 13 : 15;
+
+  const uint8_t *code = buf + 1;
+  const uint8_t *data = code + count / 3;
+  const uint8_t *data_safe_end = buf + n - 16;
+  const uint8_t *codeaux_table = data_safe_end;
+
+  for (size_t i = 0; i < count; i += 3) {
+    if (data > data_safe_end)
+      return false;
+
+    uint8_t codetri = *code++;
+    if (codetri < 0xf0) {
+      // triangle shares an edge from the fifo, the third vertex is new, cached or explicit
+      int fe = codetri >> 4;
+      uint32_t a = fifo.edges[(fifo.edge_offset - 1 - fe) & 15][0];
+      uint32_t b = fifo.edges[(fifo.edge_offset - 1 - fe) & 15][1];
+
+      int fec = codetri & 15;
+      if (fec < fecmax) {
+        uint32_t c = fec == 0 ? next : fifo.verts[(fifo.vert_offset - 1 - fec) & 15];
+        bool fec0 = fec == 0;
+        next += fec0;
+        write_triangle(dst, i, index_size, a, b, c);
+        fifo.push_vert(c, fec0);
+        fifo.push_edge(c, b);
+        fifo.push_edge(a, c);
+      } else {
+        // 13 and 14 are last -1 and +1 in version 1, 15 is an explicit delta
+        uint32_t c = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index(data, last);
+        last = c;
+        write_triangle(dst, i, index_size, a, b, c);
+        fifo.push_vert(c);
+        fifo.push_edge(c, b);
+        fifo.push_edge(a, c);
+      }
+    } else if (codetri < 0xfe) {
+      // no shared edge, vertex sources come from the aux table
+      uint8_t codeaux = codeaux_table[codetri & 15];
+      int feb = codeaux >> 4;
+      int fec = codeaux & 15;
+
+      uint32_t a = next++;
+      uint32_t b = feb == 0 ? next : fifo.verts[(fifo.vert_offset - feb) & 15];
+      bool feb0 = feb == 0;
+      next += feb0;
+      uint32_t c = fec == 0 ? next : fifo.verts[(fifo.vert_offset - fec) & 15];
+      bool fec0 = fec == 0;
+      next += fec0;
+
+      write_triangle(dst, i, index_size, a, b, c);
+      fifo.push_vert(a);
+      fifo.push_vert(b, feb0);
+      fifo.push_vert(c, fec0);
+      fifo.push_edge(b, a);
+      fifo.push_edge(c, b);
+      fifo.push_edge(a, c);
+    } else {
+      // aux byte inline, 15 marks an explicit index
+      uint8_t codeaux = *data++;
+      int fea = codetri == 0xfe ? 0 : 15;
+      int feb = codeaux >> 4;
+      int fec = codeaux & 15;
+
+      // a zero aux byte inline instead of from the table restarts the vertex sequence
+      if (codeaux == 0)
+        next = 0;
+
+      uint32_t a = fea == 0 ? next++ : 0;
+      uint32_t b = feb == 0 ? next++ : fifo.verts[(fifo.vert_offset - feb) & 15];
+      uint32_t c = fec == 0 ? next++ : fifo.verts[(fifo.vert_offset - fec) & 15];
+      if (fea == 15)
+        last = a = decode_index(data, last);
+      if (feb == 15)
+        last = b = decode_index(data, last);
+      if (fec == 15)
+        last = c = decode_index(data, last);
+
+      write_triangle(dst, i, index_size, a, b, c);
+      fifo.push_vert(a);
+      fifo.push_vert(b, feb == 0 || feb == 15);
+      fifo.push_vert(c, fec == 0 || fec == 15);
+      fifo.push_edge(b, a);
+      fifo.push_edge(c, b);
+      fifo.push_edge(a, c);
+    }
+  }
+
+  return data == data_safe_end;
+}
+
+bool decode_index_sequence(void *dst, size_t count, size_t index_size, const uint8_t *buf, size_t n)
+{
+  if (index_size != 2 && index_size != 4)
+    return false;
+  if (n < 1 + count + 4 || (buf[0] & 0xf0) != sequence_header || (buf[0] & 0x0f) > 1)
+    return false;
+
+  const uint8_t *data = buf + 1;
+  const uint8_t *data_safe_end = buf + n - 4;
+
+  // two baselines, the low bit of every value picks one
+  uint32_t last[2] = {};
+  for (size_t i = 0; i < count; i++) {
+    if (data >= data_safe_end)
+      return false;
+    uint32_t v = decode_vbyte(data);
+    uint32_t current = v & 1;
+    v >>= 1;
+    uint32_t d = (v >> 1) ^ uint32_t(-int32_t(v & 1));
+    last[current] += d;
+    write_index(dst, i, index_size, last[current]);
+  }
+
+  return data == data_safe_end;
+}
+
+bool apply_filter(Filter filter, void *data, size_t count, size_t stride)
+{
+  switch (filter) {
+    case Filter::None:
+      return true;
+    case Filter::Octahedral:
+      if (stride == 4)
+        decode_oct(static_cast<int8_t *>(data), count);
+      else if (stride == 8)
+        decode_oct(static_cast<int16_t *>(data), count);
+      else
+        return false;
+      return true;
+    case Filter::Quaternion:
+      if (stride != 8)
+        return false;
+      decode_quat(static_cast<int16_t *>(data), count);
+      return true;
+    case Filter::Exponential:
+      if (stride % 4 != 0)
+        return false;
+      decode_exp(static_cast<uint32_t *>(data), count * (stride / 4));
+      return true;
+  }
+  return false;
+}
+
+}
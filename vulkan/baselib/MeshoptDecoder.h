@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// decoders for the buffer view payloads of EXT_meshopt_compression
+namespace meshopt {
+
+enum class Filter { None, Octahedral, Quaternion, Exponential };
+
+// attributes mode, count vertices of size bytes each (size is a multiple of 4, at most 256)
+bool decode_vertex_buffer(void *dst, size_t count, size_t size, const uint8_t *buf, size_t n);
+
+// triangles mode, index_size is 2 or 4
+bool decode_index_buffer(void *dst, size_t count, size_t index_size, const uint8_t *buf, size_t n);
+
+// indices mode
+bool decode_index_sequence(void *dst, size_t count, size_t index_size, const uint8_t *buf, size_t n);
+
+// filters run in place on decoded vertex data
+bool apply_filter(Filter filter, void *data, size_t count, size_t stride);
+
+}
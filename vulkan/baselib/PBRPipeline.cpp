@@ -30,12 +30,14 @@ PBRPipeline::~PBRPipeline()
 
 void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
 {
+  _pass = render_pass;
+  _subpass = subpass;
+
   auto pipelay = pipe_layout();
 
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipelay;
-  pipelineCreateInfo.renderPass = *render_pass;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -117,13 +119,13 @@ void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/pbr_clr.vert.spv");
+  shaderStages[0].module = shader("pbr_clr.vert");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/pbr_clr.frag.spv");
+  shaderStages[1].module = shader("pbr_clr.frag");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -138,20 +140,16 @@ void PBRPipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pViewportState = &viewportState;
   pipelineCreateInfo.pDepthStencilState = &depthStencilState;
   pipelineCreateInfo.pDynamicState = &dynamicState;
-  pipelineCreateInfo.subpass = subpass;
-
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
-
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  render_pass->attach(pipelineCreateInfo, subpass);
 
+  _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo, "pbr");
 }
 
 VkDescriptorSetLayout PBRPipeline::light_layout()
 {
   if (!_light_layout) {
     VkDescriptorSetLayoutBinding layoutBinding = {};
-    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBinding.descriptorType = _uniform_type;
     layoutBinding.descriptorCount = 1;
     layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     layoutBinding.pImmutableSamplers = nullptr;
@@ -0,0 +1,157 @@
+#include "ParallelRecorder.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+
+namespace {
+
+// fewer items than this per worker are not worth a secondary of their own
+const uint32_t min_chunk = 64;
+
+}
+
+ParallelRecorder::ParallelRecorder(VulkanDevice *dev, uint32_t frames, uint32_t threads) : _device(dev), _frames(frames)
+{
+  if (threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  _threads = threads;
+
+  _slots.resize(size_t(_threads) * _frames);
+  for (auto &slot : _slots)
+    slot.pool = _device->create_command_pool(_device->graphics_family(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+  for (uint32_t w = 1; w < _threads; w++)
+    _workers.emplace_back(&ParallelRecorder::work, this, w);
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _wake.notify_all();
+  for (auto &w : _workers)
+    w.join();
+
+  // destroying a pool frees its command buffers
+  for (auto &slot : _slots)
+    vkDestroyCommandPool(*_device, slot.pool, nullptr);
+}
+
+void ParallelRecorder::begin_frame(uint32_t frame)
+{
+  for (uint32_t w = 0; w < _threads; w++) {
+    auto &slot = _slots[w * _frames + frame];
+    if (!slot.used)
+      continue;
+    VK_CHECK_RESULT(vkResetCommandPool(*_device, slot.pool, 0));
+    slot.used = 0;
+  }
+}
+
+VkCommandBuffer ParallelRecorder::acquire(uint32_t worker, uint32_t frame)
+{
+  auto &slot = _slots[worker * _frames + frame];
+  if (slot.used == slot.cmds.size())
+    slot.cmds.push_back(_device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, slot.pool, false));
+  return slot.cmds[slot.used++];
+}
+
+void ParallelRecorder::execute(VkCommandBuffer primary, uint32_t frame, VkRenderPass pass, uint32_t subpass, VkFramebuffer fb,
+                               uint32_t count, const RecordFn &fn, uint32_t threads)
+{
+  VkCommandBufferInheritanceInfo inherit = {};
+  inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inherit.renderPass = pass;
+  inherit.subpass = subpass;
+  inherit.framebuffer = fb;
+  record(primary, frame, inherit, count, fn, threads);
+}
+
+void ParallelRecorder::execute(VkCommandBuffer primary, uint32_t frame, const VkCommandBufferInheritanceRenderingInfo &rendering,
+                               uint32_t count, const RecordFn &fn, uint32_t threads)
+{
+  VkCommandBufferInheritanceInfo inherit = {};
+  inherit.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inherit.pNext = &rendering;
+  record(primary, frame, inherit, count, fn, threads);
+}
+
+void ParallelRecorder::record(VkCommandBuffer primary, uint32_t frame, const VkCommandBufferInheritanceInfo &inherit,
+                              uint32_t count, const RecordFn &fn, uint32_t threads)
+{
+  if (count == 0)
+    return;
+  if (threads == 0 || threads > _threads)
+    threads = _threads;
+  uint32_t chunks = std::max(1u, std::min(threads, count / min_chunk));
+
+  VkCommandBufferBeginInfo begin = {};
+  begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  begin.pInheritanceInfo = &inherit;
+
+  // chunk w goes to worker w, so every secondary comes from its recording thread's own pool
+  std::vector<VkCommandBuffer> cmds(chunks);
+  run(chunks, [&](uint32_t w) {
+    uint32_t first = uint32_t(uint64_t(count) * w / chunks);
+    uint32_t last = uint32_t(uint64_t(count) * (w + 1) / chunks);
+    auto cmd = acquire(w, frame);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &begin));
+    fn(cmd, first, last);
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+    cmds[w] = cmd;
+  });
+
+  vkCmdExecuteCommands(primary, uint32_t(cmds.size()), cmds.data());
+}
+
+void ParallelRecorder::run(uint32_t n, const std::function<void(uint32_t)> &job)
+{
+  if (n > 1) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _job = &job;
+      _job_workers = n;
+      _pending = n - 1;
+      _generation++;
+    }
+    _wake.notify_all();
+  }
+
+  job(0);
+
+  if (n > 1) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _pending == 0; });
+    _job = nullptr;
+  }
+}
+
+void ParallelRecorder::work(uint32_t worker)
+{
+  uint64_t seen = 0;
+  for (;;) {
+    const std::function<void(uint32_t)> *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [&] { return _quit || _generation != seen; });
+      if (_quit)
+        return;
+      seen = _generation;
+      if (worker >= _job_workers)
+        continue;
+      job = _job;
+    }
+
+    (*job)(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_pending == 0)
+        _done.notify_one();
+    }
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VulkanDevice;
+
+// records draw work into secondary command buffers on a fixed set of worker threads.
+// every worker owns one command pool per frame in flight, so workers never share a pool while
+// recording. the calling thread works as worker 0. a frame's pools are reset as a whole in
+// begin_frame, once the frame's fence has signalled.
+class ParallelRecorder {
+public:
+  // records items [begin, end) into cmd. cmd continues the render pass, but viewport, scissor,
+  // pipeline and descriptor sets are not inherited and have to be set again.
+  using RecordFn = std::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)>;
+
+  // threads = 0 takes the hardware concurrency
+  ParallelRecorder(VulkanDevice *dev, uint32_t frames, uint32_t threads = 0);
+  ~ParallelRecorder();
+
+  uint32_t thread_count() const { return _threads; }
+
+  // the frame's previous submit has finished, its secondaries can be recorded again
+  void begin_frame(uint32_t frame);
+
+  // splits count items over at most threads workers (0 = all), records them in parallel and executes
+  // the secondaries in item order. primary must be inside a render pass begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS on the given pass, subpass and framebuffer.
+  void execute(VkCommandBuffer primary, uint32_t frame, VkRenderPass pass, uint32_t subpass, VkFramebuffer fb,
+               uint32_t count, const RecordFn &fn, uint32_t threads = 0);
+
+  // the same inside vkCmdBeginRendering with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT, the
+  // secondaries inherit the attachment formats instead of a render pass
+  void execute(VkCommandBuffer primary, uint32_t frame, const VkCommandBufferInheritanceRenderingInfo &rendering,
+               uint32_t count, const RecordFn &fn, uint32_t threads = 0);
+
+private:
+  void record(VkCommandBuffer primary, uint32_t frame, const VkCommandBufferInheritanceInfo &inherit,
+              uint32_t count, const RecordFn &fn, uint32_t threads);
+
+  struct Slot {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> cmds;
+    // secondaries handed out since the last reset
+    size_t used = 0;
+  };
+
+  VkCommandBuffer acquire(uint32_t worker, uint32_t frame);
+
+  // runs job(worker) on the first n workers and returns when all of them are done
+  void run(uint32_t n, const std::function<void(uint32_t)> &job);
+
+  void work(uint32_t worker);
+
+private:
+  VulkanDevice *_device = nullptr;
+  uint32_t _frames = 0;
+  uint32_t _threads = 0;
+
+  // slot of worker w for frame f at w * _frames + f
+  std::vector<Slot> _slots;
+  // workers 1 and up, worker 0 is whoever calls execute
+  std::vector<std::thread> _workers;
+
+  std::mutex _mutex;
+  std::condition_variable _wake, _done;
+  const std::function<void(uint32_t)> *_job = nullptr;
+  uint32_t _job_workers = 0;
+  uint32_t _pending = 0;
+  uint64_t _generation = 0;
+  bool _quit = false;
+};
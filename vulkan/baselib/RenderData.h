@@ -1,6 +1,7 @@
 #pragma once
 
 #include "tvec.h"
+#include "tmath.h"
 #include "VulkanTexture.h"
 
 struct MVP {
@@ -9,6 +10,11 @@ struct MVP {
   tg::mat4 view;
 };
 
+struct BoundingSphere {
+  tg::vec3 center;
+  float radius = 0;
+};
+
 struct Transform{
   tg::mat4 m;
 };
@@ -0,0 +1,195 @@
+#include "ShaderRegistry.h"
+#include "VulkanDevice.h"
+#include "VulkanPipeline.h"
+#include "VulkanTools.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+// glslc -mfmt=c output of the baselib shaders, see compile_shader in CMakeLists.txt
+const uint32_t pbr_clr_vert[] =
+#include "shaders/pbr_clr.vert.inc"
+;
+const uint32_t pbr_clr_frag[] =
+#include "shaders/pbr_clr.frag.inc"
+;
+const uint32_t pbr_tex_vert[] =
+#include "shaders/pbr_tex.vert.inc"
+;
+const uint32_t pbr_tex_frag[] =
+#include "shaders/pbr_tex.frag.inc"
+;
+const uint32_t depth_vert[] =
+#include "shaders/depth.vert.inc"
+;
+const uint32_t depth_frag[] =
+#include "shaders/depth.frag.inc"
+;
+const uint32_t depth_pers_vert[] =
+#include "shaders/depth_pers.vert.inc"
+;
+const uint32_t depth_pers_frag[] =
+#include "shaders/depth_pers.frag.inc"
+;
+const uint32_t hud_vert[] =
+#include "shaders/hud.vert.inc"
+;
+const uint32_t hud_frag[] =
+#include "shaders/hud.frag.inc"
+;
+
+struct Embedded {
+  const char *name;
+  const uint32_t *code;
+  size_t size;
+};
+
+#define EMBED(name, code) {name, code, sizeof(code)}
+
+const Embedded embedded[] = {
+  EMBED("pbr_clr.vert", pbr_clr_vert),
+  EMBED("pbr_clr.frag", pbr_clr_frag),
+  EMBED("pbr_tex.vert", pbr_tex_vert),
+  EMBED("pbr_tex.frag", pbr_tex_frag),
+  EMBED("depth.vert", depth_vert),
+  EMBED("depth.frag", depth_frag),
+  EMBED("depth_pers.vert", depth_pers_vert),
+  EMBED("depth_pers.frag", depth_pers_frag),
+  EMBED("hud.vert", hud_vert),
+  EMBED("hud.frag", hud_frag),
+};
+
+#undef EMBED
+
+const Embedded *find_embedded(const std::string &name)
+{
+  for (auto &e : embedded)
+    if (name == e.name)
+      return &e;
+  return nullptr;
+}
+
+int64_t file_stamp(const std::string &file)
+{
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(file, ec);
+  return ec ? 0 : (int64_t)t.time_since_epoch().count();
+}
+
+int64_t now_ms()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+ShaderRegistry::ShaderRegistry(VulkanDevice *dev) : _device(dev)
+{
+}
+
+ShaderRegistry::~ShaderRegistry()
+{
+  for (auto &[name, shader] : _shaders)
+    if (shader.module)
+      vkDestroyShaderModule(*_device, shader.module, nullptr);
+}
+
+VkShaderModule ShaderRegistry::create(const std::string &name, Shader &shader)
+{
+  // the file on disk wins while watching, it is what gets edited
+  if (!shader.file.empty()) {
+    auto code = vks::tools::readFile(shader.file);
+    if (!code.empty()) {
+      shader.stamp = file_stamp(shader.file);
+      return _device->create_shader(code.c_str(), (int)code.size());
+    }
+  }
+
+  if (auto e = find_embedded(name))
+    return _device->create_shader((const char *)e->code, (int)e->size);
+  return VK_NULL_HANDLE;
+}
+
+VkShaderModule ShaderRegistry::get(const std::string &name, VulkanPipeline *user)
+{
+  auto it = _shaders.find(name);
+  if (it == _shaders.end()) {
+    Shader shader;
+    if (!find_embedded(name))
+      shader.file = name;
+    else if (_watching)
+      shader.file = _dir + "/" + name + ".spv";
+    shader.module = create(name, shader);
+    it = _shaders.emplace(name, std::move(shader)).first;
+  }
+  if (user)
+    it->second.users.insert(user);
+  return it->second.module;
+}
+
+void ShaderRegistry::forget(VulkanPipeline *user)
+{
+  for (auto &[name, shader] : _shaders)
+    shader.users.erase(user);
+}
+
+void ShaderRegistry::watch(const std::string &dir)
+{
+  _watching = true;
+  _dir = dir;
+  for (auto &[name, shader] : _shaders) {
+    if (find_embedded(name)) {
+      shader.file = _dir + "/" + name + ".spv";
+      shader.stamp = file_stamp(shader.file);
+    }
+  }
+}
+
+bool ShaderRegistry::poll()
+{
+  if (!_watching)
+    return false;
+
+  // a stat per shader is cheap, but not every loop iteration
+  int64_t now = now_ms();
+  if (now - _last_poll < 500)
+    return false;
+  _last_poll = now;
+
+  std::set<VulkanPipeline *> dirty;
+  std::vector<Shader *> changed;
+  for (auto &[name, shader] : _shaders) {
+    if (shader.file.empty())
+      continue;
+    auto stamp = file_stamp(shader.file);
+    if (stamp == 0 || stamp == shader.stamp)
+      continue;
+    shader.stamp = stamp;
+    changed.push_back(&shader);
+  }
+  if (changed.empty())
+    return false;
+
+  // the old modules and pipelines may still be referenced by frames in flight
+  vkDeviceWaitIdle(*_device);
+
+  for (auto *shader : changed) {
+    auto code = vks::tools::readFile(shader->file);
+    // caught the compiler halfway through the file, try again on the next poll
+    if (code.size() < 20 || code.size() % 4 || *(const uint32_t *)code.data() != 0x07230203) {
+      shader->stamp = 0;
+      continue;
+    }
+    std::cout << "reloading " << shader->file << std::endl;
+    vkDestroyShaderModule(*_device, shader->module, nullptr);
+    shader->module = _device->create_shader(code.c_str(), (int)code.size());
+    dirty.insert(shader->users.begin(), shader->users.end());
+  }
+
+  for (auto *pipeline : dirty)
+    pipeline->rebuild();
+  return !dirty.empty();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class VulkanDevice;
+class VulkanPipeline;
+
+// one VkShaderModule per shader for the whole device.
+// baselib shaders are compiled into the library and looked up by name ("depth.vert"), any other
+// name is read as a .spv path. with watch() the registry polls the .spv files on disk and, when one
+// changes, swaps the module and rebuilds only the pipelines that were created with it.
+class ShaderRegistry {
+public:
+  ShaderRegistry(VulkanDevice *dev);
+  ~ShaderRegistry();
+
+  // user is rebuilt when the shader is reloaded
+  VkShaderModule get(const std::string &name, VulkanPipeline *user = nullptr);
+
+  void forget(VulkanPipeline *user);
+
+  // embedded shaders are reloaded from dir/<name>.spv, paths are watched as they are
+  void watch(const std::string &dir);
+
+  // reloads changed shaders, true when a pipeline was rebuilt and command buffers need recording
+  bool poll();
+
+private:
+  struct Shader {
+    VkShaderModule module = VK_NULL_HANDLE;
+    std::string file;
+    int64_t stamp = 0;
+    std::set<VulkanPipeline *> users;
+  };
+
+  VkShaderModule create(const std::string &name, Shader &shader);
+
+private:
+  VulkanDevice *_device = nullptr;
+  std::map<std::string, Shader> _shaders;
+
+  bool _watching = false;
+  std::string _dir;
+  int64_t _last_poll = 0;
+};
@@ -0,0 +1,79 @@
+#include "StagingRing.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+StagingRing::StagingRing(VulkanDevice *dev, VkDeviceSize size) : _device(dev), _size(size)
+{
+  VkBufferCreateInfo info = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size);
+  info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(*_device, &info, nullptr, &_buffer));
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(*_device, _buffer, &reqs);
+  _memory = _device->allocator()->allocate(reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                                          MemoryCategory::Staging);
+  if (!_memory || !_memory.mapped)
+    throw std::runtime_error("No proper memory type!");
+  VK_CHECK_RESULT(vkBindBufferMemory(*_device, _buffer, _memory.memory, _memory.offset));
+}
+
+StagingRing::~StagingRing()
+{
+  if (_buffer)
+    vkDestroyBuffer(*_device, _buffer, nullptr);
+  if (_memory)
+    _device->allocator()->free(_memory);
+}
+
+std::optional<StagingRing::Region> StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_segments.empty())
+    _head = _tail = 0;
+
+  VkDeviceSize offset = (_head + alignment - 1) / alignment * alignment;
+  bool wrapped = _head < _tail || (_head == _tail && !_segments.empty());
+  if (wrapped) {
+    if (offset + size > _tail)
+      return std::nullopt;
+  } else if (offset + size > _size) {
+    // the tail end is too short, start over at the front of the ring
+    if (size > _tail)
+      return std::nullopt;
+    offset = 0;
+  }
+
+  _head = offset + size;
+  _segments.push_back({_next_ticket, _head, false});
+
+  Region region;
+  region.buffer = _buffer;
+  region.offset = offset;
+  region.data = _memory.mapped + offset;
+  region.ticket = _next_ticket++;
+  return region;
+}
+
+void StagingRing::release(uint64_t ticket)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto &seg : _segments) {
+    if (seg.ticket == ticket) {
+      seg.done = true;
+      break;
+    }
+  }
+  while (!_segments.empty() && _segments.front().done) {
+    _tail = _segments.front().end;
+    _segments.pop_front();
+  }
+}
+
+VkDeviceSize StagingRing::in_flight() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_segments.empty())
+    return 0;
+  return _head > _tail ? _head - _tail : _size - _tail + _head;
+}
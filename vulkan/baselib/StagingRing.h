@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+
+// persistently mapped host visible ring that upload batches carve their staging copies from.
+// every allocation gets a ticket, space is recycled once the tickets in front of it are released.
+class StagingRing {
+public:
+  struct Region {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    uint8_t *data = nullptr;
+    uint64_t ticket = 0;
+  };
+
+  StagingRing(VulkanDevice *dev, VkDeviceSize size);
+  ~StagingRing();
+
+  // nullopt when the ring has no room left until older uploads retire
+  std::optional<Region> allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+  // called once the gpu no longer reads the region of the ticket, in any order
+  void release(uint64_t ticket);
+
+  VkDeviceSize size() const { return _size; }
+  VkDeviceSize in_flight() const;
+
+private:
+  struct Segment {
+    uint64_t ticket;
+    VkDeviceSize end;
+    bool done;
+  };
+
+  VulkanDevice *_device = nullptr;
+  VkBuffer _buffer = VK_NULL_HANDLE;
+  MemoryAllocation _memory;
+  VkDeviceSize _size = 0;
+
+  // _head is where the next region goes, _tail the start of the oldest live one
+  VkDeviceSize _head = 0, _tail = 0;
+  uint64_t _next_ticket = 1;
+  std::deque<Segment> _segments;
+
+  mutable std::mutex _mutex;
+};
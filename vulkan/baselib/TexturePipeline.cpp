@@ -48,12 +48,14 @@ VkDescriptorSetLayout TexturePipeline::texture_layout()
 
 void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
 {
+  _pass = render_pass;
+  _subpass = subpass;
+
   auto pipe_lay = pipe_layout();
 
   VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
   pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineCreateInfo.layout = pipe_lay;
-  pipelineCreateInfo.renderPass = *render_pass;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
   inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -142,13 +144,13 @@ void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
   VkPipelineShaderStageCreateInfo shaderStages[2] = {};
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = _device->create_shader(SHADER_DIR "/pbr_tex.vert.spv");
+  shaderStages[0].module = shader("pbr_tex.vert");
   shaderStages[0].pName = "main";
   assert(shaderStages[0].module != VK_NULL_HANDLE);
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = _device->create_shader(SHADER_DIR "/pbr_tex.frag.spv");
+  shaderStages[1].module = shader("pbr_tex.frag");
   shaderStages[1].pName = "main";
   assert(shaderStages[1].module != VK_NULL_HANDLE);
 
@@ -163,12 +165,9 @@ void TexturePipeline::realize(VulkanPass *render_pass, int subpass)
   pipelineCreateInfo.pViewportState = &viewportState;
   pipelineCreateInfo.pDepthStencilState = &depthStencilState;
   pipelineCreateInfo.pDynamicState = &dynamicState;
-  pipelineCreateInfo.subpass = subpass;
-
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*_device, _device->get_or_create_pipecache(), 1, &pipelineCreateInfo, nullptr, &_pipeline));
+  render_pass->attach(pipelineCreateInfo, subpass);
 
-  vkDestroyShaderModule(*_device, shaderStages[0].module, nullptr);
-  vkDestroyShaderModule(*_device, shaderStages[1].module, nullptr);
+  _pipeline = _device->create_graphics_pipeline(pipelineCreateInfo, "texture");
 }
 
 VkDescriptorSetLayout TexturePipeline::pbr_layout()
@@ -0,0 +1,162 @@
+#include "TextureTools.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+namespace tex {
+
+uint32_t mip_levels(uint32_t w, uint32_t h)
+{
+  uint32_t n = std::max(w, h), levels = 1;
+  while (n > 1) {
+    n >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+static void downsample_rows(const uint8_t *src, uint32_t sw, uint32_t sh, uint8_t *dst, uint32_t dw, uint32_t c, uint32_t y0, uint32_t y1)
+{
+  for (uint32_t y = y0; y < y1; y++) {
+    const uint8_t *r0 = src + size_t(std::min(2 * y, sh - 1)) * sw * c;
+    const uint8_t *r1 = src + size_t(std::min(2 * y + 1, sh - 1)) * sw * c;
+    uint8_t *d = dst + size_t(y) * dw * c;
+    for (uint32_t x = 0; x < dw; x++) {
+      uint32_t x0 = std::min(2 * x, sw - 1) * c;
+      uint32_t x1 = std::min(2 * x + 1, sw - 1) * c;
+      for (uint32_t k = 0; k < c; k++)
+        d[x * c + k] = uint8_t((r0[x0 + k] + r0[x1 + k] + r1[x0 + k] + r1[x1 + k] + 2) >> 2);
+    }
+  }
+}
+
+std::vector<MipLevel> build_mip_chain(const uint8_t *data, uint32_t w, uint32_t h, uint32_t channels, std::vector<uint8_t> &out)
+{
+  std::vector<MipLevel> levels(mip_levels(w, h));
+
+  size_t total = 0;
+  for (uint32_t i = 0, lw = w, lh = h; i < levels.size(); i++) {
+    levels[i].w = lw;
+    levels[i].h = lh;
+    levels[i].offset = total;
+    levels[i].size = size_t(lw) * lh * channels;
+    total += levels[i].size;
+    lw = std::max(lw >> 1, 1u);
+    lh = std::max(lh >> 1, 1u);
+  }
+
+  out.resize(total);
+  memcpy(out.data(), data, levels[0].size);
+
+  const uint32_t hw_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (size_t i = 1; i < levels.size(); i++) {
+    auto &src = levels[i - 1];
+    auto &dst = levels[i];
+    const uint8_t *s = out.data() + src.offset;
+    uint8_t *d = out.data() + dst.offset;
+
+    // small levels are not worth a thread
+    uint32_t nthreads = std::min(hw_threads, std::max(dst.h / 64, 1u));
+    if (nthreads == 1) {
+      downsample_rows(s, src.w, src.h, d, dst.w, channels, 0, dst.h);
+      continue;
+    }
+
+    std::vector<std::thread> workers;
+    uint32_t rows = (dst.h + nthreads - 1) / nthreads;
+    for (uint32_t t = 0; t < nthreads; t++) {
+      uint32_t y0 = t * rows, y1 = std::min(y0 + rows, dst.h);
+      if (y0 >= y1)
+        break;
+      workers.emplace_back(downsample_rows, s, src.w, src.h, d, dst.w, channels, y0, y1);
+    }
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  return levels;
+}
+
+const uint8_t ktx2_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+template <typename T>
+static T read_le(const uint8_t *p)
+{
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+bool read_ktx2(const std::string &file, Ktx2Image &img)
+{
+  std::ifstream is(file, std::ios::binary);
+  if (!is) {
+    std::cerr << "Could not open " << file << std::endl;
+    return false;
+  }
+  std::vector<uint8_t> buf((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+  const size_t header_size = 80;
+  if (buf.size() < header_size || memcmp(buf.data(), ktx2_identifier, sizeof(ktx2_identifier)) != 0) {
+    std::cerr << file << " is not a ktx2 file" << std::endl;
+    return false;
+  }
+
+  const uint8_t *h = buf.data() + sizeof(ktx2_identifier);
+  uint32_t vk_format = read_le<uint32_t>(h);
+  uint32_t width = read_le<uint32_t>(h + 8);
+  uint32_t height = read_le<uint32_t>(h + 12);
+  uint32_t depth = read_le<uint32_t>(h + 16);
+  uint32_t layers = read_le<uint32_t>(h + 20);
+  uint32_t faces = read_le<uint32_t>(h + 24);
+  uint32_t level_count = std::max(read_le<uint32_t>(h + 28), 1u);
+  uint32_t supercompression = read_le<uint32_t>(h + 32);
+
+  if (vk_format == 0 || depth > 1 || layers > 1 || faces != 1 || supercompression != 0) {
+    std::cerr << file << ": only plain 2d ktx2 textures are supported" << std::endl;
+    return false;
+  }
+  if (buf.size() < header_size + size_t(level_count) * 24) {
+    std::cerr << file << ": truncated level index" << std::endl;
+    return false;
+  }
+
+  img.vk_format = vk_format;
+  img.w = width;
+  img.h = height;
+  img.levels.resize(level_count);
+
+  size_t total = 0;
+  const uint8_t *index = buf.data() + header_size;
+  for (uint32_t i = 0; i < level_count; i++, index += 24) {
+    uint64_t offset = read_le<uint64_t>(index);
+    uint64_t length = read_le<uint64_t>(index + 8);
+    if (offset + length > buf.size()) {
+      std::cerr << file << ": level " << i << " is out of range" << std::endl;
+      return false;
+    }
+    auto &lv = img.levels[i];
+    lv.w = std::max(width >> i, 1u);
+    lv.h = std::max(height >> i, 1u);
+    lv.offset = offset;
+    lv.size = length;
+    total += length;
+  }
+
+  // repack the levels largest first, the file stores them the other way round
+  img.data.resize(total);
+  size_t dst = 0;
+  for (auto &lv : img.levels) {
+    memcpy(img.data.data() + dst, buf.data() + lv.offset, lv.size);
+    lv.offset = dst;
+    dst += lv.size;
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tex {
+
+struct MipLevel {
+  uint32_t w = 0, h = 0;
+  size_t offset = 0, size = 0;
+};
+
+uint32_t mip_levels(uint32_t w, uint32_t h);
+
+// box filter an 8 bit per channel image down to 1x1, every level (base included) is written to out
+std::vector<MipLevel> build_mip_chain(const uint8_t *data, uint32_t w, uint32_t h, uint32_t channels, std::vector<uint8_t> &out);
+
+struct Ktx2Image {
+  uint32_t vk_format = 0;
+  uint32_t w = 0, h = 0;
+  std::vector<MipLevel> levels;
+  std::vector<uint8_t> data;
+};
+
+extern const uint8_t ktx2_identifier[12];
+
+// single layer, single face 2d textures without supercompression
+bool read_ktx2(const std::string &file, Ktx2Image &img);
+
+}
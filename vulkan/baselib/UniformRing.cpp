@@ -0,0 +1,61 @@
+#include "UniformRing.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+UniformRing::UniformRing(VulkanDevice *dev, uint32_t frames, VkDeviceSize frame_size) : _device(dev), _frames(frames)
+{
+  _alignment = std::max<VkDeviceSize>(_device->device_properties().limits.minUniformBufferOffsetAlignment, 16);
+  _frame_size = (frame_size + _alignment - 1) / _alignment * _alignment;
+  _host.resize(_frame_size);
+  _frame_versions.resize(_frames, 0);
+
+  VkBufferCreateInfo info = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, _frame_size * _frames);
+  info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(*_device, &info, nullptr, &_buffer));
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(*_device, _buffer, &reqs);
+  _memory = _device->allocator()->allocate(reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                                          MemoryCategory::Uniform);
+  if (!_memory || !_memory.mapped)
+    throw std::runtime_error("No proper memory type!");
+  VK_CHECK_RESULT(vkBindBufferMemory(*_device, _buffer, _memory.memory, _memory.offset));
+}
+
+UniformRing::~UniformRing()
+{
+  if (_buffer)
+    vkDestroyBuffer(*_device, _buffer, nullptr);
+  if (_memory)
+    _device->allocator()->free(_memory);
+}
+
+VkDeviceSize UniformRing::allocate(VkDeviceSize size)
+{
+  VkDeviceSize offset = _used;
+  VkDeviceSize end = offset + (size + _alignment - 1) / _alignment * _alignment;
+  if (end > _frame_size)
+    throw std::runtime_error("Uniform ring is full!");
+  _used = end;
+  return offset;
+}
+
+void UniformRing::write(VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+  assert(offset + size <= _used);
+  memcpy(_host.data() + offset, data, size);
+  _version++;
+}
+
+void UniformRing::flush(uint32_t frame)
+{
+  assert(frame < _frames);
+  if (_frame_versions[frame] == _version)
+    return;
+  memcpy(_memory.mapped + frame * _frame_size, _host.data(), _used);
+  _frame_versions[frame] = _version;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+
+// persistently mapped uniform memory with one slice per frame in flight.
+// a block is allocated once and sits at the same offset in every slice, its descriptor points at
+// slice 0 and each frame selects its own slice through the dynamic offset. writes go to a host copy
+// and are only copied into a slice by flush(), after the frame that last read it has retired.
+class UniformRing {
+public:
+  UniformRing(VulkanDevice *dev, uint32_t frames, VkDeviceSize frame_size = 64 * 1024);
+  ~UniformRing();
+
+  // offset of the block inside a slice, aligned to minUniformBufferOffsetAlignment
+  VkDeviceSize allocate(VkDeviceSize size);
+
+  void write(VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+  // copies the pending writes into the slice of frame, the frame's fence must have signalled
+  void flush(uint32_t frame);
+
+  // binding for a UNIFORM_BUFFER_DYNAMIC descriptor of a block
+  VkDescriptorBufferInfo descriptor(VkDeviceSize size) const { return {_buffer, 0, size}; }
+
+  uint32_t dynamic_offset(uint32_t frame, VkDeviceSize offset) const { return uint32_t(frame * _frame_size + offset); }
+
+  uint32_t frames() const { return _frames; }
+
+private:
+  VulkanDevice *_device = nullptr;
+  VkBuffer _buffer = VK_NULL_HANDLE;
+  MemoryAllocation _memory;
+
+  uint32_t _frames = 0;
+  VkDeviceSize _frame_size = 0;
+  VkDeviceSize _alignment = 1;
+  VkDeviceSize _used = 0;
+
+  std::vector<uint8_t> _host;
+  // a slice is stale while its version is behind _version
+  uint64_t _version = 0;
+  std::vector<uint64_t> _frame_versions;
+};
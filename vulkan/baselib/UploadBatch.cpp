@@ -0,0 +1,225 @@
+#include "UploadBatch.h"
+#include "VulkanDevice.h"
+#include "VulkanBuffer.h"
+#include "VulkanTools.h"
+#include "VulkanInitializers.hpp"
+
+UploadBatch::UploadBatch(const std::shared_ptr<VulkanDevice> &dev) : _device(dev)
+{
+}
+
+UploadBatch::~UploadBatch()
+{
+  // staged but never submitted, nothing on the gpu reads the ring space
+  if (!_value && !_done)
+    retire();
+  if (_value)
+    wait();
+  if (_timeline)
+    vkDestroySemaphore(*_device, _timeline, nullptr);
+  if (_cmd)
+    vkFreeCommandBuffers(*_device, _device->transfer_command_pool(), 1, &_cmd);
+  if (_gfx_cmd)
+    vkFreeCommandBuffers(*_device, _device->command_pool(), 1, &_gfx_cmd);
+}
+
+bool UploadBatch::split() const
+{
+  return _device->transfer_family() != _device->graphics_family();
+}
+
+VkCommandBuffer UploadBatch::command_buffer()
+{
+  assert(!_value);
+  if (!_cmd)
+    _cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, _device->transfer_command_pool(), true);
+  return _cmd;
+}
+
+VkCommandBuffer UploadBatch::graphics_command_buffer()
+{
+  assert(!_value);
+  if (!split())
+    return command_buffer();
+  if (!_gfx_cmd)
+    _gfx_cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+  return _gfx_cmd;
+}
+
+StagingRing::Region UploadBatch::stage(const void *data, VkDeviceSize size)
+{
+  if (auto region = _device->staging_ring()->allocate(size)) {
+    memcpy(region->data, data, size);
+    _tickets.push_back(region->ticket);
+    return *region;
+  }
+
+  auto buf = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, size, (void *)data);
+  _staging.push_back(buf);
+  StagingRing::Region region;
+  region.buffer = *buf;
+  return region;
+}
+
+void UploadBatch::copy(const void *data, VkDeviceSize size, VulkanBuffer *dst, VkDeviceSize dst_offset)
+{
+  copy(data, size, VkBuffer(*dst), dst_offset);
+}
+
+void UploadBatch::copy(const void *data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dst_offset)
+{
+  if (size == 0)
+    return;
+  auto src = stage(data, size);
+  VkBufferCopy region = {};
+  region.srcOffset = src.offset;
+  region.dstOffset = dst_offset;
+  region.size = size;
+  vkCmdCopyBuffer(command_buffer(), src.buffer, dst, 1, &region);
+
+  if (split()) {
+    VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+    barrier.srcQueueFamilyIndex = _device->transfer_family();
+    barrier.dstQueueFamilyIndex = _device->graphics_family();
+    barrier.buffer = dst;
+    barrier.offset = dst_offset;
+    barrier.size = size;
+    _buffers.push_back(barrier);
+  }
+}
+
+void UploadBatch::transfer_image(VkImage img, const VkImageSubresourceRange &range, VkImageLayout layout)
+{
+  if (!split())
+    return;
+
+  VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+  barrier.srcQueueFamilyIndex = _device->transfer_family();
+  barrier.dstQueueFamilyIndex = _device->graphics_family();
+  barrier.oldLayout = layout;
+  barrier.newLayout = layout;
+  barrier.image = img;
+  barrier.subresourceRange = range;
+
+  // release, the access mask of the other family is ignored
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  vkCmdPipelineBarrier(command_buffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  // acquire
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(graphics_command_buffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
+                       nullptr, 0, nullptr, 1, &barrier);
+}
+
+void UploadBatch::submit()
+{
+  if (!_cmd || _value)
+    return;
+
+  const VkAccessFlags read_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                    VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  if (!split()) {
+    // make the copies visible to whatever reads them later on this queue
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = read_access;
+    vkCmdPipelineBarrier(_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                         nullptr);
+  } else if (!_buffers.empty()) {
+    for (auto &b : _buffers) {
+      b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      b.dstAccessMask = 0;
+    }
+    vkCmdPipelineBarrier(_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         (uint32_t)_buffers.size(), _buffers.data(), 0, nullptr);
+    for (auto &b : _buffers) {
+      b.srcAccessMask = 0;
+      b.dstAccessMask = read_access;
+    }
+    vkCmdPipelineBarrier(graphics_command_buffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
+                         nullptr, (uint32_t)_buffers.size(), _buffers.data(), 0, nullptr);
+  }
+
+  VkSemaphoreTypeCreateInfo type_info = {};
+  type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  type_info.initialValue = 0;
+  VkSemaphoreCreateInfo sem_info = vks::initializers::semaphoreCreateInfo();
+  sem_info.pNext = &type_info;
+  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &sem_info, nullptr, &_timeline));
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(_cmd));
+
+  uint64_t copied = 1;
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.signalSemaphoreValueCount = 1;
+  timeline_info.pSignalSemaphoreValues = &copied;
+
+  VkSubmitInfo submit_info = vks::initializers::submitInfo();
+  submit_info.pNext = &timeline_info;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &_cmd;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &_timeline;
+  VK_CHECK_RESULT(vkQueueSubmit(_device->transfer_queue(), 1, &submit_info, VK_NULL_HANDLE));
+  _value = copied;
+
+  if (_gfx_cmd) {
+    VK_CHECK_RESULT(vkEndCommandBuffer(_gfx_cmd));
+
+    // the graphics queue only stalls on the copies inside this submit, frames recorded around it keep going
+    uint64_t acquired = 2;
+    timeline_info.waitSemaphoreValueCount = 1;
+    timeline_info.pWaitSemaphoreValues = &copied;
+    timeline_info.pSignalSemaphoreValues = &acquired;
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &_timeline;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.pCommandBuffers = &_gfx_cmd;
+    VK_CHECK_RESULT(vkQueueSubmit(_device->graphic_queue(), 1, &submit_info, VK_NULL_HANDLE));
+    _value = acquired;
+  }
+}
+
+bool UploadBatch::finished()
+{
+  if (_done || !_cmd)
+    return true;
+  if (!_value)
+    return false;
+  uint64_t value = 0;
+  VK_CHECK_RESULT(vkGetSemaphoreCounterValue(*_device, _timeline, &value));
+  if (value < _value)
+    return false;
+  retire();
+  return true;
+}
+
+void UploadBatch::wait()
+{
+  if (_done || !_value)
+    return;
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_timeline;
+  wait_info.pValues = &_value;
+  VK_CHECK_RESULT(vkWaitSemaphores(*_device, &wait_info, DEFAULT_FENCE_TIMEOUT));
+  retire();
+}
+
+void UploadBatch::retire()
+{
+  _done = true;
+  for (auto ticket : _tickets)
+    _device->staging_ring()->release(ticket);
+  _tickets.clear();
+  _staging.clear();
+}
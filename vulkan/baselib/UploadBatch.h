@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+#include "StagingRing.h"
+
+class VulkanDevice;
+class VulkanBuffer;
+
+// records any number of uploads for the transfer queue. with a dedicated transfer family the
+// resources are released to the graphics family and acquired by a second command buffer on the
+// graphics queue, which waits for the copies on the batch's timeline semaphore.
+class UploadBatch {
+public:
+  UploadBatch(const std::shared_ptr<VulkanDevice> &dev);
+  ~UploadBatch();
+
+  // transfer queue commands, copies only
+  VkCommandBuffer command_buffer();
+
+  // graphics queue commands that run after the copies, blits and layout changes for sampling go here.
+  // same as command_buffer() when the device has no separate transfer family.
+  VkCommandBuffer graphics_command_buffer();
+
+  // host visible copy of data, taken from the device staging ring and kept until the batch retires
+  StagingRing::Region stage(const void *data, VkDeviceSize size);
+
+  // dst is handed to the graphics family on submit
+  void copy(const void *data, VkDeviceSize size, VulkanBuffer *dst, VkDeviceSize dst_offset = 0);
+  void copy(const void *data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dst_offset = 0);
+
+  // hands an image written by command_buffer() over to the graphics family, layout is kept as is.
+  // record before touching the image in graphics_command_buffer().
+  void transfer_image(VkImage img, const VkImageSubresourceRange &range, VkImageLayout layout);
+
+  void submit();
+
+  // polls the timeline, staging memory is released once the gpu is done with it
+  bool finished();
+
+  void wait();
+
+  bool submitted() { return _value != 0; }
+
+private:
+  bool split() const;
+  void retire();
+
+private:
+  std::shared_ptr<VulkanDevice> _device;
+
+  VkCommandBuffer _cmd = VK_NULL_HANDLE;
+  VkCommandBuffer _gfx_cmd = VK_NULL_HANDLE;
+  // 1 once the copies are done, 2 once the graphics side is done
+  VkSemaphore _timeline = VK_NULL_HANDLE;
+  uint64_t _value = 0;
+  bool _done = false;
+
+  std::vector<VkBufferMemoryBarrier> _buffers;
+
+  std::vector<uint64_t> _tickets;
+  // uploads that did not fit the ring
+  std::vector<std::shared_ptr<VulkanBuffer>> _staging;
+};
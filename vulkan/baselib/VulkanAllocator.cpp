@@ -0,0 +1,411 @@
+#include "VulkanAllocator.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+namespace {
+
+const VkDeviceSize min_alloc_size = 256;
+
+uint32_t order_of(VkDeviceSize size)
+{
+  uint32_t order = 0;
+  while ((min_alloc_size << order) < size)
+    order++;
+  return order;
+}
+
+VkDeviceSize align_down(VkDeviceSize v, VkDeviceSize a)
+{
+  return v / a * a;
+}
+
+VkDeviceSize align_up(VkDeviceSize v, VkDeviceSize a)
+{
+  return (v + a - 1) / a * a;
+}
+
+}
+
+const char *category_name(MemoryCategory category)
+{
+  switch (category) {
+  case MemoryCategory::Vertex: return "vertex";
+  case MemoryCategory::Index: return "index";
+  case MemoryCategory::Uniform: return "uniform";
+  case MemoryCategory::Texture: return "texture";
+  case MemoryCategory::RenderTarget: return "render_target";
+  case MemoryCategory::Staging: return "staging";
+  default: return "other";
+  }
+}
+
+struct VulkanAllocator::Block {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  uint8_t *mapped = nullptr;
+  VkDeviceSize used = 0;
+  uint32_t count = 0;
+
+  // free offsets per order, order k covers min_alloc_size << k bytes
+  std::vector<std::set<VkDeviceSize>> free;
+  struct Live {
+    uint32_t order;
+    MemoryCategory category;
+  };
+  // live allocations by offset
+  std::map<VkDeviceSize, Live> live;
+};
+
+struct VulkanAllocator::Pool {
+  uint32_t type = 0;
+  bool linear = true;
+  std::vector<std::unique_ptr<Block>> blocks;
+};
+
+VulkanAllocator::VulkanAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size)
+  : _device(device)
+{
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &_props);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physical_device, &props);
+  _atom_size = std::max<VkDeviceSize>(props.limits.nonCoherentAtomSize, 1);
+
+  // block size is a power of two so the buddy tree stays complete
+  _block_size = min_alloc_size << order_of(std::max(block_size, min_alloc_size));
+
+  _pools.resize(_props.memoryTypeCount * 2);
+  for (uint32_t i = 0; i < _pools.size(); i++) {
+    _pools[i] = std::make_unique<Pool>();
+    _pools[i]->type = i / 2;
+    _pools[i]->linear = (i % 2) == 0;
+  }
+}
+
+VulkanAllocator::~VulkanAllocator()
+{
+  for (auto &pool : _pools) {
+    for (auto &block : pool->blocks) {
+      if (block->memory)
+        vkFreeMemory(_device, block->memory, nullptr);
+    }
+  }
+  for (auto &d : _dedicated)
+    vkFreeMemory(_device, d.memory, nullptr);
+}
+
+std::optional<uint32_t> VulkanAllocator::find_type(uint32_t bits, VkMemoryPropertyFlags flags) const
+{
+  for (uint32_t i = 0; i < _props.memoryTypeCount; i++) {
+    if ((bits & (1u << i)) && (_props.memoryTypes[i].propertyFlags & flags) == flags)
+      return i;
+  }
+  return std::nullopt;
+}
+
+bool VulkanAllocator::host_coherent(uint32_t type) const
+{
+  return _props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+MemoryAllocation VulkanAllocator::allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags, bool linear,
+                                           MemoryCategory category, const void *next)
+{
+  MemoryAllocation alloc = allocate_memory(reqs, flags, linear, next);
+  if (!alloc)
+    return alloc;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  alloc.category = category;
+  if (alloc.pool >= 0)
+    _pools[alloc.pool]->blocks[alloc.block]->live[alloc.offset].category = category;
+  auto &c = _categories[size_t(category)];
+  c.allocations++;
+  c.bytes += alloc.size;
+  c.total_allocations++;
+  c.total_bytes += alloc.size;
+  return alloc;
+}
+
+MemoryAllocation VulkanAllocator::allocate_memory(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags, bool linear, const void *next)
+{
+  MemoryAllocation alloc;
+  auto type = find_type(reqs.memoryTypeBits, flags);
+  if (!type)
+    return alloc;
+
+  // buddy offsets are aligned to their own size, rounding up to the alignment covers it
+  VkDeviceSize size = std::max(reqs.size, reqs.alignment);
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (next || size > _block_size / 2)
+    return allocate_dedicated(reqs.size, *type, next);
+
+  int32_t pool_index = int32_t(*type * 2 + (linear ? 0 : 1));
+  auto &pool = *_pools[pool_index];
+  if (allocate_from(pool, pool_index, size, alloc))
+    return alloc;
+
+  // no room left, reuse a released slot or grow the pool by one block
+  auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](auto &b) { return b->memory == VK_NULL_HANDLE; });
+  if (it == pool.blocks.end()) {
+    pool.blocks.push_back(std::make_unique<Block>());
+    it = pool.blocks.end() - 1;
+  }
+  auto &block = **it;
+
+  VkMemoryAllocateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  info.allocationSize = _block_size;
+  info.memoryTypeIndex = *type;
+  if (vkAllocateMemory(_device, &info, nullptr, &block.memory) != VK_SUCCESS) {
+    block.memory = VK_NULL_HANDLE;
+    // a small heap may not fit a whole block, give the resource its own memory instead
+    return allocate_dedicated(reqs.size, *type);
+  }
+  if (_props.memoryTypes[*type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    VK_CHECK_RESULT(vkMapMemory(_device, block.memory, 0, VK_WHOLE_SIZE, 0, (void **)&block.mapped));
+
+  uint32_t top = order_of(_block_size);
+  block.free.assign(top + 1, {});
+  block.free[top].insert(0);
+
+  allocate_from(pool, pool_index, size, alloc);
+  return alloc;
+}
+
+bool VulkanAllocator::allocate_from(Pool &pool, int32_t pool_index, VkDeviceSize size, MemoryAllocation &out)
+{
+  uint32_t order = order_of(size);
+  for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+    auto &block = *pool.blocks[b];
+    if (!block.memory)
+      continue;
+
+    uint32_t j = order;
+    while (j < block.free.size() && block.free[j].empty())
+      j++;
+    if (j >= block.free.size())
+      continue;
+
+    VkDeviceSize offset = *block.free[j].begin();
+    block.free[j].erase(block.free[j].begin());
+    // split down to the requested order, the upper halves go back to the free lists
+    while (j > order) {
+      j--;
+      block.free[j].insert(offset + (min_alloc_size << j));
+    }
+
+    block.live[offset] = {order, MemoryCategory::Other};
+    block.used += min_alloc_size << order;
+    block.count++;
+
+    out.memory = block.memory;
+    out.offset = offset;
+    out.size = min_alloc_size << order;
+    out.mapped = block.mapped ? block.mapped + offset : nullptr;
+    out.type = pool.type;
+    out.pool = pool_index;
+    out.block = b;
+    out.order = order;
+    return true;
+  }
+  return false;
+}
+
+MemoryAllocation VulkanAllocator::allocate_dedicated(VkDeviceSize size, uint32_t type, const void *next)
+{
+  MemoryAllocation alloc;
+  VkMemoryAllocateInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  info.pNext = next;
+  info.allocationSize = size;
+  info.memoryTypeIndex = type;
+  if (vkAllocateMemory(_device, &info, nullptr, &alloc.memory) != VK_SUCCESS)
+    return MemoryAllocation();
+
+  if (_props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    VK_CHECK_RESULT(vkMapMemory(_device, alloc.memory, 0, VK_WHOLE_SIZE, 0, (void **)&alloc.mapped));
+
+  alloc.size = size;
+  alloc.type = type;
+  alloc.pool = -1;
+  _dedicated.push_back({alloc.memory, size, type});
+  return alloc;
+}
+
+void VulkanAllocator::release(Pool &pool, uint32_t b, VkDeviceSize offset, uint32_t order)
+{
+  auto &block = *pool.blocks[b];
+  block.live.erase(offset);
+  block.used -= min_alloc_size << order;
+  block.count--;
+
+  // merge with the buddy as long as it is free as a whole
+  while (order + 1 < block.free.size()) {
+    VkDeviceSize buddy = offset ^ (min_alloc_size << order);
+    auto it = block.free[order].find(buddy);
+    if (it == block.free[order].end())
+      break;
+    block.free[order].erase(it);
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  block.free[order].insert(offset);
+}
+
+void VulkanAllocator::free(MemoryAllocation &alloc)
+{
+  if (!alloc)
+    return;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto &c = _categories[size_t(alloc.category)];
+  c.allocations--;
+  c.bytes -= alloc.size;
+
+  if (alloc.pool < 0) {
+    auto it = std::find_if(_dedicated.begin(), _dedicated.end(), [&](auto &d) { return d.memory == alloc.memory; });
+    if (it != _dedicated.end())
+      _dedicated.erase(it);
+    vkFreeMemory(_device, alloc.memory, nullptr);
+  } else {
+    release(*_pools[alloc.pool], alloc.block, alloc.offset, alloc.order);
+  }
+  alloc = MemoryAllocation();
+}
+
+VkResult VulkanAllocator::flush(const MemoryAllocation &alloc, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (!alloc || host_coherent(alloc.type))
+    return VK_SUCCESS;
+  if (size == VK_WHOLE_SIZE)
+    size = alloc.size - offset;
+
+  VkMappedMemoryRange range = {};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = alloc.memory;
+  range.offset = align_down(alloc.offset + offset, _atom_size);
+  range.size = align_up(alloc.offset + offset + size, _atom_size) - range.offset;
+  if (alloc.pool < 0 && range.offset + range.size > alloc.size)
+    range.size = VK_WHOLE_SIZE;
+  return vkFlushMappedMemoryRanges(_device, 1, &range);
+}
+
+VkResult VulkanAllocator::invalidate(const MemoryAllocation &alloc, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (!alloc || host_coherent(alloc.type))
+    return VK_SUCCESS;
+  if (size == VK_WHOLE_SIZE)
+    size = alloc.size - offset;
+
+  VkMappedMemoryRange range = {};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = alloc.memory;
+  range.offset = align_down(alloc.offset + offset, _atom_size);
+  range.size = align_up(alloc.offset + offset + size, _atom_size) - range.offset;
+  if (alloc.pool < 0 && range.offset + range.size > alloc.size)
+    range.size = VK_WHOLE_SIZE;
+  return vkInvalidateMappedMemoryRanges(_device, 1, &range);
+}
+
+MemoryStats VulkanAllocator::stats() const
+{
+  MemoryStats total;
+  for (uint32_t i = 0; i < _props.memoryTypeCount; i++) {
+    auto s = stats(i);
+    total.blocks += s.blocks;
+    total.allocations += s.allocations;
+    total.dedicated += s.dedicated;
+    total.reserved += s.reserved;
+    total.used += s.used;
+    total.largest_free = std::max(total.largest_free, s.largest_free);
+  }
+  return total;
+}
+
+MemoryStats VulkanAllocator::stats(uint32_t type) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  MemoryStats s;
+  for (uint32_t p = type * 2; p < type * 2 + 2; p++) {
+    for (auto &block : _pools[p]->blocks) {
+      if (!block->memory)
+        continue;
+      s.blocks++;
+      s.allocations += block->count;
+      s.reserved += _block_size;
+      s.used += block->used;
+      for (size_t k = block->free.size(); k-- > 0;) {
+        if (!block->free[k].empty()) {
+          s.largest_free = std::max(s.largest_free, min_alloc_size << k);
+          break;
+        }
+      }
+    }
+  }
+  for (auto &d : _dedicated) {
+    if (d.type != type)
+      continue;
+    s.dedicated++;
+    s.allocations++;
+    s.reserved += d.size;
+    s.used += d.size;
+  }
+  return s;
+}
+
+CategoryStats VulkanAllocator::stats(MemoryCategory category) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _categories[size_t(category)];
+}
+
+std::vector<VkDeviceSize> VulkanAllocator::heap_reserved() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<VkDeviceSize> heaps(_props.memoryHeapCount, 0);
+  for (auto &pool : _pools) {
+    auto heap = _props.memoryTypes[pool->type].heapIndex;
+    for (auto &block : pool->blocks) {
+      if (block->memory)
+        heaps[heap] += _block_size;
+    }
+  }
+  for (auto &d : _dedicated)
+    heaps[_props.memoryTypes[d.type].heapIndex] += d.size;
+  return heaps;
+}
+
+float VulkanAllocator::fragmentation() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  VkDeviceSize total_free = 0, largest = 0;
+  for (auto &pool : _pools) {
+    for (auto &block : pool->blocks) {
+      if (!block->memory)
+        continue;
+      for (size_t k = 0; k < block->free.size(); k++) {
+        VkDeviceSize sz = min_alloc_size << k;
+        total_free += sz * block->free[k].size();
+        if (!block->free[k].empty())
+          largest = std::max(largest, sz);
+      }
+    }
+  }
+  return total_free ? 1.f - float(largest) / float(total_free) : 0.f;
+}
+
+void VulkanAllocator::release_empty_blocks()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto &pool : _pools) {
+    for (auto &block : pool->blocks) {
+      if (block->memory && block->count == 0) {
+        vkFreeMemory(_device, block->memory, nullptr);
+        *block = Block();
+      }
+    }
+  }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// what an allocation is used for, only feeds the telemetry
+enum class MemoryCategory : uint8_t {
+  Other,
+  Vertex,
+  Index,
+  Uniform,
+  Texture,
+  RenderTarget,
+  Staging,
+  Count
+};
+
+const char *category_name(MemoryCategory category);
+
+struct MemoryAllocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // persistently mapped pointer at offset, null for memory the host cannot see
+  uint8_t *mapped = nullptr;
+
+  uint32_t type = 0;
+  int32_t pool = -1;     // -1 for dedicated allocations
+  uint32_t block = 0;
+  uint32_t order = 0;
+  MemoryCategory category = MemoryCategory::Other;
+
+  explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+};
+
+struct MemoryStats {
+  uint32_t blocks = 0;
+  uint32_t allocations = 0;
+  uint32_t dedicated = 0;
+  VkDeviceSize reserved = 0;
+  VkDeviceSize used = 0;
+  VkDeviceSize largest_free = 0;
+};
+
+struct CategoryStats {
+  // live right now
+  uint32_t allocations = 0;
+  VkDeviceSize bytes = 0;
+  // everything handed out since the allocator was created
+  uint64_t total_allocations = 0;
+  VkDeviceSize total_bytes = 0;
+};
+
+// buddy sub-allocator over large VkDeviceMemory blocks, one pool per memory type and tiling.
+// linear (buffers) and optimal (images) resources never share a block, so bufferImageGranularity
+// needs no extra padding.
+class VulkanAllocator {
+public:
+  VulkanAllocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size = 64ull << 20);
+  ~VulkanAllocator();
+
+  // next is chained into VkMemoryAllocateInfo and forces a dedicated allocation (e.g. device address flags)
+  MemoryAllocation allocate(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags, bool linear,
+                            MemoryCategory category = MemoryCategory::Other, const void *next = nullptr);
+
+  void free(MemoryAllocation &alloc);
+
+  // flushes/invalidates a range of a non coherent allocation, aligned to nonCoherentAtomSize
+  VkResult flush(const MemoryAllocation &alloc, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+  VkResult invalidate(const MemoryAllocation &alloc, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+  MemoryStats stats() const;
+  MemoryStats stats(uint32_t type) const;
+  CategoryStats stats(MemoryCategory category) const;
+
+  // bytes reserved from each heap, blocks and dedicated allocations
+  std::vector<VkDeviceSize> heap_reserved() const;
+
+  // 0 for tightly packed pools, approaching 1 when the free space is scattered in small pieces
+  float fragmentation() const;
+
+  // blocks that hold no allocation are normally kept for reuse
+  void release_empty_blocks();
+
+  uint32_t memory_type_count() const { return _props.memoryTypeCount; }
+  const VkMemoryType &memory_type(uint32_t i) const { return _props.memoryTypes[i]; }
+  uint32_t memory_heap_count() const { return _props.memoryHeapCount; }
+  const VkMemoryHeap &memory_heap(uint32_t i) const { return _props.memoryHeaps[i]; }
+
+private:
+  struct Block;
+  struct Pool;
+
+  std::optional<uint32_t> find_type(uint32_t bits, VkMemoryPropertyFlags flags) const;
+  MemoryAllocation allocate_memory(const VkMemoryRequirements &reqs, VkMemoryPropertyFlags flags, bool linear, const void *next);
+  MemoryAllocation allocate_dedicated(VkDeviceSize size, uint32_t type, const void *next = nullptr);
+  bool allocate_from(Pool &pool, int32_t pool_index, VkDeviceSize size, MemoryAllocation &out);
+  void release(Pool &pool, uint32_t block, VkDeviceSize offset, uint32_t order);
+  bool host_coherent(uint32_t type) const;
+
+private:
+  VkDevice _device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties _props = {};
+  VkDeviceSize _block_size = 0;
+  VkDeviceSize _atom_size = 1;
+
+  std::vector<std::unique_ptr<Pool>> _pools;
+
+  struct Dedicated {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t type;
+  };
+  std::vector<Dedicated> _dedicated;
+
+  CategoryStats _categories[size_t(MemoryCategory::Count)];
+
+  mutable std::mutex _mutex;
+};
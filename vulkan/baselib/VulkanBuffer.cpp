@@ -13,14 +13,19 @@ VulkanBuffer::~VulkanBuffer()
 
 uint8_t* VulkanBuffer::map()
 {
+  // host visible allocations are persistently mapped by the allocator
+  if (_alloc.mapped)
+    return _alloc.mapped;
+
   uint8_t* entry = 0;
-  VK_CHECK_RESULT(vkMapMemory(*_device, _memory, 0, _size, 0, (void **)&entry));
+  VK_CHECK_RESULT(vkMapMemory(*_device, _alloc.memory, _alloc.offset, _size, 0, (void **)&entry));
   return entry;
 }
 
 void VulkanBuffer::unmap()
 {
-  vkUnmapMemory(*_device, _memory);
+  if (!_alloc.mapped)
+    vkUnmapMemory(*_device, _alloc.memory);
 }
 
 /**
@@ -36,13 +41,8 @@ void VulkanBuffer::unmap()
 VkResult VulkanBuffer::flush(VkDeviceSize size, VkDeviceSize offset)
 {
   if (size == VK_WHOLE_SIZE)
-    size = _size;
-  VkMappedMemoryRange mappedRange = {};
-  mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  mappedRange.memory = _memory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
-  return vkFlushMappedMemoryRanges(*_device, 1, &mappedRange);
+    size = _size - offset;
+  return _device->allocator()->flush(_alloc, offset, size);
 }
 
 /**
@@ -57,12 +57,9 @@ VkResult VulkanBuffer::flush(VkDeviceSize size, VkDeviceSize offset)
  */
 VkResult VulkanBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
 {
-  VkMappedMemoryRange mappedRange = {};
-  mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  mappedRange.memory = _memory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
-  return vkInvalidateMappedMemoryRanges(*_device, 1, &mappedRange);
+  if (size == VK_WHOLE_SIZE)
+    size = _size - offset;
+  return _device->allocator()->invalidate(_alloc, offset, size);
 }
 
 /**
@@ -70,12 +67,17 @@ VkResult VulkanBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
  */
 void VulkanBuffer::destroy()
 {
-  if (_buffer) {
-    vkDestroyBuffer(*_device, _buffer, nullptr);
-    _buffer = VK_NULL_HANDLE;
-  }
-  if (_memory) {
-    vkFreeMemory(*_device, _memory, nullptr);
-    _memory = VK_NULL_HANDLE;
-  }
+  if (!_buffer && !_alloc)
+    return;
+  // frames still in flight may read the buffer
+  VkDevice dev = *_device;
+  auto allocator = _device->allocator();
+  _device->retire([dev, allocator, buf = _buffer, alloc = _alloc]() mutable {
+    if (buf)
+      vkDestroyBuffer(dev, buf, nullptr);
+    if (alloc)
+      allocator->free(alloc);
+  });
+  _buffer = VK_NULL_HANDLE;
+  _alloc = MemoryAllocation();
 }
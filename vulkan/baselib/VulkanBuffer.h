@@ -3,6 +3,10 @@
 #include <vulkan/vulkan.h>
 #include <memory>
 
+#include "VulkanAllocator.h"
+
+class VulkanDevice;
+
 class VulkanBuffer : public std::enable_shared_from_this<VulkanBuffer>{
   friend class VulkanDevice;
 public:
@@ -11,7 +15,9 @@ public:
 
   operator VkBuffer() const { return _buffer; }
   operator VkBuffer*() { return &_buffer; }
-  VkDeviceMemory memory() { return _memory; }
+  VkDeviceMemory memory() { return _alloc.memory; }
+  // offset of the buffer inside memory(), buffers are sub-allocated
+  VkDeviceSize offset() { return _alloc.offset; }
   VkDeviceSize size() { return _size; }
   VkDeviceSize memsize() { return _memsize; }
 
@@ -27,7 +33,7 @@ private:
   std::shared_ptr<VulkanDevice> _device = nullptr;
 
   VkBuffer _buffer = VK_NULL_HANDLE;
-  VkDeviceMemory _memory = VK_NULL_HANDLE;
+  MemoryAllocation _alloc;
   VkDeviceSize _size = 0, _memsize = 0;
   VkDeviceSize _alignment = 0;
   VkBufferUsageFlags _usageFlags;
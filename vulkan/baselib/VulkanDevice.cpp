@@ -20,6 +20,10 @@
 #include "VulkanInitializers.hpp"
 
 #include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <unordered_set>
 #include <iostream>
 #include <stdexcept>
@@ -68,7 +72,13 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice _physical_device)
  */
 VulkanDevice::~VulkanDevice()
 {
+  if (_logical_device) {
+    vkDeviceWaitIdle(_logical_device);
+    flush_retired();
+  }
+
   if (_pipe_cache) {
+    save_pipecache();
     vkDestroyPipelineCache(_logical_device, _pipe_cache, nullptr);
     _pipe_cache = VK_NULL_HANDLE;
   }
@@ -78,11 +88,19 @@ VulkanDevice::~VulkanDevice()
     _command_pool = VK_NULL_HANDLE;
   }
 
-  if(_descriptor_pool) {
-    vkDestroyDescriptorPool(_logical_device, _descriptor_pool, nullptr);
-    _descriptor_pool = VK_NULL_HANDLE;
+  if (_transfer_pool) {
+    vkDestroyCommandPool(_logical_device, _transfer_pool, nullptr);
+    _transfer_pool = VK_NULL_HANDLE;
   }
 
+  _descriptors.reset();
+
+  _memory_telemetry.reset();
+  _shader_registry.reset();
+  _geometry_arena.reset();
+  _staging_ring.reset();
+  _allocator.reset();
+
   if (_logical_device) {
     vkDestroyDevice(_logical_device, nullptr);
     _logical_device = VK_NULL_HANDLE;
@@ -182,6 +200,11 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
     physicalDeviceFeatures2.pNext = pNextChain;
     deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.pNext = &physicalDeviceFeatures2;
+
+    for (auto next = (const VkBaseInStructure *)pNextChain; next; next = next->pNext) {
+      if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES)
+        _dynamic_rendering = ((const VkPhysicalDeviceVulkan13Features *)next)->dynamicRendering;
+    }
   }
 
 #if (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK)) && defined(VK_KHR_portability_subset)
@@ -193,6 +216,10 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
 
   deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
 
+  _memory_budget = extension_supported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (_memory_budget)
+    deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
   if (deviceExtensions.size() > 0) {
     for (const char *enabledExtension : deviceExtensions) {
       if (!extension_supported(enabledExtension)) {
@@ -211,8 +238,13 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
     return result;
   }
 
+  _allocator = std::make_unique<VulkanAllocator>(_physical_device, _logical_device);
+  _staging_ring = std::make_unique<StagingRing>(this, 32ull << 20);
+
   // Create a default command pool for graphics command buffers
   _command_pool = create_command_pool(_queue_family.graphics);
+  if (_queue_family.transfer != _queue_family.graphics)
+    _transfer_pool = create_command_pool(_queue_family.transfer);
 
   vkGetPhysicalDeviceProperties(_physical_device, &properties);
   vkGetPhysicalDeviceFeatures(_physical_device, &features);
@@ -224,6 +256,85 @@ VkResult VulkanDevice::realize(VkPhysicalDeviceFeatures enabledFeatures, std::ve
   return result;
 }
 
+GeometryArena *VulkanDevice::geometry_arena()
+{
+  if (!_geometry_arena)
+    _geometry_arena = std::make_unique<GeometryArena>(this);
+  return _geometry_arena.get();
+}
+
+ShaderRegistry *VulkanDevice::shaders()
+{
+  if (!_shader_registry)
+    _shader_registry = std::make_unique<ShaderRegistry>(this);
+  return _shader_registry.get();
+}
+
+uint64_t VulkanDevice::next_frame_serial()
+{
+  std::lock_guard<std::mutex> lock(_retire_mutex);
+  return ++_submitted_serial;
+}
+
+void VulkanDevice::frame_completed(uint64_t serial)
+{
+  std::vector<std::function<void()>> ready;
+  {
+    std::lock_guard<std::mutex> lock(_retire_mutex);
+    _completed_serial = std::max(_completed_serial, serial);
+    // serials are queued in order, the front is always the oldest
+    while (!_retired.empty() && _retired.front().serial <= _completed_serial) {
+      ready.push_back(std::move(_retired.front().destroy));
+      _retired.pop_front();
+    }
+  }
+  for (auto &destroy : ready)
+    destroy();
+}
+
+void VulkanDevice::retire(std::function<void()> destroy)
+{
+  {
+    std::lock_guard<std::mutex> lock(_retire_mutex);
+    if (_completed_serial < _submitted_serial) {
+      _retired.push_back({_submitted_serial, std::move(destroy)});
+      return;
+    }
+  }
+  destroy();
+}
+
+void VulkanDevice::retire_framebuffers(std::vector<VkFramebuffer> &frame_bufs)
+{
+  if (frame_bufs.empty())
+    return;
+  VkDevice dev = _logical_device;
+  retire([dev, bufs = std::move(frame_bufs)]() {
+    for (auto buf : bufs) {
+      if (buf)
+        vkDestroyFramebuffer(dev, buf, nullptr);
+    }
+  });
+  frame_bufs.clear();
+}
+
+void VulkanDevice::flush_retired()
+{
+  uint64_t serial;
+  {
+    std::lock_guard<std::mutex> lock(_retire_mutex);
+    serial = _submitted_serial;
+  }
+  frame_completed(serial);
+}
+
+MemoryTelemetry *VulkanDevice::memory_telemetry()
+{
+  if (!_memory_telemetry)
+    _memory_telemetry = std::make_unique<MemoryTelemetry>(this);
+  return _memory_telemetry.get();
+}
+
 VkRenderPass VulkanDevice::create_render_pass(VkFormat color, VkFormat depth)
 {
   std::array<VkAttachmentDescription, 2> attachments = {};
@@ -310,31 +421,33 @@ void VulkanDevice::destroy_render_pass(VkRenderPass rdpass)
   vkDestroyRenderPass(_logical_device, rdpass, nullptr);
 }
 
-std::tuple<VkImage, VkDeviceMemory> 
-VulkanDevice::create_image(int w, int h, VkFormat format)
+std::tuple<VkImage, MemoryAllocation> 
+VulkanDevice::create_image(int w, int h, VkFormat format, uint32_t levels, MemoryCategory category)
 {
   VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
   imageInfo.format = format;
   imageInfo.extent.width = w;
   imageInfo.extent.height = h; 
+  imageInfo.mipLevels = levels;
+  // mip levels are blitted from their parent level
+  if (levels > 1)
+    imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
   VkImage img = VK_NULL_HANDLE;
   VK_CHECK_RESULT(vkCreateImage(_logical_device, &imageInfo, nullptr, &img));
   VkMemoryRequirements memReqs;
   vkGetImageMemoryRequirements(_logical_device, img, &memReqs);
 
-  VkDeviceMemory mem;
-  VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-  memAllocInfo.allocationSize = memReqs.size;
-  memAllocInfo.memoryTypeIndex = *memory_type_index(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAllocInfo, nullptr, &mem));
-  VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, mem, 0));
+  auto mem = _allocator->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, category);
+  if (!mem)
+    throw std::runtime_error("No proper memory type!");
+  VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, mem.memory, mem.offset));
 
   return std::make_tuple(img, mem);
 }
 
-VkImageView VulkanDevice::create_image_view(VkImage img, VkFormat format)
+VkImageView VulkanDevice::create_image_view(VkImage img, VkFormat format, uint32_t levels)
 {
   VkImageViewCreateInfo colorAttachmentView = {};
   colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -343,7 +456,7 @@ VkImageView VulkanDevice::create_image_view(VkImage img, VkFormat format)
   colorAttachmentView.components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
   colorAttachmentView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   colorAttachmentView.subresourceRange.baseMipLevel = 0;
-  colorAttachmentView.subresourceRange.levelCount = 1;
+  colorAttachmentView.subresourceRange.levelCount = levels;
   colorAttachmentView.subresourceRange.baseArrayLayer = 0;
   colorAttachmentView.subresourceRange.layerCount = 1;
   colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -357,7 +470,7 @@ VkImageView VulkanDevice::create_image_view(VkImage img, VkFormat format)
 
 std::shared_ptr<VulkanImage> VulkanDevice::create_color_image(uint32_t width, uint32_t height, VkFormat format)
 {
-  auto [img, imgmem] = create_image(width, height, format);
+  auto [img, imgmem] = create_image(width, height, format, 1, MemoryCategory::RenderTarget);
   auto imgview = create_image_view(img, format);
 
   auto vkimg = std::make_shared<VulkanImage>(shared_from_this());
@@ -372,7 +485,6 @@ std::shared_ptr<VulkanImage> VulkanDevice::create_color_image(uint32_t width, ui
 std::shared_ptr<VulkanImage> VulkanDevice::create_depth_image(uint32_t width, uint32_t height, VkFormat format)
 {
   VkImage img = VK_NULL_HANDLE;
-  VkDeviceMemory imgmem = VK_NULL_HANDLE;
   // Create an optimal image used as the depth stencil attachment
   VkImageCreateInfo image = {};
   image.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -388,17 +500,12 @@ std::shared_ptr<VulkanImage> VulkanDevice::create_depth_image(uint32_t width, ui
   VK_CHECK_RESULT(vkCreateImage(_logical_device, &image, nullptr, &img));
 
   // Allocate memory for the image (device local) and bind it to our image
-  VkMemoryAllocateInfo memAlloc = {};
-  memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   VkMemoryRequirements memReqs;
   vkGetImageMemoryRequirements(_logical_device, img, &memReqs);
-  memAlloc.allocationSize = memReqs.size;
-  auto memIndex = memory_type_index(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  if (!memIndex)
+  auto imgmem = _allocator->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::RenderTarget);
+  if (!imgmem)
     throw std::runtime_error("No proper memory type!");
-  memAlloc.memoryTypeIndex = *memIndex;
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAlloc, nullptr, &imgmem));
-  VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, imgmem, 0));
+  VK_CHECK_RESULT(vkBindImageMemory(_logical_device, img, imgmem.memory, imgmem.offset));
 
   // Create a view for the depth stencil image
   // Images aren't directly accessed in Vulkan, but rather through views described by a subresource range
@@ -447,40 +554,104 @@ VkShaderModule VulkanDevice::create_shader(const char *shader_source, int n)
   return shader_module;
 }
 
+namespace {
+// written in front of the driver's blob, the driver version is not part of the vulkan header
+struct PipeCacheFile {
+  uint32_t magic;
+  uint32_t driver_version;
+  uint64_t size;
+};
+constexpr uint32_t pipe_cache_magic = 0x43504c56;  // VLPC
+}
+
+std::vector<uint8_t> VulkanDevice::load_pipecache()
+{
+  std::ifstream is(_pipe_cache_file, std::ios::binary);
+  if (!is.is_open())
+    return {};
+
+  PipeCacheFile file = {};
+  if (!is.read((char *)&file, sizeof(file)) || file.magic != pipe_cache_magic || file.driver_version != properties.driverVersion)
+    return {};
+
+  std::vector<uint8_t> data(file.size);
+  if (file.size < sizeof(VkPipelineCacheHeaderVersionOne) || !is.read((char *)data.data(), data.size()))
+    return {};
+
+  // a blob from another gpu or driver build is rejected here instead of trusting the driver to
+  VkPipelineCacheHeaderVersionOne header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.headerSize < sizeof(header) || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    return {};
+
+  return data;
+}
+
+void VulkanDevice::save_pipecache()
+{
+  if (_pipe_cache_file.empty())
+    return;
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(_logical_device, _pipe_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    return;
+  std::vector<uint8_t> data(size);
+  if (vkGetPipelineCacheData(_logical_device, _pipe_cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  // write next to the old file and swap, a crash mid write leaves the previous cache intact
+  std::string tmp = _pipe_cache_file + ".tmp";
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    PipeCacheFile file = {pipe_cache_magic, properties.driverVersion, size};
+    os.write((const char *)&file, sizeof(file));
+    os.write((const char *)data.data(), size);
+    if (!os)
+      return;
+  }
+  std::remove(_pipe_cache_file.c_str());
+  std::rename(tmp.c_str(), _pipe_cache_file.c_str());
+
+  printf("pipelines: %u created in %.2f ms from a %s cache\n", _pipeline_count, _pipeline_ms, _pipe_cache_warm ? "warm" : "cold");
+}
+
 VkPipelineCache VulkanDevice::get_or_create_pipecache()
 {
   if (!_pipe_cache) {
+    auto data = load_pipecache();
+    _pipe_cache_warm = !data.empty();
+
     VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
     pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = data.size();
+    pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
     VK_CHECK_RESULT(vkCreatePipelineCache(_logical_device, &pipelineCacheCreateInfo, nullptr, &_pipe_cache));
   }
   return _pipe_cache;
 }
 
-VkDescriptorPool VulkanDevice::get_or_create_descriptor_pool()
-{
-  if (!_descriptor_pool) {
-    VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}};
-    uint32_t sz = sizeof(pool_sizes) / sizeof(VkDescriptorPoolSize);
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    pool_info.maxSets = 1000 * sz;
-    pool_info.poolSizeCount = sz;
-    pool_info.pPoolSizes = pool_sizes;
-    VK_CHECK_RESULT(vkCreateDescriptorPool(_logical_device, &pool_info, nullptr, &_descriptor_pool));
-  }
-  return _descriptor_pool;
+VkPipeline VulkanDevice::create_graphics_pipeline(const VkGraphicsPipelineCreateInfo &info, const char *name)
+{
+  auto cache = get_or_create_pipecache();
+
+  auto t0 = std::chrono::steady_clock::now();
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateGraphicsPipelines(_logical_device, cache, 1, &info, nullptr, &pipeline));
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+  _pipeline_count++;
+  _pipeline_ms += ms;
+  printf("%s pipeline: %.2f ms (%s cache)\n", name, ms, _pipe_cache_warm ? "warm" : "cold");
+  return pipeline;
+}
+
+DescriptorAllocator *VulkanDevice::descriptors()
+{
+  if (!_descriptors)
+    _descriptors = std::make_unique<DescriptorAllocator>(this, true);
+  return _descriptors.get();
 }
 
 /**
@@ -559,7 +730,7 @@ std::optional<uint32_t> VulkanDevice::memory_type_index(uint32_t typeBits, VkMem
  * @param size Size of the buffer in byes
  * @param buffer Pointer to the buffer handle acquired by the function
  * @param memory Pointer to the memory handle acquired by the function
- * @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
+ * @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over). Memory the host cannot map is filled through a staging copy
  *
  * @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
  */
@@ -568,50 +739,55 @@ std::shared_ptr<VulkanBuffer> VulkanDevice::create_buffer(VkBufferUsageFlags usa
 {
   auto buffer = std::make_shared<VulkanBuffer>(shared_from_this());
 
+  // initial data for memory the host may not see is copied in from a staging buffer
+  if (data && !(memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    usageFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
   VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
   bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   VK_CHECK_RESULT(vkCreateBuffer(_logical_device, &bufferCreateInfo, nullptr, &buffer->_buffer));
   buffer->_size = size;
 
   VkMemoryRequirements memReqs;
-  VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
   vkGetBufferMemoryRequirements(_logical_device, *buffer, &memReqs);
-  memAlloc.allocationSize = memReqs.size;
-
-  auto index = memory_type_index(memReqs.memoryTypeBits, memoryPropertyFlags);
-  if (!index) return nullptr;
 
-  memAlloc.memoryTypeIndex = *index;
   VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+  const void *next = nullptr;
   if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
     allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
     allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-    memAlloc.pNext = &allocFlagsInfo;
+    next = &allocFlagsInfo;
   }
 
-  VkDeviceMemory memory;
-  VK_CHECK_RESULT(vkAllocateMemory(_logical_device, &memAlloc, nullptr, &memory));
-  buffer->_memory = memory;
+  // tagged by the first usage that says what the buffer is for
+  MemoryCategory category = MemoryCategory::Other;
+  if (usageFlags & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+    category = MemoryCategory::Vertex;
+  else if (usageFlags & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+    category = MemoryCategory::Index;
+  else if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    category = MemoryCategory::Uniform;
+  else if (usageFlags & VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+    category = MemoryCategory::Staging;
+
+  buffer->_alloc = _allocator->allocate(memReqs, memoryPropertyFlags, true, category, next);
+  if (!buffer->_alloc) return nullptr;
+
+  VK_CHECK_RESULT(vkBindBufferMemory(_logical_device, buffer->_buffer, buffer->_alloc.memory, buffer->_alloc.offset));
+  buffer->_memsize = memReqs.size;
 
-  if (data != nullptr) {
-    void *mapped = nullptr;
-    VkDeviceSize sz = memReqs.size; 
-    VK_CHECK_RESULT(vkMapMemory(_logical_device, memory, 0, sz, 0, &mapped));
-    memcpy(mapped, data, size);
+  if (data != nullptr && buffer->_alloc.mapped) {
+    // host visible memory stays mapped for the lifetime of the allocation
+    memcpy(buffer->_alloc.mapped, data, size);
     // If host coherency hasn't been requested, do a manual flush to make writes visible
-    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-      VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-      mappedRange.memory = memory;
-      mappedRange.offset = 0;
-      mappedRange.size = sz;
-      vkFlushMappedMemoryRanges(_logical_device, 1, &mappedRange);
-    }
-    vkUnmapMemory(_logical_device, memory);
+    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+      _allocator->flush(buffer->_alloc, 0, size);
+  } else if (data != nullptr) {
+    auto staging = create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, data);
+    if (!staging) return nullptr;
+    copy_buffer(staging.get(), buffer.get(), graphic_queue());
   }
 
-  VK_CHECK_RESULT(vkBindBufferMemory(_logical_device, buffer->_buffer, memory, 0));
-  buffer->_memsize = memReqs.size;
-
   return buffer;
 }
 
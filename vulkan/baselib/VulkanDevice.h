@@ -12,11 +12,20 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDef.h"
+#include "VulkanAllocator.h"
+#include "StagingRing.h"
+#include "GeometryArena.h"
+#include "ShaderRegistry.h"
+#include "DescriptorAllocator.h"
+#include "MemoryTelemetry.h"
 
 #include <vector>
 #include <string>
 #include <assert.h>
+#include <deque>
 #include <exception>
+#include <functional>
+#include <mutex>
 #include <optional>
 #include <memory>
 
@@ -31,6 +40,14 @@ public:
   operator VkDevice() const { return _logical_device; };
   VkPhysicalDevice physical_device() { return _physical_device; }
   VkCommandPool command_pool() { return _command_pool; }
+  // pool for command buffers submitted to transfer_queue(), the default pool when there is no transfer family
+  VkCommandPool transfer_command_pool() { return _transfer_pool ? _transfer_pool : _command_pool; }
+  VulkanAllocator *allocator() { return _allocator.get(); }
+  StagingRing *staging_ring() { return _staging_ring.get(); }
+  // created on first use, demos without meshes never pay for the pages
+  GeometryArena *geometry_arena();
+  ShaderRegistry *shaders();
+  MemoryTelemetry *memory_telemetry();
 
   VkResult realize(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char *> enabledExtensions, void *pNextChain,
                                bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
@@ -38,8 +55,9 @@ public:
   VkRenderPass create_render_pass(VkFormat color, VkFormat depth = VK_FORMAT_D24_UNORM_S8_UINT);
   void destroy_render_pass(VkRenderPass rdpass);
   
-  std::tuple<VkImage, VkDeviceMemory> create_image(int w, int h, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
-  VkImageView create_image_view(VkImage img, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+  std::tuple<VkImage, MemoryAllocation> create_image(int w, int h, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t levels = 1,
+                                                     MemoryCategory category = MemoryCategory::Texture);
+  VkImageView create_image_view(VkImage img, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t levels = 1);
 
   std::shared_ptr<VulkanImage> create_color_image(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
   std::shared_ptr<VulkanImage> create_depth_image(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_D24_UNORM_S8_UINT);
@@ -48,9 +66,28 @@ public:
 
   VkShaderModule create_shader(const char *source, int n);
 
+  // the cache is seeded from pipecache_file() when its header matches this device and driver,
+  // and written back when the device goes away
   VkPipelineCache get_or_create_pipecache();
-
-  VkDescriptorPool get_or_create_descriptor_pool();
+  void set_pipecache_file(const std::string &file) { _pipe_cache_file = file; }
+  const std::string &pipecache_file() const { return _pipe_cache_file; }
+
+  // vkCreateGraphicsPipelines on the shared cache, the time spent is logged under name
+  VkPipeline create_graphics_pipeline(const VkGraphicsPipelineCreateInfo &info, const char *name);
+
+  // long lived descriptor sets, grows by adding pools
+  DescriptorAllocator *descriptors();
+
+  // every queue submit that may use resources takes the next serial, the view reports it back
+  // once the submit's fence has signalled. retire() runs its destroy function after every frame
+  // submitted so far has finished, straight away when nothing is in flight.
+  uint64_t next_frame_serial();
+  void frame_completed(uint64_t serial);
+  void retire(std::function<void()> destroy);
+  // destroys the framebuffers once they are out of use and clears the vector
+  void retire_framebuffers(std::vector<VkFramebuffer> &frame_bufs);
+  // runs everything still queued, the device must be idle
+  void flush_retired();
 
   uint32_t queue_family_index(VkQueueFlags queueFlags) const;
 
@@ -74,12 +111,26 @@ public:
   VkQueue graphic_queue(uint32_t idx = 0);
   VkQueue transfer_queue(uint32_t idx = 0);
 
+  uint32_t graphics_family() const { return _queue_family.graphics; }
+  uint32_t transfer_family() const { return _queue_family.transfer; }
+
   bool extension_supported(std::string extension);
+  // VK_EXT_memory_budget is enabled whenever the device has it
+  bool memory_budget_supported() const { return _memory_budget; }
+
+  // dynamicRendering of VkPhysicalDeviceVulkan13Features was in the chain given to realize
+  bool dynamic_rendering() const { return _dynamic_rendering; }
   VkFormat supported_depth_format(bool checkSamplingSupport);
 
+private:
+  std::vector<uint8_t> load_pipecache();
+  void save_pipecache();
+
 public:
 
   const std::vector<VkQueueFamilyProperties> &queue_family_properties() { return _queue_family_properties; }
+  const VkPhysicalDeviceFeatures &enabled_features() const { return enabledFeatures; }
+  const VkPhysicalDeviceProperties &device_properties() const { return properties; }
 
 public:
 
@@ -104,6 +155,7 @@ private:
   std::vector<std::string> supportedExtensions;
   /** @brief Default command pool for the graphics queue family index */
   VkCommandPool _command_pool = VK_NULL_HANDLE;
+  VkCommandPool _transfer_pool = VK_NULL_HANDLE;
   /** @brief Contains queue family indices */
   struct {
     uint32_t graphics;
@@ -111,6 +163,27 @@ private:
     uint32_t transfer;
   } _queue_family;
 
+  std::unique_ptr<VulkanAllocator> _allocator;
+  std::unique_ptr<StagingRing> _staging_ring;
+  std::unique_ptr<GeometryArena> _geometry_arena;
+  std::unique_ptr<ShaderRegistry> _shader_registry;
+  std::unique_ptr<MemoryTelemetry> _memory_telemetry;
+  bool _memory_budget = false;
+  bool _dynamic_rendering = false;
+
   VkPipelineCache _pipe_cache = VK_NULL_HANDLE;
-  VkDescriptorPool _descriptor_pool = VK_NULL_HANDLE;
+  std::string _pipe_cache_file = "pipeline.cache";
+  bool _pipe_cache_warm = false;
+  uint32_t _pipeline_count = 0;
+  double _pipeline_ms = 0;
+  std::unique_ptr<DescriptorAllocator> _descriptors;
+
+  struct Retired {
+    uint64_t serial;
+    std::function<void()> destroy;
+  };
+  std::mutex _retire_mutex;
+  std::deque<Retired> _retired;
+  uint64_t _submitted_serial = 0;
+  uint64_t _completed_serial = 0;
 };
@@ -3,6 +3,7 @@
 #include "VulkanView.h"
 #include "VulkanDevice.h"
 #include "VulkanBuffer.h"
+#include "GpuProfiler.h"
 #include "VulkanTools.h"
 #include "VulkanInitializers.hpp"
 #include "VulkanSwapChain.h"
@@ -85,7 +86,7 @@ VulkanImGUI::~VulkanImGUI()
   if (_font_img)
     vkDestroyImage(*device, _font_img, nullptr);
   if (_font_memory)
-    vkFreeMemory(*device, _font_memory, nullptr);
+    device->allocator()->free(_font_memory);
 }
 
 void VulkanImGUI::resize(int w, int h)
@@ -146,8 +147,6 @@ void VulkanImGUI::create_pipeline(VkFormat clrformat)
   //-----------------------------------------------------------------------------------------------------------
 
   // Push constants for UI rendering parameters
-  VkPipelineCache pipe_cache = device->get_or_create_pipecache();
-
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
       vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 
@@ -229,7 +228,7 @@ void VulkanImGUI::create_pipeline(VkFormat clrformat)
 
   pipelineCreateInfo.pVertexInputState = &vertexInputState;
 
-  VK_CHECK_RESULT(vkCreateGraphicsPipelines(*device, pipe_cache, 1, &pipelineCreateInfo, nullptr, &_pipeline));
+  _pipeline = device->create_graphics_pipeline(pipelineCreateInfo, "imgui");
 
   vkDestroyShaderModule(*device, shaderStages[0].module, nullptr);
   vkDestroyShaderModule(*device, shaderStages[1].module, nullptr);
@@ -239,20 +238,14 @@ void VulkanImGUI::check_frame(int count, VkFormat clrformat)
 {
   auto device = _view->device();
 
-  for (auto& framebuf : _frame_bufs)
-    vkDestroyFramebuffer(*device, framebuf, nullptr);
-
-  _frame_bufs = _view->swapchain()->create_frame_buffer(_render_pass, VK_NULL_HANDLE);
-  if (count != _cmd_bufs.size())
-    _cmd_bufs = _view->device()->create_command_buffers(count);
-
-  build_command_buffers();
+  // the old ones may still be in use by frames in flight, new ones are made when an image is first drawn
+  device->retire_framebuffers(_frame_bufs);
+  _frame_bufs.assign(count, VK_NULL_HANDLE);
 }
 
-bool VulkanImGUI::update_frame()
+bool VulkanImGUI::upload(uint32_t frame)
 {
   ImDrawData* imDrawData = ImGui::GetDrawData();
-  bool updateCmdBuffers = false;
 
   if (!imDrawData) {
     return false;
@@ -269,40 +262,37 @@ bool VulkanImGUI::update_frame()
 
   auto device = _view->device();
 
-  auto vbuf = _vert_buf, ibuf = _index_buf;
-  if (_vert_buf == 0 || _vert_buf->size() < vertex_buf_size) {
-    _vert_buf_bak = device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertex_buf_size, 0);
-    vbuf = _vert_buf_bak;
-    updateCmdBuffers = true;
-  }
+  if (_geometry.size() <= frame)
+    _geometry.resize(frame + 1);
+  auto& geo = _geometry[frame];
 
-  if (_index_buf == 0 || _index_buf->size() < index_buf_size) {
-    _index_buf_bak = device->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_buf_size, 0);
-    ibuf = _index_buf_bak;
-    updateCmdBuffers = true;
-  }
+  // the old buffers go through the device's retire queue, a frame still in flight may read them
+  if (geo.vert == 0 || geo.vert->size() < vertex_buf_size)
+    geo.vert = device->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertex_buf_size, 0);
+  if (geo.index == 0 || geo.index->size() < index_buf_size)
+    geo.index = device->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, index_buf_size, 0);
 
-  uint8_t* vtxDst = vbuf->map();
-  uint8_t* idxDst = ibuf->map();
+  uint8_t* vtxDst = geo.vert->map();
+  uint8_t* idxDst = geo.index->map();
   for (int n = 0; n < imDrawData->CmdListsCount; n++) {
     const ImDrawList* cmd_list = imDrawData->CmdLists[n];
     memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
     memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-    vtxDst += cmd_list->VtxBuffer.Size;
-    idxDst += cmd_list->IdxBuffer.Size;
+    vtxDst += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+    idxDst += cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
   }
-  vbuf->flush();
-  ibuf->flush();
-  vbuf->unmap();
-  ibuf->unmap();
+  geo.vert->flush();
+  geo.index->flush();
+  geo.vert->unmap();
+  geo.index->unmap();
 
-  return updateCmdBuffers || _force_update;
+  return true;
 }
 
-void VulkanImGUI::draw(const VkCommandBuffer cmdbuf)
+void VulkanImGUI::draw(const VkCommandBuffer cmdbuf, uint32_t frame)
 {
   ImDrawData* imdata = ImGui::GetDrawData();
-  if (!imdata || imdata->CmdListsCount == 0)
+  if (!imdata || imdata->CmdListsCount == 0 || _geometry.size() <= frame || !_geometry[frame].vert)
     return;
 
   _force_update = false;
@@ -316,14 +306,10 @@ void VulkanImGUI::draw(const VkCommandBuffer cmdbuf)
 
   vkCmdPushConstants(cmdbuf, _pipe_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &const_block);
 
-  if (_vert_buf_bak)
-    _vert_buf = std::move(_vert_buf_bak);
-  if (_index_buf_bak)
-    _index_buf = std::move(_index_buf_bak);
-
+  auto& geo = _geometry[frame];
   VkDeviceSize offsets[1] = {};
-  vkCmdBindVertexBuffers(cmdbuf, 0, 1, *_vert_buf, offsets);
-  vkCmdBindIndexBuffer(cmdbuf, *_index_buf, 0, VK_INDEX_TYPE_UINT16);
+  vkCmdBindVertexBuffers(cmdbuf, 0, 1, *geo.vert, offsets);
+  vkCmdBindIndexBuffer(cmdbuf, *geo.index, 0, VK_INDEX_TYPE_UINT16);
 
   uint32_t indexOffset = 0, vertexOffset = 0;
   for (int32_t i = 0; i < imdata->CmdListsCount; i++) {
@@ -432,22 +418,19 @@ void VulkanImGUI::create_renderpass(VkFormat color)
   _render_pass = renderPass;
 }
 
-void VulkanImGUI::build_command_buffers()
+void VulkanImGUI::record(VkCommandBuffer cmd_buf, uint32_t image, uint32_t frame)
 {
-  auto& framebuffers = _frame_bufs;
-  auto& renderPass = _render_pass;
-  auto device = _view->device();
-
-  assert(framebuffers.size() == _cmd_bufs.size());
+  if (!upload(frame))
+    return;
 
-  VkCommandBufferBeginInfo buf_info = {};
-  buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  buf_info.pNext = nullptr;
+  if (!_frame_bufs[image])
+    _frame_bufs[image] = _view->swapchain()->create_frame_buffer(_render_pass, image, VK_NULL_HANDLE);
 
   VkRenderPassBeginInfo renderPassBeginInfo = {};
   renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassBeginInfo.pNext = nullptr;
-  renderPassBeginInfo.renderPass = renderPass;
+  renderPassBeginInfo.renderPass = _render_pass;
+  renderPassBeginInfo.framebuffer = _frame_bufs[image];
   renderPassBeginInfo.renderArea.offset.x = 0;
   renderPassBeginInfo.renderArea.offset.y = 0;
   renderPassBeginInfo.renderArea.extent.width = _view->width();
@@ -455,36 +438,31 @@ void VulkanImGUI::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 0;
   renderPassBeginInfo.pClearValues = nullptr;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    auto& cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    {
-      VkViewport viewport = {};
-      viewport.y = _view->height();
-      viewport.width = _view->width();
-      viewport.height = -_view->height();
-      viewport.minDepth = 0;
-      viewport.maxDepth = 1;
-      vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-    }
-
-    {
-      VkRect2D scissor = {};
-      scissor.extent.width = _view->width();
-      scissor.extent.height = _view->height();
-      scissor.offset.x = 0;
-      scissor.offset.y = 0;
-      vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-    }
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    draw(cmd_buf);
+  {
+    VkViewport viewport = {};
+    viewport.y = _view->height();
+    viewport.width = _view->width();
+    viewport.height = -_view->height();
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+  }
 
-    vkCmdEndRenderPass(cmd_buf);
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _view->width();
+    scissor.extent.height = _view->height();
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+  }
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
+  {
+    GpuScope scope(_view->profiler(), cmd_buf, "imgui");
+    draw(cmd_buf, frame);
   }
+
+  vkCmdEndRenderPass(cmd_buf);
 }
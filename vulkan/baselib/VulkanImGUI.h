@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.h>
 #include <SDL2/SDL_events.h>
+#include "VulkanAllocator.h"
 
 #include <memory>
 #include <vector>
@@ -21,9 +22,11 @@ public:
 
   void check_frame(int n, VkFormat clrformat);
 
-  bool update_frame();
+  // uploads the current draw data into the frame's buffers and records the overlay pass
+  // into cmd, after the view's own passes
+  void record(VkCommandBuffer cmd, uint32_t image, uint32_t frame);
 
-  void draw(const VkCommandBuffer cmdbuf);
+  void draw(const VkCommandBuffer cmdbuf, uint32_t frame);
 
   bool mouse_down(SDL_MouseButtonEvent &ev);
 
@@ -38,7 +41,8 @@ private:
 
   void create_renderpass(VkFormat color);
 
-  void build_command_buffers();
+  // false when there is nothing to draw
+  bool upload(uint32_t frame);
 
 private:
   bool _initialized = false;
@@ -48,7 +52,6 @@ private:
   VkRenderPass _render_pass = VK_NULL_HANDLE;
 
   std::vector<VkFramebuffer> _frame_bufs;
-  std::vector<VkCommandBuffer> _cmd_bufs;
 
   VkSampler _sampler = VK_NULL_HANDLE;
   VkDescriptorPool _descriptor_pool = VK_NULL_HANDLE;
@@ -58,10 +61,14 @@ private:
   VkPipelineLayout _pipe_layout = VK_NULL_HANDLE;
   VkPipeline _pipeline = VK_NULL_HANDLE;
 
-  std::shared_ptr<VulkanBuffer> _vert_buf, _vert_buf_bak;
-  std::shared_ptr<VulkanBuffer> _index_buf, _index_buf_bak;
+  // one pair per frame in flight, the gpu may still read the other frames' geometry
+  struct Geometry {
+    std::shared_ptr<VulkanBuffer> vert;
+    std::shared_ptr<VulkanBuffer> index;
+  };
+  std::vector<Geometry> _geometry;
 
   VkImage _font_img;
-  VkDeviceMemory _font_memory;
+  MemoryAllocation _font_memory;
   VkImageView _font_view;
 };
\ No newline at end of file
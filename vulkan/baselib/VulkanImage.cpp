@@ -7,22 +7,19 @@ VulkanImage::VulkanImage(std::shared_ptr<VulkanDevice> &dev) : _device(dev)
 
 VulkanImage::~VulkanImage()
 {
-  if (_image_view) {
-    vkDestroyImageView(*_device, _image_view, nullptr);
-    _image_view = VK_NULL_HANDLE;
-  }
-  if (_image) {
-    vkDestroyImage(*_device, _image, nullptr);
-    _image = VK_NULL_HANDLE;
-  }
-  if (_image_mem) {
-    vkFreeMemory(*_device, _image_mem, nullptr);
-    _image_mem = VK_NULL_HANDLE;
-  }
-
+  VkDevice dev = *_device;
+  auto allocator = _device->allocator();
+  _device->retire([dev, allocator, img = _image, view = _image_view, mem = _image_mem]() mutable {
+    if (view)
+      vkDestroyImageView(dev, view, nullptr);
+    if (img)
+      vkDestroyImage(dev, img, nullptr);
+    if (mem)
+      allocator->free(mem);
+  });
 }
 
-void VulkanImage::setImage(int w, int h, VkFormat format, VkDeviceMemory imgmem, VkImage img, VkImageView imgview)
+void VulkanImage::setImage(int w, int h, VkFormat format, const MemoryAllocation &imgmem, VkImage img, VkImageView imgview)
 {
   _w = w;
   _h = h;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vulkan/vulkan_core.h>
+#include "VulkanAllocator.h"
 #include <memory>
 
 class VulkanDevice;
@@ -18,10 +19,10 @@ public:
 
   const VkImage& image() const { return _image; }
   const VkImageView& image_view() const { return _image_view; }
-  const VkDeviceMemory& image_mem() const { return _image_mem; }
+  VkDeviceMemory image_mem() const { return _image_mem.memory; }
   const VkFormat& format() const { return _format; }
 
-  void setImage(int w, int h, VkFormat format, VkDeviceMemory mem, VkImage img = VK_NULL_HANDLE, VkImageView imgview = VK_NULL_HANDLE);
+  void setImage(int w, int h, VkFormat format, const MemoryAllocation &mem, VkImage img = VK_NULL_HANDLE, VkImageView imgview = VK_NULL_HANDLE);
 
 private:
   std::shared_ptr<VulkanDevice> _device;
@@ -29,7 +30,7 @@ private:
 
   VkImage _image = VK_NULL_HANDLE;
   VkImageView _image_view = VK_NULL_HANDLE;
-  VkDeviceMemory _image_mem = VK_NULL_HANDLE;
+  MemoryAllocation _image_mem;
 
   VkFormat _format = VK_FORMAT_UNDEFINED;
 };
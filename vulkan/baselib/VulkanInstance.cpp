@@ -2,6 +2,7 @@
 
 #include <Windows.h>
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -68,10 +69,37 @@ VulkanInstance::create_device(const std::string &devStr)
 
   auto &phyDev = physicalDevices[selectedDevice];
 
+  VkPhysicalDeviceFeatures supported = {};
+  vkGetPhysicalDeviceFeatures(phyDev, &supported);
+
   VkPhysicalDeviceFeatures features = {};
+  features.textureCompressionBC = supported.textureCompressionBC;
   std::vector<const char *> extension;
+
+  // upload batches hand off between the transfer and graphics queues with timeline semaphores
+  VkPhysicalDeviceVulkan12Features features12 = {};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  features12.timelineSemaphore = VK_TRUE;
+
+  // passes may begin with vkCmdBeginRendering instead of render pass and framebuffer objects
+  VkPhysicalDeviceVulkan13Features supported13 = {};
+  supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  VkPhysicalDeviceFeatures2 supported2 = {};
+  supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supported2.pNext = &supported13;
+  VkPhysicalDeviceProperties phyProps;
+  vkGetPhysicalDeviceProperties(phyDev, &phyProps);
+  if (phyProps.apiVersion >= VK_API_VERSION_1_3)
+    vkGetPhysicalDeviceFeatures2(phyDev, &supported2);
+
+  VkPhysicalDeviceVulkan13Features features13 = {};
+  features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  features13.dynamicRendering = supported13.dynamicRendering;
+  if (features13.dynamicRendering)
+    features12.pNext = &features13;
+
   auto dev = std::make_shared<VulkanDevice>(phyDev);
-  dev->realize(features, extension, nullptr);
+  dev->realize(features, extension, &features12, true, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
   return dev;
 }
 
@@ -109,6 +137,11 @@ void VulkanInstance::initialize()
   instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   //instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
+  // a headless driver may offer no surface extensions, offscreen views do not need them
+  instanceExtensions.erase(std::remove_if(instanceExtensions.begin(), instanceExtensions.end(), [&](const char *ext) {
+    return std::find(supportedExt.begin(), supportedExt.end(), ext) == supportedExt.end();
+  }), instanceExtensions.end());
+
   if (instanceExtensions.size() > 0) {
     instanceCreateInfo.enabledExtensionCount = instanceExtensions.size();
     instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
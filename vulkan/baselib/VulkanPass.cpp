@@ -2,6 +2,7 @@
 #include "VulkanTools.h"
 
 #include <array>
+#include <stdexcept>
 
 VulkanPass::VulkanPass(const std::shared_ptr<VulkanDevice>& dev) : _device(dev)
 {
@@ -17,17 +18,47 @@ VulkanPass::~VulkanPass()
 
 VulkanPass::operator VkRenderPass()
 {
-  if (!_render_pass) {
+  if (!_render_pass && !_dynamic) {
     initialize();
   }
 
   return _render_pass;
 }
 
+void VulkanPass::set_dynamic(bool dynamic)
+{
+  if (dynamic && !_device->dynamic_rendering())
+    throw std::runtime_error("Dynamic rendering is not supported!");
+  _dynamic = dynamic;
+}
+
+void VulkanPass::attach(VkGraphicsPipelineCreateInfo &info, int subpass)
+{
+  if (!_dynamic) {
+    info.renderPass = *this;
+    info.subpass = subpass;
+    return;
+  }
+
+  bool stencil = vks::tools::formatAspect(_depth_format) & VK_IMAGE_ASPECT_STENCIL_BIT;
+
+  _rendering = {};
+  _rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  _rendering.colorAttachmentCount = _color_format != VK_FORMAT_UNDEFINED ? 1 : 0;
+  _rendering.pColorAttachmentFormats = &_color_format;
+  _rendering.depthAttachmentFormat = _depth_format;
+  _rendering.stencilAttachmentFormat = stencil ? _depth_format : VK_FORMAT_UNDEFINED;
+  _rendering.pNext = info.pNext;
+
+  info.renderPass = VK_NULL_HANDLE;
+  info.subpass = 0;
+  info.pNext = &_rendering;
+}
+
 void VulkanPass::initialize()
 {
   std::array<VkAttachmentDescription, 2> attachments = {};
-  attachments[0].format = VK_FORMAT_B8G8R8A8_UNORM;
+  attachments[0].format = _color_format;
   attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
   attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -36,7 +67,7 @@ void VulkanPass::initialize()
   attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
-  attachments[1].format = VK_FORMAT_D24_UNORM_S8_UINT;
+  attachments[1].format = _depth_format;
   attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
   attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
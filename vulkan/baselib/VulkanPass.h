@@ -9,6 +9,19 @@ public:
 
   operator VkRenderPass(); 
 
+  // no render pass object, pipelines are built against the attachment formats and the pass is drawn
+  // between vkCmdBeginRendering and vkCmdEndRendering. set before the first pipeline is realized.
+  void set_dynamic(bool dynamic);
+  bool dynamic() const { return _dynamic; }
+
+  // attachment formats, VK_FORMAT_UNDEFINED when the pass has no attachment of that kind
+  VkFormat color_format() const { return _color_format; }
+  VkFormat depth_format() const { return _depth_format; }
+
+  // points a pipeline create info at the render pass and subpass, or chains the attachment formats
+  // when dynamic. the chained struct lives in the pass, so create the pipeline before the next call.
+  void attach(VkGraphicsPipelineCreateInfo &info, int subpass);
+
 protected:
 
   virtual void initialize();
@@ -17,5 +30,11 @@ protected:
   std::shared_ptr<VulkanDevice> _device;
 
   VkRenderPass _render_pass = VK_NULL_HANDLE;
+
+  VkFormat _color_format = VK_FORMAT_B8G8R8A8_UNORM;
+  VkFormat _depth_format = VK_FORMAT_D24_UNORM_S8_UINT;
+
+  bool _dynamic = false;
+  VkPipelineRenderingCreateInfo _rendering = {};
 };
 
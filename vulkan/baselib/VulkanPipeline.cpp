@@ -17,6 +17,8 @@ VulkanPipeline::VulkanPipeline(const std::shared_ptr<VulkanDevice>& dev) : _devi
 
 VulkanPipeline::~VulkanPipeline()
 {
+  _device->shaders()->forget(this);
+
   if(_matrix_layout) {
     vkDestroyDescriptorSetLayout(*_device, _matrix_layout, nullptr);
     _matrix_layout = VK_NULL_HANDLE;
@@ -37,7 +39,7 @@ VkDescriptorSetLayout VulkanPipeline::matrix_layout()
 {
   if (!_matrix_layout) {
     VkDescriptorSetLayoutBinding layoutBinding = {};
-    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBinding.descriptorType = _uniform_type;
     layoutBinding.descriptorCount = 1;
     layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     layoutBinding.pImmutableSamplers = nullptr;
@@ -63,3 +65,19 @@ VkPipelineLayout VulkanPipeline::pipe_layout()
   }
   return _pipe_layout;
 }
+
+void VulkanPipeline::rebuild()
+{
+  if (!_pass)
+    return;
+  if (_pipeline) {
+    vkDestroyPipeline(*_device, _pipeline, nullptr);
+    _pipeline = VK_NULL_HANDLE;
+  }
+  realize(_pass, _subpass);
+}
+
+VkShaderModule VulkanPipeline::shader(const std::string &name)
+{
+  return _device->shaders()->get(name, this);
+}
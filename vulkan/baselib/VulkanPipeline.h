@@ -17,18 +17,32 @@ public:
   VkDescriptorSetLayout matrix_layout();
   void set_matrix_layout(VkDescriptorSetLayout layout) { _matrix_layout = layout; }
 
+  // per frame uniform sets (matrix, light) take a dynamic offset, set before the layouts are created
+  void set_dynamic_uniforms(bool dynamic) { _uniform_type = dynamic ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; }
+  VkDescriptorType uniform_type() const { return _uniform_type; }
+
   bool valid() { return _pipeline != VK_NULL_HANDLE; }
 
   VkPipelineLayout pipe_layout();
 
+  // recreates the pipeline for the pass of the last realize, used when a shader is reloaded
+  void rebuild();
+
 protected:
 
+  // shared module from the device's shader registry, the pipeline is rebuilt when it reloads
+  VkShaderModule shader(const std::string &name);
+
   virtual VkPipelineLayout  create_pipe_layout() = 0;
   
   std::shared_ptr<VulkanDevice> _device;
 
   VkDescriptorSetLayout _matrix_layout = VK_NULL_HANDLE;
+  VkDescriptorType _uniform_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 
   VkPipelineLayout  _pipe_layout = VK_NULL_HANDLE;
   VkPipeline        _pipeline = VK_NULL_HANDLE;
+
+  VulkanPass *_pass = nullptr;
+  int _subpass = 0;
 };
\ No newline at end of file
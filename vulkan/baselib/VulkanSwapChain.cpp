@@ -4,6 +4,7 @@
 #include "VulkanInstance.h"
 #include "VulkanTools.h"
 
+#include <algorithm>
 #include <array>
 
 VulkanSwapChain::VulkanSwapChain(const std::shared_ptr<VulkanDevice> &dev)
@@ -27,6 +28,8 @@ VulkanSwapChain::VulkanSwapChain(const std::shared_ptr<VulkanDevice> &dev)
 
 VulkanSwapChain::~VulkanSwapChain() 
 {
+  destroy_offscreen();
+
   if (_swapChain != VK_NULL_HANDLE) {
     for (uint32_t i = 0; i < _images.size(); i++) {
       vkDestroyImageView(*_device, _images[i].view, nullptr);
@@ -104,16 +107,27 @@ void VulkanSwapChain::set_surface(VkSurfaceKHR surface)
   }
 }
 
-void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen) 
+bool VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen) 
 {
-  _width = width; _height = height;
-  vkDeviceWaitIdle(*_device);
-
+  // no device wait, frames in flight keep their images. the old chain is handed over and
+  // destroyed with its views once the frames submitted so far have finished
   VkSwapchainKHR oldchain = _swapChain;
 
   VkSurfaceCapabilitiesKHR surfaceCaps;
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_device->physical_device(), _surface, &surfaceCaps);
 
+  // the surface may dictate the size, the window may have changed again since the event
+  if (surfaceCaps.currentExtent.width != UINT32_MAX) {
+    width = surfaceCaps.currentExtent.width;
+    height = surfaceCaps.currentExtent.height;
+  }
+  width = std::clamp(width, surfaceCaps.minImageExtent.width, surfaceCaps.maxImageExtent.width);
+  height = std::clamp(height, surfaceCaps.minImageExtent.height, surfaceCaps.maxImageExtent.height);
+  // minimized, the current chain is kept until there is something to present to again
+  if (width == 0 || height == 0)
+    return false;
+  _width = width; _height = height;
+
   uint32_t presetModeCount;
   vkGetPhysicalDeviceSurfacePresentModesKHR(_device->physical_device(), _surface, &presetModeCount, nullptr);
   std::vector<VkPresentModeKHR> presentModes(presetModeCount);
@@ -195,15 +209,20 @@ void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool
     swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
   }
 
-  vkCreateSwapchainKHR(*_device, &swapchainCI, nullptr, &_swapChain);
+  VK_CHECK_RESULT(vkCreateSwapchainKHR(*_device, &swapchainCI, nullptr, &_swapChain));
 
-  // If an existing swap chain is re-created, destroy the old swap chain
+  // If an existing swap chain is re-created, retire the old swap chain
   // This also cleans up all the presentable images
   if (oldchain != VK_NULL_HANDLE) {
-    for (uint32_t i = 0; i < _images.size(); i++) {
-      vkDestroyImageView(*_device, _images[i].view, nullptr);
-    }
-    vkDestroySwapchainKHR(*_device, oldchain, nullptr);
+    std::vector<VkImageView> views;
+    for (auto &img : _images)
+      views.push_back(img.view);
+    VkDevice dev = *_device;
+    _device->retire([dev, oldchain, views]() {
+      for (auto view : views)
+        vkDestroyImageView(dev, view, nullptr);
+      vkDestroySwapchainKHR(dev, oldchain, nullptr);
+    });
   }
 
   uint32_t imageCount;
@@ -233,6 +252,69 @@ void VulkanSwapChain::realize(uint32_t width, uint32_t height, bool vsync, bool
 
     VK_CHECK_RESULT(vkCreateImageView(*_device, &colorAttachmentView, nullptr, &_images[i].view));
   }
+  return true;
+}
+
+void VulkanSwapChain::realize_offscreen(uint32_t width, uint32_t height, uint32_t count, VkFormat format)
+{
+  _width = width; _height = height;
+
+  // images of frames still in flight go once those frames are done
+  if (_offscreen && !_images.empty()) {
+    VulkanDevice *dev = _device.get();
+    _device->retire([dev, images = std::move(_images)]() {
+      for (auto &img : images) {
+        vkDestroyImageView(*dev, img.view, nullptr);
+        vkDestroyImage(*dev, img.image, nullptr);
+        dev->allocator()->free(img.mem);
+      }
+    });
+    _images.clear();
+  }
+  _offscreen = true;
+  _color_format = format;
+  _next_image = 0;
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = {width, height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  // copied out by VulkanView::capture, like a swapchain image with transfer source support
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  _images.resize(count);
+  for (auto &img : _images) {
+    VK_CHECK_RESULT(vkCreateImage(*_device, &imageInfo, nullptr, &img.image));
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(*_device, img.image, &memReqs);
+    img.mem = _device->allocator()->allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::RenderTarget);
+    if (!img.mem)
+      throw std::runtime_error("No proper memory type!");
+    VK_CHECK_RESULT(vkBindImageMemory(*_device, img.image, img.mem.memory, img.mem.offset));
+
+    img.view = _device->create_image_view(img.image, format);
+  }
+}
+
+void VulkanSwapChain::destroy_offscreen()
+{
+  if (!_offscreen)
+    return;
+
+  for (auto &img : _images) {
+    vkDestroyImageView(*_device, img.view, nullptr);
+    vkDestroyImage(*_device, img.image, nullptr);
+    _device->allocator()->free(img.mem);
+  }
+  _images.clear();
+  _offscreen = false;
 }
 
 std::vector<VkFramebuffer> VulkanSwapChain::create_frame_buffer(VkRenderPass vkPass, const VkImageView& depth)
@@ -275,8 +357,32 @@ std::vector<VkFramebuffer> VulkanSwapChain::create_frame_buffer(VkRenderPass vkP
   return frameBuffers;
 }
 
+VkFramebuffer VulkanSwapChain::create_frame_buffer(VkRenderPass vkPass, uint32_t index, const VkImageView &depth)
+{
+  VkImageView attachments[2] = {_images[index].view, depth};
+
+  VkFramebufferCreateInfo frameBufferCreateInfo = {};
+  frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  frameBufferCreateInfo.renderPass = vkPass;
+  frameBufferCreateInfo.attachmentCount = depth == VK_NULL_HANDLE ? 1 : 2;
+  frameBufferCreateInfo.pAttachments = attachments;
+  frameBufferCreateInfo.width = _width;
+  frameBufferCreateInfo.height = _height;
+  frameBufferCreateInfo.layers = 1;
+
+  VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &frameBuffer));
+  return frameBuffer;
+}
+
 std::tuple<VkResult, uint32_t> VulkanSwapChain::acquire_image(VkSemaphore present_sema)
 {
+  if (_offscreen) {
+    uint32_t index = _next_image;
+    _next_image = (_next_image + 1) % uint32_t(_images.size());
+    return {VK_SUCCESS, index};
+  }
+
   uint32_t index;
   auto result = vkAcquireNextImageKHR(*_device, _swapChain, UINT64_MAX, present_sema, nullptr, &index);
   return {result, index};
@@ -284,6 +390,9 @@ std::tuple<VkResult, uint32_t> VulkanSwapChain::acquire_image(VkSemaphore presen
 
 VkResult VulkanSwapChain::queue_present(VkQueue queue, uint32_t index, VkSemaphore wait_sema)
 {
+  if (_offscreen)
+    return VK_SUCCESS;
+
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   presentInfo.pNext = NULL;
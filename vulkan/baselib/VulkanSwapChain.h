@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include "vulkan/vulkan.h"
+#include "VulkanAllocator.h"
 
 class VulkanInstance;
 class VulkanDevice;
@@ -20,20 +21,43 @@ public:
 
   VkFormat color_format() { return _color_format; }
 
-  void realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen = false);
+  // creates the chain, or a new one taking over from the current without waiting for the device.
+  // the size may end up different from the one asked for when the surface dictates it. false when
+  // the surface has no area (minimized), nothing changed then and the current chain stays.
+  bool realize(uint32_t width, uint32_t height, bool vsync, bool fullscreen = false);
+
+  // no surface, count plain color images stand in for the swapchain images. they are handed out
+  // round robin, acquire signals nothing and present does nothing.
+  void realize_offscreen(uint32_t width, uint32_t height, uint32_t count, VkFormat format = VK_FORMAT_B8G8R8A8_UNORM);
+
+  // the offscreen counterpart of set_surface, fixes the format, the images come with realize_offscreen
+  void set_offscreen(VkFormat format = VK_FORMAT_B8G8R8A8_UNORM) { _offscreen = true; _color_format = format; }
+
+  bool offscreen() { return _offscreen; }
 
   uint32_t image_count() { return _images.size(); }
 
+  VkImage image(int idx) { return _images[idx].image; }
+
   VkImageView image_view(int idx) { return _images[idx].view; }
 
+  uint32_t width() { return _width; }
+  uint32_t height() { return _height; }
+
   std::vector<VkFramebuffer> create_frame_buffer(VkRenderPass vkPass, const VkImageView &depth);
 
   std::vector<VkFramebuffer> create_frame_buffer(VkRenderPass vkPass, const std::vector<VkImageView> &color, const VkImageView &depth);
 
+  // one framebuffer for image index, for views creating them lazily when an image is first drawn
+  VkFramebuffer create_frame_buffer(VkRenderPass vkPass, uint32_t index, const VkImageView &depth);
+
   std::tuple<VkResult, uint32_t> acquire_image(VkSemaphore present_sema);
 
   VkResult queue_present(VkQueue queue, uint32_t index, VkSemaphore wait_sema = VK_NULL_HANDLE);
 
+private:
+  void destroy_offscreen();
+
 private:
   std::shared_ptr<VulkanDevice>    _device;
 
@@ -48,9 +72,14 @@ private:
   struct SwapChainImage{
     VkImage image;
     VkImageView view;
+    // offscreen images only
+    MemoryAllocation mem;
   };
   std::vector<SwapChainImage> _images;
 
+  bool _offscreen = false;
+  uint32_t _next_image = 0;
+
   //PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR;
   //PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR;
   //PFN_vkGetPhysicalDeviceSurfaceFormatsKHR fpGetPhysicalDeviceSurfaceFormatsKHR;
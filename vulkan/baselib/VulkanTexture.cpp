@@ -4,23 +4,34 @@
 #include "VulkanInitializers.hpp"
 #include "VulkanTools.h"
 #include "VulkanImage.h"
+#include "UploadBatch.h"
+#include "TextureTools.h"
+#include "BlockCompressor.h"
 
 #include "stb_image.h"
 
+#include <algorithm>
+
 VulkanTexture::VulkanTexture()
 {
 }
 
 VulkanTexture::~VulkanTexture()
 {
-  if (_image)
-    vkDestroyImage(*_device, _image, nullptr);
-  if (_image_view)
-    vkDestroyImageView(*_device, _image_view, nullptr);
-  if (_image_mem)
-    vkFreeMemory(*_device, _image_mem, nullptr);
-  if (_sampler)
-    vkDestroySampler(*_device, _sampler, nullptr);
+  if (!_device)
+    return;
+  VkDevice dev = *_device;
+  auto allocator = _device->allocator();
+  _device->retire([dev, allocator, img = _image, view = _image_view, mem = _image_mem, sampler = _sampler]() mutable {
+    if (img)
+      vkDestroyImage(dev, img, nullptr);
+    if (view)
+      vkDestroyImageView(dev, view, nullptr);
+    if (mem)
+      allocator->free(mem);
+    if (sampler)
+      vkDestroySampler(dev, sampler, nullptr);
+  });
 }
 
 VkImageView VulkanTexture::image_view()
@@ -47,8 +58,31 @@ VkDescriptorImageInfo VulkanTexture::descriptor()
 
 void VulkanTexture::load_image(const std::string& file)
 {
+  if (file.size() > 5 && file.compare(file.size() - 5, 5, ".ktx2") == 0) {
+    load_ktx2(file);
+    return;
+  }
+
   int x = 0, y = 0, n = 0;
-  uint8_t* data = stbi_load(file.c_str(), &x, &y, &n, 0);
+  uint8_t* data = stbi_load(file.c_str(), &x, &y, &n, 4);
+  if (!data)
+    return;
+  set_image(x, y, 4, 8, data, x * y * 4);
+  stbi_image_free(data);
+}
+
+bool VulkanTexture::load_ktx2(const std::string &file)
+{
+  tex::Ktx2Image img;
+  if (!tex::read_ktx2(file, img))
+    return false;
+
+  _w = img.w;
+  _h = img.h;
+  _format = VkFormat(img.vk_format);
+  _data = std::move(img.data);
+  _mips = std::move(img.levels);
+  return true;
 }
 
 void VulkanTexture::set_image(int w, int h, int channel, int channel_depth, uint8_t*data, int n)
@@ -59,6 +93,8 @@ void VulkanTexture::set_image(int w, int h, int channel, int channel_depth, uint
   _channel_depth = channel_depth;
   _data.resize(n);
   memcpy(_data.data(), data, n);
+  _mips.clear();
+  _format = VK_FORMAT_R8G8B8A8_UNORM;
   return;
 }
 
@@ -69,67 +105,149 @@ void VulkanTexture::set_image(int w, int h, const tg::Tvec4<uint8_t> &clr)
   _data.resize(w * h * 4);
   for (int i = 0; i < w * h; i++) 
     memcpy(&_data[i << 2], &clr, sizeof(tg::Tvec4<uint8_t>));
+  _mips.clear();
+  _format = VK_FORMAT_R8G8B8A8_UNORM;
 }
 
 void VulkanTexture::realize(const std::shared_ptr<VulkanDevice>& dev)
+{
+  if (_sampler)
+    return;
+
+  UploadBatch batch(dev);
+  realize(dev, batch);
+  batch.submit();
+  batch.wait();
+}
+
+void VulkanTexture::realize(const std::shared_ptr<VulkanDevice>& dev, UploadBatch& batch)
 {
   if (_sampler)
     return;
 
   _device = dev;
-  auto buf = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, _data.size(), (void*)_data.data());
-  auto [img, mem] = _device->create_image(_w, _h);
+
+  std::vector<uint8_t> mip_data;
+  std::vector<tex::MipLevel> mips;
+  bool gpu_mips = false;
+
+  if (!_mips.empty()) {
+    // cooked chain, block compressed levels go up as they are when the device can sample them
+    mips = _mips;
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(_device->physical_device(), _format, &format_props);
+    tex::BlockFormat block;
+    bool is_block = tex::block_format_from_vk(_format, block);
+    bool sampleable = (format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+                      (!is_block || _device->enabled_features().textureCompressionBC);
+    if (!sampleable && is_block) {
+      std::vector<tex::MipLevel> decoded = mips;
+      size_t total = 0;
+      for (auto &lv : decoded) {
+        lv.offset = total;
+        lv.size = size_t(lv.w) * lv.h * 4;
+        total += lv.size;
+      }
+      mip_data.resize(total);
+      for (size_t i = 0; i < mips.size(); i++)
+        tex::decompress(_data.data() + mips[i].offset, mips[i].w, mips[i].h, block, mip_data.data() + decoded[i].offset);
+      mips = decoded;
+      bool srgb = _format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || _format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+                  _format == VK_FORMAT_BC3_SRGB_BLOCK || _format == VK_FORMAT_BC7_SRGB_BLOCK;
+      _format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+  } else {
+    // prefer blitting the chain on the gpu, formats without linear blit support get a cpu box filter
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(_device->physical_device(), _format, &format_props);
+    const VkFormatFeatureFlags blit_features =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    gpu_mips = (format_props.optimalTilingFeatures & blit_features) == blit_features;
+
+    if (gpu_mips)
+      mips.push_back({uint32_t(_w), uint32_t(_h), 0, _data.size()});
+    else
+      mips = tex::build_mip_chain(_data.data(), _w, _h, 4, mip_data);
+  }
+  _levels = gpu_mips ? tex::mip_levels(_w, _h) : uint32_t(mips.size());
+  auto &upload = mip_data.empty() ? _data : mip_data;
+
+  auto buf = batch.stage(upload.data(), upload.size());
+  auto [img, mem] = _device->create_image(_w, _h, _format, _levels);
   _image = img;
   _image_mem = mem;
 
-  VkBufferImageCopy buffer_region = {};
-  buffer_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  buffer_region.imageSubresource.mipLevel = 0;
-  buffer_region.imageSubresource.baseArrayLayer = 0;
-  buffer_region.imageSubresource.layerCount = 1;
-  buffer_region.imageExtent.width = _w;
-  buffer_region.imageExtent.height = _h;
-  buffer_region.imageExtent.depth = 1;
-  buffer_region.bufferOffset = 0;
-  buffer_region.bufferImageHeight = _h;
-  buffer_region.bufferRowLength = _w;
+  std::vector<VkBufferImageCopy> regions(mips.size());
+  for (uint32_t i = 0; i < mips.size(); i++) {
+    auto &region = regions[i];
+    region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = i;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = mips[i].w;
+    region.imageExtent.height = mips[i].h;
+    region.imageExtent.depth = 1;
+    region.bufferOffset = buf.offset + mips[i].offset;
+    region.bufferImageHeight = 0;
+    region.bufferRowLength = 0;
+  }
 
   VkImageSubresourceRange subrange = {};
   subrange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   subrange.baseMipLevel = 0;
-  subrange.levelCount = 1;
+  subrange.levelCount = _levels;
   subrange.layerCount = 1;
 
-  auto cmdbuf = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+  // the transfer queue only copies, blits and the fragment shader barriers need the graphics queue
+  auto copycmd = batch.command_buffer();
 
-  VkImageMemoryBarrier imgbarrier = vks::initializers::imageMemoryBarrier();
-  imgbarrier.image = img;
-  imgbarrier.subresourceRange = subrange;
-  imgbarrier.srcAccessMask = 0;
-  imgbarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imgbarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  imgbarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vks::tools::insertImageMemoryBarrier(copycmd, img, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, subrange);
 
-  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgbarrier);
+  vkCmdCopyBufferToImage(copycmd, buf.buffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
 
-  vkCmdCopyBufferToImage(cmdbuf, *buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_region);
+  batch.transfer_image(img, subrange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  auto cmdbuf = batch.graphics_command_buffer();
 
-  imgbarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imgbarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  imgbarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  imgbarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  if (gpu_mips) {
+    VkImageSubresourceRange level = subrange;
+    level.levelCount = 1;
+    int32_t w = _w, h = _h;
+    for (uint32_t i = 1; i < _levels; i++) {
+      level.baseMipLevel = i - 1;
+      vks::tools::insertImageMemoryBarrier(cmdbuf, img, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, level);
 
-  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgbarrier);
+      VkImageBlit blit = {};
+      blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+      blit.srcOffsets[1] = {w, h, 1};
+      w = std::max(w >> 1, 1);
+      h = std::max(h >> 1, 1);
+      blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+      blit.dstOffsets[1] = {w, h, 1};
+      vkCmdBlitImage(cmdbuf, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
 
-  _device->flush_command_buffer(cmdbuf, _device->transfer_queue());
+      vks::tools::insertImageMemoryBarrier(cmdbuf, img, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, level);
+    }
+    subrange.baseMipLevel = _levels - 1;
+    subrange.levelCount = 1;
+  }
+
+  vks::tools::insertImageMemoryBarrier(cmdbuf, img, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, subrange);
 
   auto samplerinfo = vks::initializers::samplerCreateInfo();
-  samplerinfo.maxLod = 1;
+  samplerinfo.maxLod = float(_levels);
   VkSampler sampler;
   VK_CHECK_RESULT(vkCreateSampler(*_device, &samplerinfo, nullptr, &sampler));
   _sampler = sampler;
 
-  auto view = _device->create_image_view(img);
+  auto view = _device->create_image_view(img, _format, _levels);
   _image_view = view;
 }
 
@@ -137,6 +255,8 @@ void VulkanTexture::realize(const std::shared_ptr<VulkanImage> &img)
 {
   _vimage = img;
   _device = _vimage->device();
+  // must match the layout the render pass or frame graph leaves the image in
+  _image_layout = vks::tools::sampledLayout(_vimage->format());
 
   auto samplerinfo = vks::initializers::samplerCreateInfo();
   samplerinfo.maxLod = 1;
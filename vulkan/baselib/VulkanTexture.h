@@ -6,9 +6,12 @@
 #include <vector>
 
 #include "tvec.h"
+#include "TextureTools.h"
+#include "VulkanAllocator.h"
 
 class VulkanDevice;
 class VulkanImage;
+class UploadBatch;
 
 class VulkanTexture {
 public:
@@ -26,26 +29,35 @@ public:
 
   void load_image(const std::string &file);
 
+  bool load_ktx2(const std::string &file);
+
   void set_image(int w, int h, int channel, int depth, uint8_t*data, int n);
 
   void set_image(int w, int h, const tg::Tvec4<uint8_t> &clr);
 
   void realize(const std::shared_ptr<VulkanDevice> &dev);
 
+  // records the upload into batch, the texture is usable once the batch has finished
+  void realize(const std::shared_ptr<VulkanDevice> &dev, UploadBatch &batch);
+
   void realize(const std::shared_ptr<VulkanImage> &img);
 
 private:
   std::shared_ptr<VulkanDevice> _device;
 
   int _w, _h, _channel, _channel_depth;
+  uint32_t _levels = 1;
 
   std::vector<uint8_t> _data;
+  // precooked levels in _data (ktx2), empty when the chain is generated in realize
+  std::vector<tex::MipLevel> _mips;
+  VkFormat _format = VK_FORMAT_R8G8B8A8_UNORM;
 
-  VkImageLayout _image_layout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+  VkImageLayout _image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
   VkImage _image = VK_NULL_HANDLE;
   VkImageView _image_view = VK_NULL_HANDLE;
-  VkDeviceMemory _image_mem = VK_NULL_HANDLE;
+  MemoryAllocation _image_mem;
 
   VkSampler _sampler = VK_NULL_HANDLE;
 
@@ -144,6 +144,31 @@ VkBool32 formatHasStencil(VkFormat format)
   return std::find(stencilFormats.begin(), stencilFormats.end(), format) != std::end(stencilFormats);
 }
 
+VkImageAspectFlags formatAspect(VkFormat format)
+{
+  switch (format) {
+  case VK_FORMAT_D16_UNORM:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  case VK_FORMAT_S8_UINT:
+    return VK_IMAGE_ASPECT_STENCIL_BIT;
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  default:
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+VkImageLayout sampledLayout(VkFormat format)
+{
+  if (formatAspect(format) & VK_IMAGE_ASPECT_COLOR_BIT)
+    return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  return VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+}
+
 // Returns if a given format support LINEAR filtering
 VkBool32 formatIsFilterable(VkPhysicalDevice physicalDevice, VkFormat format, VkImageTiling tiling)
 {
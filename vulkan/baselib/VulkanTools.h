@@ -81,6 +81,10 @@ VkBool32 getSupportedDepthStencilFormat(VkPhysicalDevice physicalDevice, VkForma
 VkBool32 formatIsFilterable(VkPhysicalDevice physicalDevice, VkFormat format, VkImageTiling tiling);
 // Returns true if a given format has a stencil part
 VkBool32 formatHasStencil(VkFormat format);
+// Aspects a view or barrier of the format covers, depth and/or stencil for depth formats, color otherwise
+VkImageAspectFlags formatAspect(VkFormat format);
+// Layout a sampled image of the format is read in, without needing synchronization2
+VkImageLayout sampledLayout(VkFormat format);
 
 // Put an image memory barrier for setting an image layout on the sub resource into the given command buffer
 void setImageLayout(VkCommandBuffer cmdbuffer, VkImage image, VkImageLayout oldImageLayout, VkImageLayout newImageLayout,
@@ -1,11 +1,15 @@
 #include "VulkanView.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <chrono>
 #include <vulkan/vulkan.h>
 
 #include <SDL2/SDL_vulkan.h>
 #include <SDL2/SDL.h>
 
+#include "stb_image_write.h"
+
 #include "tvec.h"
 #include "tmath.h"
 
@@ -13,9 +17,15 @@
 #include "VulkanTools.h"
 #include "VulkanDevice.h"
 #include "VulkanImage.h"
+#include "VulkanBuffer.h"
 #include "VulkanSwapChain.h"
 #include "VulkanPass.h"
 #include "VulkanImGUI.h"
+#include "UniformRing.h"
+#include "GpuProfiler.h"
+#include "ParallelRecorder.h"
+#include "CommandCache.h"
+#include "Benchmark.h"
 
 
 using tg::vec2;
@@ -33,18 +43,17 @@ VulkanView::VulkanView(const std::shared_ptr<VulkanDevice>& dev, bool overlay) :
 VulkanView::~VulkanView()
 {
   vkDeviceWaitIdle(*_device);
+  _device->flush_retired();
 
   _imgui.reset();
-  for (auto fence : _fences)
-    vkDestroyFence(*_device, fence, nullptr);
-
-  vkDestroySemaphore(*_device, _presentSemaphore, nullptr);
-  vkDestroySemaphore(*_device, _renderSemaphore, nullptr);
+  _uniforms.reset();
+  _profiler.reset();
+  _recorder.reset();
+  _command_cache.reset();
+  destroy_frames();
 
   _swapchain.reset();
 
-  _device->destroy_command_buffers(_cmd_bufs);
-
   clear_frame();
 
   //auto surface = _swapchain->surface();
@@ -56,13 +65,132 @@ VulkanView::~VulkanView()
 void VulkanView::set_surface(VkSurfaceKHR surface, int w, int h)
 {
   _swapchain->set_surface(surface);
-  _swapchain->realize(w, h, true);
 
   if (_imgui) _imgui->create_pipeline(_swapchain->color_format());
 
   resize_impl(w, h);
 }
 
+void VulkanView::set_offscreen(int w, int h)
+{
+  _swapchain->set_offscreen();
+
+  if (_imgui) _imgui->create_pipeline(_swapchain->color_format());
+
+  resize_impl(w, h);
+}
+
+bool VulkanView::capture(const std::string &file)
+{
+  if (_last_image < 0)
+    return false;
+
+  VkFormat format = _swapchain->color_format();
+  bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+  if (!bgra && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB)
+    return false;
+
+  wait_frames();
+
+  uint32_t w = _swapchain->width(), h = _swapchain->height();
+  VkImage image = _swapchain->image(_last_image);
+  auto staging = _device->create_buffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                        VkDeviceSize(w) * h * 4);
+
+  auto cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+  // the frame left the image ready to present
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {w, h, 1};
+  vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, *staging, 1, &region);
+
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferMemoryBarrier host = {};
+  host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host.buffer = *staging;
+  host.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host, 0, nullptr);
+
+  _device->flush_command_buffer(cmd, _device->graphic_queue(0));
+
+  std::vector<uint8_t> rgba(size_t(w) * h * 4);
+  auto src = staging->map();
+  for (size_t i = 0; i < rgba.size(); i += 4) {
+    rgba[i + 0] = src[i + (bgra ? 2 : 0)];
+    rgba[i + 1] = src[i + 1];
+    rgba[i + 2] = src[i + (bgra ? 0 : 2)];
+    rgba[i + 3] = 255;
+  }
+  staging->unmap();
+
+  return stbi_write_png(file.c_str(), int(w), int(h), 4, rgba.data(), int(w) * 4) != 0;
+}
+
+bool VulkanView::benchmark(const CameraPath &path, uint32_t frames, const std::string &file)
+{
+  auto prof = profiler();
+  uint64_t collected = prof->collected();
+
+  BenchmarkReport report;
+  report.set_info(_device->device_properties().deviceName, _w, _h, frames);
+  // run once with each to compare the two
+  report.set_mode(render_pass()->dynamic() ? "dynamic rendering" : "render pass");
+
+  auto now = [] { return std::chrono::steady_clock::now(); };
+  auto last = now();
+  for (uint32_t i = 0; i < frames; i++) {
+    // keeps the window responsive, the events are dropped
+    if (!_swapchain->offscreen())
+      SDL_PumpEvents();
+
+    auto key = path.sample(frames > 1 ? float(i) / (frames - 1) : 0.f);
+    _manip.look_at(key.eye, key.pos, key.up);
+    view_changed();
+    poll_resources();
+
+    render();
+
+    // the first frame has nothing before it to measure against
+    auto t = now();
+    if (i > 0)
+      report.add_cpu(std::chrono::duration<double, std::milli>(t - last).count());
+    last = t;
+
+    // a frame's timestamps arrive once its slot comes round again
+    if (prof->collected() != collected) {
+      collected = prof->collected();
+      report.add_gpu(prof->span_ms());
+    }
+  }
+  wait_frames();
+
+  for (auto &p : prof->passes())
+    report.add_pass(p.name, p.avg_ms);
+  return report.write(file);
+}
+
 void VulkanView::update_overlay()
 {
   if (_imgui)
@@ -72,71 +200,119 @@ void VulkanView::update_overlay()
 void VulkanView::frame(bool continus)
 {
   bool running = true;
-  while (running) {
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      switch (event.type) {
-        case SDL_QUIT:
-          running = false;
-          break;
-        case SDL_WINDOWEVENT:
-          if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-            vkDeviceWaitIdle(*_device);
-            int w = event.window.data1;
-            int h = event.window.data2;
-            resize_impl(w, h);
-            update_frame();
-          }
-          break;
-        case SDL_USEREVENT:
-          if (event.user.code == WM_PAINT)
-            render();
-          break;
-        case SDL_MOUSEBUTTONDOWN:
-          if (_imgui && _imgui->mouse_down(event.button)) {
-          } else {
-            if (event.button.button == 1)
-              left_dn(event.button.x, event.button.y);
-          }
-          update_frame();
-          break;
-        case SDL_MOUSEBUTTONUP:
-          if (_imgui && _imgui->mouse_up(event.button)) {
-          } else {
-            if (event.button.button == 1)
-              left_up(event.button.x, event.button.y);
-          }
-          update_frame();
-          break;
-        case SDL_MOUSEMOTION:
-          if (_imgui && _imgui->mouse_move(event.motion)) {
-          } else {
-            if (event.motion.state & SDL_BUTTON_LMASK) {
-              _manip.rotate(event.motion.xrel, event.motion.yrel);
-              left_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
-            } else if (event.motion.state & SDL_BUTTON_MMASK) {
-            } else if (event.motion.state & SDL_BUTTON_RMASK) {
-              _manip.translate(event.motion.xrel, -event.motion.yrel);
-              right_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
-            }
+  bool redraw = true;
+  // the last size a resize event asked for, applied once the queue is drained
+  int resize_w = 0, resize_h = 0;
+  // sdl ticks of the oldest input not on screen yet, 0 when there is none
+  uint32_t input_ticks = 0;
+  uint32_t inputs = 0;
+
+  auto input = [&](const SDL_Event &event) {
+    redraw = true;
+    inputs++;
+    if (!input_ticks)
+      input_ticks = std::max(event.common.timestamp, 1u);
+  };
+
+  // input only changes state, the scene is updated and drawn once after the queue is drained
+  auto handle = [&](SDL_Event &event) {
+    switch (event.type) {
+      case SDL_QUIT:
+        running = false;
+        break;
+      case SDL_WINDOWEVENT:
+        if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+          resize_w = event.window.data1;
+          resize_h = event.window.data2;
+          redraw = true;
+        }
+        break;
+      case SDL_USEREVENT:
+        // posted by update_frame
+        if (event.user.code == WM_PAINT)
+          redraw = true;
+        break;
+      case SDL_MOUSEBUTTONDOWN:
+        if (_imgui && _imgui->mouse_down(event.button)) {
+        } else {
+          if (event.button.button == 1)
+            left_dn(event.button.x, event.button.y);
+        }
+        input(event);
+        break;
+      case SDL_MOUSEBUTTONUP:
+        if (_imgui && _imgui->mouse_up(event.button)) {
+        } else {
+          if (event.button.button == 1)
+            left_up(event.button.x, event.button.y);
+        }
+        input(event);
+        break;
+      case SDL_MOUSEMOTION:
+        if (_imgui && _imgui->mouse_move(event.motion)) {
+        } else {
+          if (event.motion.state & SDL_BUTTON_LMASK) {
+            _manip.rotate(event.motion.xrel, event.motion.yrel);
+            left_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
+          } else if (event.motion.state & SDL_BUTTON_MMASK) {
+          } else if (event.motion.state & SDL_BUTTON_RMASK) {
+            _manip.translate(event.motion.xrel, -event.motion.yrel);
+            right_drag(event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel);
           }
-          update_frame();
-          break;
-        case SDL_MOUSEWHEEL: {
-          _manip.zoom(event.wheel.y);
-          wheel(event.wheel.y);
-          update_frame();
-          break;
         }
-        case SDL_KEYUP: {
-          if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
-            _manip.home();
-          key_up(event.key.keysym.scancode);
-          update_frame();
-        } break;
-        default:
-          break;
+        input(event);
+        break;
+      case SDL_MOUSEWHEEL: {
+        _manip.zoom(event.wheel.y);
+        wheel(event.wheel.y);
+        input(event);
+        break;
       }
+      case SDL_KEYUP: {
+        if (event.key.keysym.scancode == SDL_SCANCODE_SPACE)
+          _manip.home();
+        key_up(event.key.keysym.scancode);
+        input(event);
+      } break;
+      default:
+        break;
+    }
+  };
+
+  while (running) {
+    SDL_Event event;
+    // nothing to draw, sleep until input arrives. the timeout keeps resources polled
+    if (!redraw && !continus && SDL_WaitEventTimeout(&event, 10))
+      handle(event);
+    while (SDL_PollEvent(&event))
+      handle(event);
+    if (!running)
+      break;
+
+    // a drag sends a stream of sizes, only the last one gets a swapchain
+    if (resize_w) {
+      resize_impl(resize_w, resize_h);
+      resize_w = resize_h = 0;
+    }
+
+    // new pipelines and resident meshes show up in the next recorded frame
+    redraw |= poll_resources();
+    redraw |= poll_shaders();
+
+    if (!redraw && !continus)
+      continue;
+
+    // one render per pass over the queue, with fifo present that is at most one per vblank
+    update_scene();
+    render();
+    redraw = false;
+
+    if (input_ticks) {
+      double ms = double(SDL_GetTicks() - input_ticks);
+      _input_latency_ms = _input_latency_ms ? _input_latency_ms * 0.9 + ms * 0.1 : ms;
+      _inputs_per_frame = _inputs_per_frame ? _inputs_per_frame * 0.9 + inputs * 0.1 : inputs;
+      input_ticks = 0;
+      inputs = 0;
     }
   }
 }
@@ -147,37 +323,85 @@ void VulkanView::set_render_pass(VkRenderPass render_pass)
 
 void VulkanView::set_frame_buffers(const std::vector<VkFramebuffer>& frame_bufs)
 {
-  for (auto& frame : _frame_bufs) {
-    if (frame) {
-      vkDestroyFramebuffer(*_device, frame, nullptr);
-      frame = VK_NULL_HANDLE;
-    }
-  }
+  _device->retire_framebuffers(_frame_bufs);
   _frame_bufs = frame_bufs;
 }
 
+void VulkanView::set_frames_in_flight(uint32_t n)
+{
+  n = std::max(n, 1u);
+  if (n == _frames_in_flight)
+    return;
+  // the per frame slices are sized on first use
+  assert(!_uniforms && !_profiler && !_recorder && !_command_cache);
+  wait_frames();
+  destroy_frames();
+  _frames_in_flight = n;
+  create_frames();
+}
+
 uint32_t VulkanView::frame_count()
 {
-  return _swapchain->image_count();
+  return _frames_in_flight;
+}
+
+UniformRing *VulkanView::uniforms()
+{
+  if (!_uniforms)
+    _uniforms = std::make_shared<UniformRing>(_device.get(), frame_count());
+  return _uniforms.get();
+}
+
+GpuProfiler *VulkanView::profiler()
+{
+  if (!_profiler)
+    _profiler = std::make_shared<GpuProfiler>(_device.get(), frame_count());
+  return _profiler.get();
+}
+
+ParallelRecorder *VulkanView::recorder()
+{
+  if (!_recorder)
+    _recorder = std::make_shared<ParallelRecorder>(_device.get(), frame_count());
+  return _recorder.get();
+}
+
+CommandCache *VulkanView::command_cache()
+{
+  if (!_command_cache)
+    _command_cache = std::make_shared<CommandCache>(_device.get(), frame_count());
+  return _command_cache.get();
+}
+
+bool VulkanView::poll_shaders()
+{
+  if (!_device->shaders()->poll())
+    return false;
+  // cached segments still point at the old pipelines
+  if (_command_cache)
+    _command_cache->invalidate_all();
+  return true;
 }
 
 void VulkanView::update_frame()
 {
   update_scene();
 
+  // offscreen views are driven by render() directly
+  if (_swapchain->offscreen())
+    return;
+
   SDL_Event ev;
   ev.type = SDL_USEREVENT;
   ev.user.code = WM_PAINT;
   SDL_PushEvent(&ev);
-
-  if (_imgui && _imgui->update_frame()) {
-    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[_framenum], VK_TRUE, UINT64_MAX));
-    _imgui->build_command_buffers();
-  }
 }
 
 void VulkanView::create_frame_buffers()
 {
+  // views drawing through a frame graph override this and leave the depth image to the graph
+  _depth = _device->create_depth_image(_w, _h, _depth_format);
+
   #if 0
   std::vector<VkImageView> imgs;
   for(int i = 0; i < count; i++) {
@@ -187,31 +411,59 @@ void VulkanView::create_frame_buffers()
   }
   _frame_bufs = _swapchain->create_frame_buffer(_render_pass, imgs, _depth->image_view());
   #else
-  _frame_bufs = _swapchain->create_frame_buffer(*render_pass(), _depth->image_view());
+  // made by frame_buffer() when an image is first drawn, a resize does not create them all at once
+  _frame_bufs.assign(_swapchain->image_count(), VK_NULL_HANDLE);
   #endif
 
 }
 
-void VulkanView::create_command_buffers()
+VkFramebuffer VulkanView::frame_buffer(uint32_t image)
 {
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
-  }
+  if (!_frame_bufs[image])
+    _frame_bufs[image] = _swapchain->create_frame_buffer(*render_pass(), image, _depth->image_view());
+  return _frame_bufs[image];
 }
 
-void VulkanView::build_command_buffers()
+void VulkanView::record_frame(VkCommandBuffer cmd, uint32_t image, uint32_t frame)
 {
-  auto& framebuffers = _frame_bufs;
-  auto& renderPass = _render_pass;
-  vkDeviceWaitIdle(*_device);
+  bool dynamic = render_pass()->dynamic();
+  if (dynamic)
+    begin_rendering(cmd, image);
+  else
+    begin_render_pass(cmd, image);
 
-  assert(framebuffers.size() == _cmd_bufs.size());
+  {
+    VkViewport viewport = {};
+    viewport.y = _h;
+    viewport.width = _w;
+    viewport.height = -_h;
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+  }
 
-  VkCommandBufferBeginInfo buf_info = {};
-  buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  buf_info.pNext = nullptr;
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _w;
+    scissor.extent.height = _h;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+  }
+
+  {
+    GpuScope scope(profiler(), cmd, "main");
+    build_command_buffer(cmd);
+  }
+
+  if (dynamic)
+    end_rendering(cmd, image);
+  else
+    vkCmdEndRenderPass(cmd);
+}
 
+void VulkanView::begin_render_pass(VkCommandBuffer cmd, uint32_t image)
+{
   VkClearValue clearValues[2];
   clearValues[0].color = {{0.0, 0.0, 0.0, 1.0}};
   clearValues[1].depthStencil = {1.f, 0};
@@ -220,6 +472,7 @@ void VulkanView::build_command_buffers()
   renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassBeginInfo.pNext = nullptr;
   renderPassBeginInfo.renderPass = *render_pass();
+  renderPassBeginInfo.framebuffer = frame_buffer(image);
   renderPassBeginInfo.renderArea.offset.x = 0;
   renderPassBeginInfo.renderArea.offset.y = 0;
   renderPassBeginInfo.renderArea.extent.width = _w;
@@ -227,50 +480,122 @@ void VulkanView::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 2;
   renderPassBeginInfo.pClearValues = clearValues;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    auto& cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    {
-      VkViewport viewport = {};
-      viewport.y = _h;
-      viewport.width = _w;
-      viewport.height = -_h;
-      viewport.minDepth = 0;
-      viewport.maxDepth = 1;
-      vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-    }
-
-    {
-      VkRect2D scissor = {};
-      scissor.extent.width = _w;
-      scissor.extent.height = _h;
-      scissor.offset.x = 0;
-      scissor.offset.y = 0;
-      vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-    }
-
-    build_command_buffer(cmd_buf);
+  vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-    vkCmdEndRenderPass(cmd_buf);
+void VulkanView::begin_rendering(VkCommandBuffer cmd, uint32_t image)
+{
+  // what the render pass did with its initial layouts, both images are cleared anyway
+  VkImageMemoryBarrier barriers[2] = {};
+  barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].image = _swapchain->image(image);
+  barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barriers[1] = barriers[0];
+  barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  barriers[1].image = _depth->image();
+  auto aspect = vks::tools::formatAspect(_depth_format);
+  bool stencil = aspect & VK_IMAGE_ASPECT_STENCIL_BIT;
+  barriers[1].subresourceRange = {aspect, 0, 1, 0, 1};
+  VkPipelineStageFlags tests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | tests, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | tests,
+                       0, 0, nullptr, 0, nullptr, 2, barriers);
+
+  VkRenderingAttachmentInfo color = {};
+  color.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  color.imageView = _swapchain->image_view(image);
+  color.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
+
+  VkRenderingAttachmentInfo depth = color;
+  depth.imageView = _depth->image_view();
+  depth.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depth.clearValue.depthStencil = {1.f, 0};
+
+  VkRenderingInfo rendering = {};
+  rendering.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  rendering.renderArea.extent = {uint32_t(_w), uint32_t(_h)};
+  rendering.layerCount = 1;
+  rendering.colorAttachmentCount = 1;
+  rendering.pColorAttachments = &color;
+  rendering.pDepthAttachment = &depth;
+  rendering.pStencilAttachment = stencil ? &depth : nullptr;
+  vkCmdBeginRendering(cmd, &rendering);
+}
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
-  }
+void VulkanView::end_rendering(VkCommandBuffer cmd, uint32_t image)
+{
+  vkCmdEndRendering(cmd);
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = _swapchain->image(image);
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+                       1, &barrier);
 }
 
 void VulkanView::render()
 {
-  // vkWaitForFences(*_device, 1, _fences[]);
-  auto [result, index] = _swapchain->acquire_image(_presentSemaphore);
+  auto &frame = _frames[_frame];
+
+  // only this slot's previous submit has to be done, the other frames keep running
+  VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+  // everything retired before that submit can go now
+  _device->frame_completed(frame.serial);
+
+  if (_profiler)
+    _profiler->collect(_frame);
+  if (_recorder)
+    _recorder->begin_frame(_frame);
+  if (_command_cache)
+    _command_cache->begin_frame();
+
+  // the last submit reading this slice is done, bring it up to date
+  if (_uniforms)
+    _uniforms->flush(_frame);
+
+  // nothing to present to while minimized, the slot's fence is still signalled
+  if (_stale && !recreate_swapchain(_w, _h))
+    return;
+
+  auto [result, index] = _swapchain->acquire_image(frame.acquired);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    // nothing was signalled and the fence is still set, the frame is simply skipped
+    recreate_swapchain(_w, _h);
+    return;
+  }
   if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
     VK_CHECK_RESULT(result);
   }
 
-  VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &_fences[index], VK_TRUE, UINT64_MAX));
-  VK_CHECK_RESULT(vkResetFences(*_device, 1, &_fences[index]));
+  VK_CHECK_RESULT(vkResetFences(*_device, 1, &frame.fence));
+  VK_CHECK_RESULT(vkResetCommandPool(*_device, frame.pool, 0));
+
+  VkCommandBufferBeginInfo buf_info = {};
+  buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(frame.cmd, &buf_info));
+  profiler()->begin_frame(frame.cmd, _frame);
+
+  record_frame(frame.cmd, index, _frame);
+  if (_imgui)
+    _imgui->record(frame.cmd, index, _frame);
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(frame.cmd));
 
   VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
   VkSubmitInfo submitInfo = {};
@@ -278,29 +603,40 @@ void VulkanView::render()
   submitInfo.pWaitDstStageMask = &waitStageMask;   // Pointer to the list of pipeline stages that the semaphore waits will occur at
   submitInfo.waitSemaphoreCount = 1;               // One wait semaphore
   submitInfo.signalSemaphoreCount = 1;             // One signal semaphore
+  // offscreen images are neither acquired nor presented
+  if (_swapchain->offscreen())
+    submitInfo.waitSemaphoreCount = submitInfo.signalSemaphoreCount = 0;
+  submitInfo.pCommandBuffers = &frame.cmd;         // Command buffers(s) to execute in this batch (submission)
+  submitInfo.commandBufferCount = 1;               // One command buffer
 
-  int cmdcount = 1;
-  VkCommandBuffer cmdbufs[2] = {_cmd_bufs[index], 0};
-  if (_imgui) {
-    cmdcount = 2;
-    cmdbufs[1] = _imgui->_cmd_bufs[index];
-  }
-  submitInfo.pCommandBuffers = cmdbufs;             // Command buffers(s) to execute in this batch (submission)
-  submitInfo.commandBufferCount = cmdcount;         // One command buffer
-
-  submitInfo.pWaitSemaphores = &_presentSemaphore;   // Semaphore(s) to wait upon before the submitted command buffer starts executing
-  submitInfo.pSignalSemaphores = &_renderSemaphore;  // Semaphore(s) to be signaled when command buffers have completed
+  submitInfo.pWaitSemaphores = &frame.acquired;     // Semaphore(s) to wait upon before the submitted command buffer starts executing
+  submitInfo.pSignalSemaphores = &_rendered[index]; // Semaphore(s) to be signaled when command buffers have completed
 
   auto queue =_device->graphic_queue(0);
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, _fences[index]));
+  frame.serial = _device->next_frame_serial();
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, frame.fence));
 
   {
-    _framenum = index;
-    auto present = _swapchain->queue_present(queue, _framenum, _renderSemaphore);
-    if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
+    auto present = _swapchain->queue_present(queue, index, _rendered[index]);
+    if (present == VK_SUBOPTIMAL_KHR || present == VK_ERROR_OUT_OF_DATE_KHR)
+      _stale = true;
+    else
       VK_CHECK_RESULT(present);
-    }
   }
+
+  _last_image = int(index);
+  if (_path) {
+    auto &m = _manip;
+    _path->add({tg::vec3(m.eye()), tg::vec3(m.pos()), tg::vec3(m.up())});
+  }
+  _frame = (_frame + 1) % uint32_t(_frames.size());
+
+  int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  if (_last_frame_us) {
+    double ms = double(now - _last_frame_us) / 1000.0;
+    _frame_ms = _frame_ms ? _frame_ms * 0.95 + ms * 0.05 : ms;
+  }
+  _last_frame_us = now;
 }
 
 void VulkanView::initialize()
@@ -309,63 +645,117 @@ void VulkanView::initialize()
 
     _swapchain = std::make_shared<VulkanSwapChain>(_device);
 
-    create_sync_objs();
+    create_frames();
 
     _render_pass = std::make_unique<VulkanPass>(_device);
 }
 
 void VulkanView::check_frame()
 {
-  _depth = _device->create_depth_image(_w, _h, _depth_format);
-
   create_frame_buffers();
 
-  create_command_buffers();
-
-  build_command_buffers();
-
-  if (_fences.size() != _cmd_bufs.size()) {
-    for (auto fence : _fences)
-      vkDestroyFence(*_device, fence, nullptr);
-    _fences = _device->create_fences(_cmd_bufs.size());
+  // presents on the old chain may still wait on these, they go with the frames in flight
+  if (!_rendered.empty()) {
+    VkDevice dev = *_device;
+    _device->retire([dev, semas = std::move(_rendered)]() {
+      for (auto sema : semas)
+        vkDestroySemaphore(dev, sema, nullptr);
+    });
+    _rendered.clear();
   }
+  _rendered.resize(_swapchain->image_count());
+
+  VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+  semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto &sema : _rendered)
+    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &sema));
 }
 
 void VulkanView::clear_frame()
 {
-  for (auto& framebuf : _frame_bufs)
-    vkDestroyFramebuffer(*_device, framebuf, nullptr);
-  _frame_bufs.clear();
+  // the depth image goes through the device's retire queue as well
+  _device->retire_framebuffers(_frame_bufs);
 
   _depth.reset();
 }
 
-void VulkanView::create_sync_objs()
+void VulkanView::wait_frames()
+{
+  for (auto &frame : _frames) {
+    VK_CHECK_RESULT(vkWaitForFences(*_device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+    _device->frame_completed(frame.serial);
+  }
+}
+
+void VulkanView::create_frames()
 {
   VkSemaphoreCreateInfo semaphoreCreateInfo = {};
   semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
   semaphoreCreateInfo.pNext = nullptr;
 
-  // Semaphore used to ensure that image presentation is complete before starting to submit again
-  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_presentSemaphore));
+  // created signalled, the first wait on every slot returns at once
+  auto fences = _device->create_fences(_frames_in_flight);
+
+  _frames.resize(_frames_in_flight);
+  for (uint32_t i = 0; i < _frames.size(); i++) {
+    auto &frame = _frames[i];
+    frame.pool = _device->create_command_pool(_device->graphics_family(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    frame.cmd = _device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, frame.pool, false);
+    frame.fence = fences[i];
+    frame.serial = 0;
+    // Semaphore used to ensure that image presentation is complete before starting to render into it
+    VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &frame.acquired));
+  }
+  _frame = 0;
+}
 
-  // Semaphore used to ensure that all commands submitted have been finished before submitting the image to the queue
-  VK_CHECK_RESULT(vkCreateSemaphore(*_device, &semaphoreCreateInfo, nullptr, &_renderSemaphore));
+void VulkanView::destroy_frames()
+{
+  for (auto &frame : _frames) {
+    vkDestroyCommandPool(*_device, frame.pool, nullptr);
+    vkDestroySemaphore(*_device, frame.acquired, nullptr);
+    vkDestroyFence(*_device, frame.fence, nullptr);
+  }
+  _frames.clear();
+
+  for (auto sema : _rendered)
+    vkDestroySemaphore(*_device, sema, nullptr);
+  _rendered.clear();
 }
 
 void VulkanView::resize_impl(int w, int h)
 {
-  if (w != _w && h != _h) {
-    _w = w; _h = h;
+  if (w == _w && h == _h)
+    return;
+  recreate_swapchain(w, h);
+}
 
-    _swapchain->realize(w, h, true);
+bool VulkanView::recreate_swapchain(int w, int h)
+{
+  // no wait for the gpu, frames in flight finish on the old images and framebuffers
+  if (_swapchain->offscreen()) {
+    // one image per frame in flight, the image a frame renders to is free once its fence signalled
+    _swapchain->realize_offscreen(w, h, frame_count(), _swapchain->color_format());
+  } else if (!_swapchain->realize(w, h, true)) {
+    // minimized, the old chain and what is built on it stay until the surface has an area again
+    _stale = true;
+    return false;
+  }
+  _stale = false;
+  // the new images hold nothing yet
+  _last_image = -1;
 
-    clear_frame();
-    check_frame();
+  // the surface has the last word on the size, it may differ from what was asked for
+  bool resized = _w != int(_swapchain->width()) || _h != int(_swapchain->height());
+  _w = int(_swapchain->width());
+  _h = int(_swapchain->height());
 
-    resize(w, h);
-  }
+  clear_frame();
+  check_frame();
 
   if (_imgui)
-    _imgui->resize(w, h);
+    _imgui->resize(_w, _h);
+  if (resized)
+    resize(_w, _h);
+  return true;
 }
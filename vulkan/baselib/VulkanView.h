@@ -4,6 +4,7 @@
 class VulkanDevice;
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "vulkan/vulkan.h"
@@ -14,6 +15,11 @@ class VulkanSwapChain;
 class VulkanImGUI;
 class VulkanImage;
 class VulkanPass;
+class UniformRing;
+class GpuProfiler;
+class ParallelRecorder;
+class CommandCache;
+class CameraPath;
 
 class VulkanView {
 public:
@@ -23,9 +29,26 @@ public:
 
   void set_surface(VkSurfaceKHR surface, int w, int h);
 
+  // renders without a window into offscreen images of the swapchain format, with the same passes
+  // and pipelines. there is no event loop, call render() once per frame.
+  void set_offscreen(int w, int h);
+
+  // reads the last rendered image back and writes it as png, waits for the frames in flight.
+  // a window's swapchain has to allow transfer source usage.
+  bool capture(const std::string &file);
+
+  // renders frames along path as fast as possible without handling input, then writes cpu and
+  // gpu frame time percentiles and the pass averages as json
+  bool benchmark(const CameraPath &path, uint32_t frames, const std::string &file);
+
+  // appends the camera pose of every rendered frame to path until called with null
+  void record_path(CameraPath *path) { _path = path; }
+
   void update_overlay();
 
-  void frame(bool continus = true);
+  // the event loop. input is coalesced, every pass drains the queue and renders once when something
+  // changed. continus renders every pass, paced by present.
+  void frame(bool continus = false);
 
   VulkanDevice *device() { return _device.get(); }
 
@@ -39,14 +62,43 @@ public:
 
   void set_frame_buffers(const std::vector<VkFramebuffer> &frame_bufs);
 
+  // how many frames the cpu may record ahead of the gpu, set before set_surface
+  void set_frames_in_flight(uint32_t n);
+
+  // frames in flight, every per frame resource below has this many slices
   uint32_t frame_count();
 
+  // per frame uniform storage, created on first use with one slice per frame in flight
+  UniformRing *uniforms();
+
+  // cpu time between two rendered frames, averaged
+  double frame_ms() const { return _frame_ms; }
+
+  // from the oldest input of a frame to its present call, and how many inputs a frame took, averaged
+  double input_latency_ms() const { return _input_latency_ms; }
+  double inputs_per_frame() const { return _inputs_per_frame; }
+
+  // gpu timestamps of the passes, frames are read back once their fence has signalled
+  GpuProfiler *profiler();
+
+  // secondary command buffers recorded on worker threads, created on first use
+  ParallelRecorder *recorder();
+
+  // draw segments recorded once and replayed until invalidated, created on first use. a reloaded
+  // shader invalidates every segment, what else a segment depends on the view has to invalidate.
+  CommandCache *command_cache();
+
+  // reloads changed shaders, returns true when pipelines were rebuilt
+  bool poll_shaders();
+
   Manipulator &manipulator() { return _manip; }
 
   int width() { return _w; }
   int height() { return _h; }
 
   virtual void update_scene(){};
+  // called once per loop, return true when resources became resident and the commands need rebuilding
+  virtual bool poll_resources() { return false; }
   virtual void resize(int w, int h) = 0;
   virtual void build_command_buffer(VkCommandBuffer cmd_buf) = 0;
 
@@ -56,6 +108,8 @@ public:
   virtual void left_drag(int x, int y, int xdel, int ydel){};
   virtual void right_drag(int x, int y, int xdel, int ydel){};
   virtual void key_up(int){};
+  // the manipulator was moved by something other than the input handlers
+  virtual void view_changed(){};
 
   virtual void render();
 
@@ -63,11 +117,17 @@ protected:
 
   void update_frame();
 
+  // waits for this view's submitted frames only, command buffers can be recorded again afterwards
+  void wait_frames();
+
   virtual void create_frame_buffers();
 
-  virtual void create_command_buffers();
+  // framebuffer of the default render pass for a swapchain image, made on first use
+  VkFramebuffer frame_buffer(uint32_t image);
 
-  virtual void build_command_buffers();
+  // records one frame into cmd, already begun. image picks the swapchain framebuffer,
+  // frame the slice of the per frame resources. the overlay is recorded after it.
+  virtual void record_frame(VkCommandBuffer cmd, uint32_t image, uint32_t frame);
 
 private:
   void initialize();
@@ -76,10 +136,21 @@ private:
 
   void clear_frame();
 
-  void create_sync_objs();
+  void create_frames();
+
+  void destroy_frames();
 
   void resize_impl(int w, int h);
 
+  // the default pass, either a render pass object or dynamic rendering straight on the swapchain image
+  void begin_render_pass(VkCommandBuffer cmd, uint32_t image);
+  void begin_rendering(VkCommandBuffer cmd, uint32_t image);
+  void end_rendering(VkCommandBuffer cmd, uint32_t image);
+
+  // a new swapchain of about w x h taking over from the current one, everything built on the old one is
+  // retired and resize() follows when the size changed. false when minimized, the view stays stale then.
+  bool recreate_swapchain(int w, int h);
+
 protected:
   std::shared_ptr<VulkanDevice> _device;
   std::shared_ptr<VulkanSwapChain> _swapchain;
@@ -87,22 +158,49 @@ protected:
 
   std::shared_ptr<VulkanImGUI> _imgui = 0;
 
-  std::vector<VkCommandBuffer> _cmd_bufs;
-
-  int _w, _h;
-  uint32_t _framenum = 0;
+  int _w = 0, _h = 0;
 
   VkFormat _depth_format = VK_FORMAT_D24_UNORM_S8_UINT;
 
   std::shared_ptr<VulkanImage> _depth = {VK_NULL_HANDLE};
   std::vector<std::shared_ptr<VulkanImage>> _images;
 
+  std::shared_ptr<UniformRing> _uniforms;
+  std::shared_ptr<GpuProfiler> _profiler;
+  std::shared_ptr<ParallelRecorder> _recorder;
+  std::shared_ptr<CommandCache> _command_cache;
+
 private:
   std::vector<VkFramebuffer> _frame_bufs;
 
-  VkSemaphore _presentSemaphore = VK_NULL_HANDLE;
-  VkSemaphore _renderSemaphore = VK_NULL_HANDLE;
-  std::vector<VkFence> _fences;
+  struct Frame {
+    // reset as a whole before the frame is recorded again
+    VkCommandPool pool = VK_NULL_HANDLE;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VkSemaphore acquired = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    // device frame serial of the last submit behind the fence
+    uint64_t serial = 0;
+  };
+
+  uint32_t _frames_in_flight = 2;
+  std::vector<Frame> _frames;
+  uint32_t _frame = 0;
+  // signalled by the submit and waited by present, one per swapchain image since
+  // present gives no signal when it is done with the semaphore
+  std::vector<VkSemaphore> _rendered;
+  // present reported the swapchain suboptimal, it is recreated before the next acquire
+  bool _stale = false;
+
+  double _frame_ms = 0;
+  int64_t _last_frame_us = 0;
+  double _input_latency_ms = 0;
+  double _inputs_per_frame = 0;
+
+  // swapchain image of the last submit, -1 before the first frame
+  int _last_image = -1;
+
+  CameraPath *_path = nullptr;
 
   Manipulator _manip;
 };
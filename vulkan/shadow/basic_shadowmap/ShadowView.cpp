@@ -20,6 +20,7 @@
 #include "RenderData.h"
 #include "GLTFLoader.h"
 #include "MeshInstance.h"
+#include "UniformRing.h"
 
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_vulkan.h"
@@ -48,7 +49,9 @@ ShadowView::ShadowView(const std::shared_ptr<VulkanDevice> &dev) : VulkanView(de
   _deer->set_transform(tg::translate(tg::vec3(3, 3, 1)) * tg::rotate(tg::radians(30.f), tg::vec3(0, 0, 1)) * tg::scale(1.0f));
 
   _shadow_pipeline = std::make_shared<ShadowPipeline>(dev);
+  _shadow_pipeline->set_dynamic_uniforms(true);
   _depth_pipeline = std::make_shared<DepthPipeline>(dev, 2048, 2048);
+  _depth_pipeline->set_dynamic_uniforms(true);
 
   _depth_image = _device->create_depth_image(2048, 2048, VK_FORMAT_D32_SFLOAT);
 
@@ -210,7 +213,7 @@ void ShadowView::create_sphere()
     VkFence fence;
     VK_CHECK_RESULT(vkCreateFence(*device(), &fenceCreateInfo, nullptr, &fence));
 
-    VK_CHECK_RESULT(vkQueueSubmit(device()->transfer_queue(), 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkQueueSubmit(device()->graphic_queue(), 1, &submitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(*device(), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
     vkDestroyFence(*device(), fence, nullptr);
     vkFreeCommandBuffers(*device(), device()->command_pool(), 1, &cmdBuffer);
@@ -227,37 +230,21 @@ void ShadowView::set_uniforms()
   light.light_dir = tg::normalize(vec3(1, 1, 1));
   light.light_color = vec3(10);
 
-  uint8_t *data = 0;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _light->memory(), 0, sizeof(light), 0, (void **)&data));
-  memcpy(data, &light, sizeof(light));
-
   pbr.albedo = vec3(0.8);
   pbr.ao = 1;
   pbr.metallic = 0.2;
   pbr.roughness = 0.7;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _material->memory(), 0, sizeof(pbr), 0, (void **)&data));
-  memcpy(data, &pbr, sizeof(pbr));
 
   auto vp = tg::vec3(100);
-  _depth_matrix_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(MVP));
   _depth_matrix.view = tg::lookat(vp);
   _depth_matrix.prj = tg::ortho<float>(-25, 25, -25, 25, 10, 400);
 
-  VK_CHECK_RESULT(vkMapMemory(*device(), _depth_matrix_buf->memory(), 0, sizeof(MVP), 0, (void **)&data));
-  memcpy(data, &_depth_matrix, sizeof(MVP));
+  _shadow_matrix.light = tg::normalize(vp);
+  _shadow_matrix.view = _depth_matrix.view;
+  _shadow_matrix.prj = _depth_matrix.prj;
+  _shadow_matrix.mvp = _depth_matrix.prj * _depth_matrix.view;
 
-  {
-    _shadow_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                          sizeof(ShadowMatrix));
-    ShadowMatrix sm;
-    sm.light = tg::normalize(vp); 
-    sm.view = _depth_matrix.view;
-    sm.prj = _depth_matrix.prj;
-    sm.mvp = _depth_matrix.prj * _depth_matrix.view;
-    
-    VK_CHECK_RESULT(vkMapMemory(*device(), _shadow_buf->memory(), 0, sizeof(ShadowMatrix), 0, (void **)&data));
-    memcpy(data, &sm, sizeof(ShadowMatrix));
-  }
+  upload_uniforms();
 }
 
 void ShadowView::update_ubo()
@@ -271,10 +258,19 @@ void ShadowView::update_ubo()
   // auto xx = _matrix.view * tg::vec4(0, 0, 100, 1);
   // xx = _matrix.prj * xx;
 
-  uint8_t *data = 0;
-  VK_CHECK_RESULT(vkMapMemory(*device(), _ubo_buf->memory(), 0, sizeof(_matrix), 0, (void **)&data));
-  memcpy(data, &_matrix, sizeof(_matrix));
-  vkUnmapMemory(*device(), _ubo_buf->memory());
+  upload_uniforms();
+}
+
+void ShadowView::upload_uniforms()
+{
+  // only the host copy changes here, the next frame's slice picks it up in render()
+  if (!_ring)
+    return;
+  _ring->write(_matrix_block, &_matrix, sizeof(_matrix));
+  _ring->write(_light_block, &light, sizeof(light));
+  _ring->write(_pbr_block, &pbr, sizeof(pbr));
+  _ring->write(_depth_block, &_depth_matrix, sizeof(_depth_matrix));
+  _ring->write(_shadow_block, &_shadow_matrix, sizeof(_shadow_matrix));
 }
 
 void ShadowView::resize(int w, int h)
@@ -305,21 +301,14 @@ void ShadowView::key_up(int key)
     update_ubo();
 }
 
-void ShadowView::create_command_buffers()
-{
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
-  }
-}
-
-void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
+void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame)
 {
   tg::mat4 mt;
   mt.identity();
   if (_depth_pipeline && _depth_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_depth_pipeline);
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_depth_matrix_set, 0, nullptr);
+    uint32_t depth_offset = _ring->dynamic_offset(frame, _depth_block);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_depth_matrix_set, 1, &depth_offset);
 
     vkCmdPushConstants(cmd_buf, _depth_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -334,20 +323,13 @@ void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
   }
 }
 
-void ShadowView::build_command_buffers()
+void ShadowView::record_frame(VkCommandBuffer cmd_buf, uint32_t image, uint32_t frame)
 {
   if (!_depth_pipeline->valid() || !_shadow_pipeline->valid())
     return;
 
-  vkDeviceWaitIdle(*_device);
-
   auto &framebuffers = frame_buffers();
   auto &renderPass = *render_pass();
-  assert(framebuffers.size() == _cmd_bufs.size());
-
-  VkCommandBufferBeginInfo buf_info = {};
-  buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  buf_info.pNext = nullptr;
 
   VkClearValue clearValues[2];
 
@@ -361,42 +343,36 @@ void ShadowView::build_command_buffers()
   renderPassBeginInfo.clearValueCount = 1;
   renderPassBeginInfo.pClearValues = clearValues;
 
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.renderPass = *_depth_pass;
-    renderPassBeginInfo.framebuffer = _depth_frames[i];
-    renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
-    renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
-    auto &cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    clearValues[0].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 1;
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  renderPassBeginInfo.renderPass = *_depth_pass;
+  renderPassBeginInfo.framebuffer = _depth_frames[image];
+  renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
+  renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
 
-    build_depth_command_buffer(cmd_buf);
+  clearValues[0].depthStencil = {1.f, 0};
+  renderPassBeginInfo.clearValueCount = 1;
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdEndRenderPass(cmd_buf);
+  build_depth_command_buffer(cmd_buf, frame);
 
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 2;
+  vkCmdEndRenderPass(cmd_buf);
 
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    renderPassBeginInfo.renderArea.extent.width = width();
-    renderPassBeginInfo.renderArea.extent.height = height();
+  clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
+  clearValues[1].depthStencil = {1.f, 0};
+  renderPassBeginInfo.clearValueCount = 2;
 
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  renderPassBeginInfo.renderPass = renderPass;
+  renderPassBeginInfo.framebuffer = framebuffers[image];
+  renderPassBeginInfo.renderArea.extent.width = width();
+  renderPassBeginInfo.renderArea.extent.height = height();
 
-    build_command_buffer(cmd_buf);
+  vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdEndRenderPass(cmd_buf);
+  build_command_buffer(cmd_buf, frame);
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
-  }
+  vkCmdEndRenderPass(cmd_buf);
 }
 
-void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf) 
+void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame)
 {
   tg::mat4 mt;
   mt.identity();
@@ -422,9 +398,10 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
   if (_shadow_pipeline && _shadow_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_shadow_pipeline);
 
-    uint32_t offset[1] = {};
+    uint32_t offset[3] = {_ring->dynamic_offset(frame, _matrix_block), _ring->dynamic_offset(frame, _light_block),
+                          _ring->dynamic_offset(frame, _pbr_block)};
     VkDescriptorSet dessets[3] = {_matrix_set, _light_set, _pbr_set};
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 1, offset);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 3, offset);
 
     VkWriteDescriptorSet texture_set = {};
     texture_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -436,7 +413,8 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
     texture_set.pImageInfo = &descriptor;
     _device->vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 3, 1, &texture_set);
 
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_set, 0, 0);
+    uint32_t shadow_offset = _ring->dynamic_offset(frame, _shadow_block);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_set, 1, &shadow_offset);
 
     vkCmdPushConstants(cmd_buf, _shadow_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -460,14 +438,16 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
 
 void ShadowView::create_pipe_layout()
 {
-  VkDescriptorPoolSize typeCounts[1];
-  typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  VkDescriptorPoolSize typeCounts[2];
+  typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   typeCounts[0].descriptorCount = 10;
+  typeCounts[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  typeCounts[1].descriptorCount = 2;
 
   VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
   descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   descriptorPoolInfo.pNext = nullptr;
-  descriptorPoolInfo.poolSizeCount = 1;
+  descriptorPoolInfo.poolSizeCount = 2;
   descriptorPoolInfo.pPoolSizes = typeCounts;
   descriptorPoolInfo.maxSets = 10;
 
@@ -476,66 +456,19 @@ void ShadowView::create_pipe_layout()
   _descript_pool = desPool;
 
   //----------------------------------------------------------------------------------------------------
-  auto mlayout = _shadow_pipeline->matrix_layout();
-  auto llayout = _shadow_pipeline->light_layout();
-  auto playout = _shadow_pipeline->pbr_layout();
+  // the sets only point at ring blocks and the shadow map, they are written once in create_pipeline
+  VkDescriptorSetLayout layouts[5] = {_shadow_pipeline->matrix_layout(), _shadow_pipeline->light_layout(), _shadow_pipeline->pbr_layout(),
+                                      _depth_pipeline->matrix_layout(), _shadow_pipeline->shadow_layout()};
+  VkDescriptorSet *sets[5] = {&_matrix_set, &_light_set, &_pbr_set, &_depth_matrix_set, &_shadow_set};
 
   VkDescriptorSetAllocateInfo allocInfo = {};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = desPool;
   allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &mlayout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_matrix_set));
-
-  allocInfo.pSetLayouts = &llayout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_light_set));
-
-  allocInfo.pSetLayouts = &playout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_pbr_set));
-
-  VkDescriptorBufferInfo descriptor = {};
-  int sz = sizeof(_matrix);
-  _ubo_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  descriptor.buffer = *_ubo_buf;
-  descriptor.offset = 0;
-  descriptor.range = sizeof(_matrix);
-
-  sz = sizeof(light);
-  VkDescriptorBufferInfo ldescriptor = {};
-  _light = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  ldescriptor.buffer = *_light;
-  ldescriptor.offset = 0;
-  ldescriptor.range = sz;
-
-  sz = sizeof(pbr);
-  VkDescriptorBufferInfo mdescriptor = {};
-  _material = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  mdescriptor.buffer = *_material;
-  mdescriptor.offset = 0;
-  mdescriptor.range = sz;
-
-  VkWriteDescriptorSet writeDescriptorSet = {};
-  writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  writeDescriptorSet.dstSet = _matrix_set;
-  writeDescriptorSet.descriptorCount = 1;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.pBufferInfo = &descriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _light_set;
-  writeDescriptorSet.pBufferInfo = &ldescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _pbr_set;
-  writeDescriptorSet.pBufferInfo = &mdescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  //writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
+  for (int i = 0; i < 5; i++) {
+    allocInfo.pSetLayouts = &layouts[i];
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, sets[i]));
+  }
 
   //----------------------------------------------------------------------------------------------------
   //{
@@ -567,7 +500,12 @@ void ShadowView::create_pipe_layout()
 
 void ShadowView::create_frame_buffers()
 {
-  {
+  _depth = _device->create_depth_image(_w, _h, _depth_format);
+
+  // they only point at the shadow map, a new swapchain only needs new ones when the image count changed
+  if (_depth_frames.size() != _swapchain->image_count()) {
+    _device->retire_framebuffers(_depth_frames);
+
     auto view = _depth_image->image_view();
     VkFramebufferCreateInfo frameBufferCreateInfo = {};
     frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -610,77 +548,52 @@ void ShadowView::create_frame_buffers()
 
 void ShadowView::create_pipeline()
 {
-  if (_depth_pipeline) {
-    _depth_pipeline->realize(_depth_pass.get());
-
-    auto des_layout = _depth_pipeline->matrix_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &des_layout;
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_depth_matrix_set));
-
-    int sz = sizeof(_depth_matrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_depth_matrix_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
+  // uniforms() needs the frame count, known once the swapchain exists
+  if (!_ring) {
+    _ring = uniforms();
+    _matrix_block = _ring->allocate(sizeof(_matrix));
+    _light_block = _ring->allocate(sizeof(light));
+    _pbr_block = _ring->allocate(sizeof(pbr));
+    _depth_block = _ring->allocate(sizeof(_depth_matrix));
+    _shadow_block = _ring->allocate(sizeof(_shadow_matrix));
+
+    VkDescriptorBufferInfo descriptors[5] = {_ring->descriptor(sizeof(_matrix)), _ring->descriptor(sizeof(light)),
+                                             _ring->descriptor(sizeof(pbr)), _ring->descriptor(sizeof(_depth_matrix)),
+                                             _ring->descriptor(sizeof(_shadow_matrix))};
+    VkDescriptorSet sets[5] = {_matrix_set, _light_set, _pbr_set, _depth_matrix_set, _shadow_set};
 
     VkWriteDescriptorSet writeDescriptorSet = {};
     writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _depth_matrix_set;
     writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeDescriptorSet.pBufferInfo = &descriptor;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     writeDescriptorSet.dstBinding = 0;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-  }
-
-  _shadow_pipeline->realize(render_pass());
-
-  _tree->realize(_device, _shadow_pipeline);
-
-  _deer->realize(_device, _shadow_pipeline);
-
-  {
-    auto slayout = _shadow_pipeline->shadow_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &slayout;
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_set));
-
-    int sz = sizeof(ShadowMatrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_shadow_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
-
-    VkWriteDescriptorSet writeDescriptorSet = {};
-    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _shadow_set;
-    writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeDescriptorSet.pBufferInfo = &descriptor;
-    writeDescriptorSet.dstBinding = 0;
-    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+    for (int i = 0; i < 5; i++) {
+      writeDescriptorSet.dstSet = sets[i];
+      writeDescriptorSet.pBufferInfo = &descriptors[i];
+      vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+    }
 
     _shadow_texture = std::make_shared<VulkanTexture>();
     _shadow_texture->realize(_depth_image);
 
     VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
 
+    writeDescriptorSet.dstSet = _shadow_set;
     writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     writeDescriptorSet.dstBinding = 1;
     writeDescriptorSet.pBufferInfo = 0;
     writeDescriptorSet.pImageInfo = &depthDescriptor;
-
     vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+
+    upload_uniforms();
   }
 
-  build_command_buffers();
+  if (_depth_pipeline)
+    _depth_pipeline->realize(_depth_pass.get());
+
+  _shadow_pipeline->realize(render_pass());
+
+  _tree->realize(_device, _shadow_pipeline);
+
+  _deer->realize(_device, _shadow_pipeline);
 }
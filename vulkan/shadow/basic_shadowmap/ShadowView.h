@@ -16,6 +16,7 @@ public:
 
   void set_uniforms();
   void update_ubo();
+  void upload_uniforms();
 
   void resize(int w, int h);
   void update_scene();
@@ -23,13 +24,14 @@ public:
   void wheel(int delta) { update_ubo(); }
   void left_drag(int x, int y, int, int) { update_ubo(); }
   void right_drag(int x, int y, int, int) { update_ubo(); }
+  void view_changed() override { update_ubo(); }
   void key_up(int key);
 
-  void create_command_buffers();
-  void build_depth_command_buffer(VkCommandBuffer cmd_buf);
+  void build_depth_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame);
 
-  void build_command_buffers();
-  void build_command_buffer(VkCommandBuffer cmd_buf) override;
+  void record_frame(VkCommandBuffer cmd_buf, uint32_t image, uint32_t frame) override;
+  void build_command_buffer(VkCommandBuffer cmd_buf) override { build_command_buffer(cmd_buf, 0); }
+  void build_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame);
   void create_pipe_layout();
   void create_frame_buffers();
   void create_pipeline();
@@ -57,15 +59,16 @@ private:
   VkDescriptorSet _basic_tex_set = VK_NULL_HANDLE;
 
   VkDescriptorSet _depth_matrix_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _depth_matrix_buf;
 
   VkDescriptorSet _shadow_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _shadow_buf;
   std::shared_ptr<VulkanTexture> _shadow_texture;
 
-  std::shared_ptr<VulkanBuffer> _ubo_buf, _light, _material;
+  // every uniform block sits in the view's ring, bound with a per frame dynamic offset
+  UniformRing *_ring = nullptr;
+  VkDeviceSize _matrix_block = 0, _light_block = 0, _pbr_block = 0, _depth_block = 0, _shadow_block = 0;
 
   MVP _matrix, _depth_matrix;
+  ShadowMatrix _shadow_matrix;
 
   uint32_t _vert_count = 0;
   uint32_t _index_count = 0;
@@ -7,6 +7,9 @@
 #include "VulkanSwapChain.h"
 #include "VulkanBuffer.h"
 #include "VulkanImage.h"
+#include "UniformRing.h"
+#include "GpuProfiler.h"
+#include "ParallelRecorder.h"
 #include "VulkanTools.h"
 #include "VulkanPass.h"
 #include "DepthPass.h"
@@ -28,6 +31,11 @@
 #include "config.h"
 #include "imgui/imgui.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
 #define WM_PAINT 1
 
 constexpr float fov = 60;
@@ -90,16 +98,19 @@ ShadowView::ShadowView(const std::shared_ptr<VulkanDevice> &dev) : VulkanView(de
 {
   create_sphere();
 
-  GLTFLoader loader;
-  _tree = loader.load_file(ROOT_DIR "/data/oaktree.gltf");
-  _tree->set_transform(tg::mat4(tg::translate(tg::vec3(0, 0, 1)) * tg::scale(4.0f)));
+  _tree.load = GLTFLoader::load_file_async(ROOT_DIR "/data/oaktree.gltf");
+  _tree.pos = tg::vec3(0, 0, 1);
+  _tree.transform = tg::mat4(tg::translate(_tree.pos) * tg::scale(4.0f));
 
-  _deer = loader.load_file(ROOT_DIR "/data/deer.gltf");
-  _deer->set_transform(tg::mat4(tg::translate(tg::vec3(3, 0, 1)) * tg::rotate(tg::radians(30.f), tg::vec3(0, 0, 1)) * tg::scale(1.f)));
+  _deer.load = GLTFLoader::load_file_async(ROOT_DIR "/data/deer.gltf");
+  _deer.pos = tg::vec3(3, 0, 1);
+  _deer.transform = tg::mat4(tg::translate(_deer.pos) * tg::rotate(tg::radians(30.f), tg::vec3(0, 0, 1)) * tg::scale(1.f));
 
   _shadow_pipeline = std::make_shared<ShadowPipeline>(dev);
+  _shadow_pipeline->set_dynamic_uniforms(true);
 
   _depth_pipeline = std::make_shared<DepthPersPipeline>(dev, 2048, 2048);
+  _depth_pipeline->set_dynamic_uniforms(true);
   _depth_image = _device->create_depth_image(2048, 2048, VK_FORMAT_D32_SFLOAT);
 
   _depth_pass = std::make_shared<DepthPass>(dev);
@@ -149,21 +160,8 @@ ShadowView::~ShadowView()
     _index_mem = VK_NULL_HANDLE;
   }
 
-  if (_descript_pool) {
-    vkDestroyDescriptorPool(*device(), _descript_pool, nullptr);
-    _descript_pool = VK_NULL_HANDLE;
-  }
-
-  for (int i = 0; i < _depth_frames.size(); i++) {
-    vkDestroyFramebuffer(*_device, _depth_frames[i], 0);
-  }
-  _depth_frames.clear();
-
-  for (int i = 0; i < _hud_frames.size(); i++)
-  {
-    vkDestroyFramebuffer(*_device, _hud_frames[i], 0);
-  }
-  _hud_frames.clear();
+  _descriptors.reset();
+  _graph.reset();
 }
 
 void ShadowView::create_sphere()
@@ -276,7 +274,7 @@ void ShadowView::create_sphere()
     VkFence fence;
     VK_CHECK_RESULT(vkCreateFence(*device(), &fenceCreateInfo, nullptr, &fence));
 
-    VK_CHECK_RESULT(vkQueueSubmit(device()->transfer_queue(), 1, &submitInfo, fence));
+    VK_CHECK_RESULT(vkQueueSubmit(device()->graphic_queue(), 1, &submitInfo, fence));
     VK_CHECK_RESULT(vkWaitForFences(*device(), 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
     vkDestroyFence(*device(), fence, nullptr);
     vkFreeCommandBuffers(*device(), device()->command_pool(), 1, &cmdBuffer);
@@ -299,12 +297,9 @@ void ShadowView::set_uniforms()
   pbr.roughness = 0.7;
   uint8_t *data = 0;
 
-  VK_CHECK_RESULT(vkMapMemory(*device(), _material->memory(), 0, sizeof(pbr), 0, (void **)&data));
+  data = _material->map();
   memcpy(data, &pbr, sizeof(pbr));
-  vkUnmapMemory(*device(), _material->memory());
-
-  _shadow_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(ShadowMatrix));
+  _material->unmap();
 
   update_light();
 }
@@ -315,14 +310,20 @@ void ShadowView::update_ubo()
   _matrix.view = manipulator().view_matrix();
   _matrix.prj = tg::perspective<float>(fov, float(width()) / height(), 0.1, 1000);
 
-  void *data = 0;
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _ubo_buf->memory(), 0, sizeof(_matrix), 0, (void **)&data));
-    memcpy(data, &_matrix, sizeof(_matrix));
-    vkUnmapMemory(*device(), _ubo_buf->memory());
+  // receivers are the top of the ground box, casters are whatever stands on it
+  tg::boundingbox psc(tg::vec3(-10, -10, 0), tg::vec3(10, 10, 1));
+  for (auto *m : {&_tree, &_deer}) {
+    if (m->resident) {
+      auto &box = m->mesh->world_bound();
+      if (!box.empty()) {
+        psc.expand(box.min());
+        psc.expand(box.max());
+      }
+    } else {
+      psc.expand(m->pos - tg::vec3(0.5, 0.5, 0));
+      psc.expand(m->pos + tg::vec3(0.5, 0.5, 1));
+    }
   }
-
-  tg::boundingbox psc(tg::vec3(-10, -10, 0), tg::vec3(10, 10, 4));
   auto vp = manipulator().eye();
   auto ct = tg::vec3(0, 0, 0);
   auto [mm, mp] = cal_psm_matrix(light.light_dir, vp, ct, 0.1, 20, psc);
@@ -364,27 +365,31 @@ void ShadowView::update_ubo()
 
   _shadow_matrix.pers = mat;
 
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _shadow_buf->memory(), 0, sizeof(ShadowMatrix), 0, (void **)&data));
-    memcpy(data, &_shadow_matrix, sizeof(ShadowMatrix));
-    vkUnmapMemory(*device(), _shadow_buf->memory());
-  }
+  upload_uniforms();
 }
 
 void ShadowView::update_light()
 {
   _shadow_matrix.light = light.light_dir;
 
-  uint8_t *data = 0;
-  {
-    VK_CHECK_RESULT(vkMapMemory(*device(), _light->memory(), 0, sizeof(light), 0, (void **)&data));
-    memcpy(data, &light, sizeof(light));
-  vkUnmapMemory(*device(), _light->memory());
-  }
+  upload_uniforms();
+}
+
+void ShadowView::upload_uniforms()
+{
+  // frames in flight keep reading their own slice, the ring copies these in before the next submit
+  if (!_ring)
+    return;
+  _ring->write(_matrix_block, &_matrix, sizeof(_matrix));
+  _ring->write(_light_block, &light, sizeof(light));
+  _ring->write(_shadow_block, &_shadow_matrix, sizeof(_shadow_matrix));
 }
 
 void ShadowView::resize(int w, int h)
 {
+  // the viewport is recorded into the main pass
+  if (_scene_seg != UINT32_MAX)
+    command_cache()->invalidate(_scene_seg);
   update_ubo();
 }
 
@@ -419,7 +424,35 @@ void ShadowView::update_scene()
       fun();
     }
 
+    ImGui::Text("frame %.2f ms, %u in flight", frame_ms(), frame_count());
+    ImGui::Text("input latency %.1f ms, %.1f inputs per frame", input_latency_ms(), inputs_per_frame());
+
+    // a crowd of small cubes to compare serial and threaded recording of the main pass
+    if (ImGui::SliderInt("crowd", &_crowd, 0, 20000) && _scene_seg != UINT32_MAX)
+      command_cache()->invalidate(_scene_seg);
+    ImGui::SliderInt("threads", &_record_threads, 1, int(recorder()->thread_count()));
+    ImGui::Text("main pass recorded in %.3f ms", _record_ms);
+
+    bool cache = _cache_draws;
+    if (ImGui::Checkbox("cache static draws", &cache))
+      set_cache_draws(cache);
+    auto &cached = command_cache()->stats();
+    ImGui::Text("segments: %u recorded, %u replayed", cached.recorded, cached.replayed);
+
+    if (_graph) {
+      auto &stats = _graph->stats();
+      ImGui::Text("graph: %u passes, %u culled, %u barriers", stats.passes, stats.culled, stats.barriers);
+      ImGui::Text("passes begin with %s", _graph->dynamic_rendering() ? "vkCmdBeginRendering" : "render pass objects");
+      ImGui::Text("transients: %.1f MB in %.1f MB", stats.transient_bytes / 1048576.0, stats.allocated_bytes / 1048576.0);
+    }
+
     ImGui::End();
+
+    auto telemetry = device()->memory_telemetry();
+    telemetry->sample();
+    telemetry->draw();
+    profiler()->draw();
+
     ImGui::EndFrame();
     ImGui::Render();
   }
@@ -435,25 +468,27 @@ void ShadowView::key_up(int key)
     manipulator().rotate(-1, 0);
   else if (key == SDL_SCANCODE_RIGHT)
     manipulator().rotate(1, 0);
+  else if (key == SDL_SCANCODE_M) {
+    auto telemetry = device()->memory_telemetry();
+    telemetry->sample();
+    if (telemetry->dump("memory.json"))
+      std::cout << "memory telemetry written to memory.json" << std::endl;
+  } else if (key == SDL_SCANCODE_T) {
+    if (profiler()->export_trace("gpu_trace.json"))
+      std::cout << "gpu trace written to gpu_trace.json" << std::endl;
+  }
 
   update_ubo();
 }
 
-void ShadowView::create_command_buffers()
-{
-  int count = _swapchain->image_count();
-  if (count != _cmd_bufs.size()) {
-    _cmd_bufs = _device->create_command_buffers(count);
-  }
-}
-
-void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
+void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame)
 {
   tg::mat4 mt;
   mt.identity();
   if (_depth_pipeline && _depth_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_depth_pipeline);
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_shadow_matrix_set, 0, nullptr);
+    uint32_t shadow_offset = _ring->dynamic_offset(frame, _shadow_block);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _depth_pipeline->pipe_layout(), 0, 1, &_shadow_matrix_set, 1, &shadow_offset);
 
     vkCmdPushConstants(cmd_buf, _depth_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
 
@@ -477,112 +512,144 @@ void ShadowView::build_depth_command_buffer(VkCommandBuffer cmd_buf)
       vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offset);
       vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
       vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
+
+      draw_placeholders(cmd_buf, _depth_pipeline->pipe_layout());
     }
 
-    _tree->build_command_buffer(cmd_buf, _depth_pipeline);
+    if (_tree.resident)
+      _tree.mesh->build_command_buffer(cmd_buf, _depth_pipeline);
 
-    _deer->build_command_buffer(cmd_buf, _depth_pipeline);
+    if (_deer.resident)
+      _deer.mesh->build_command_buffer(cmd_buf, _depth_pipeline);
   }
 }
 
-void ShadowView::build_command_buffers()
+void ShadowView::record_frame(VkCommandBuffer cmd_buf, uint32_t image, uint32_t frame)
 {
   if (!_depth_pipeline->valid() || !_shadow_pipeline->valid())
     return;
 
-  vkDeviceWaitIdle(*_device);
-
-  auto &framebuffers = frame_buffers();
-  auto &renderPass = *render_pass();
-  assert(framebuffers.size() == _cmd_bufs.size());
-
-  VkCommandBufferBeginInfo buf_info = {};
-  buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  buf_info.pNext = nullptr;
-
-  VkClearValue clearValues[2];
-
-  VkRenderPassBeginInfo renderPassBeginInfo = {};
-  renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassBeginInfo.pNext = nullptr;
-  renderPassBeginInfo.renderArea.offset.x = 0;
-  renderPassBeginInfo.renderArea.offset.y = 0;
-  renderPassBeginInfo.renderArea.extent.width = _w;
-  renderPassBeginInfo.renderArea.extent.height = _h;
-  renderPassBeginInfo.clearValueCount = 1;
-  renderPassBeginInfo.pClearValues = clearValues;
-
-  for (int i = 0; i < _cmd_bufs.size(); i++) {
-    renderPassBeginInfo.renderPass = *_depth_pass;
-    renderPassBeginInfo.framebuffer = _depth_frames[i];
-    renderPassBeginInfo.renderArea.extent.width = _depth_image->width();
-    renderPassBeginInfo.renderArea.extent.height = _depth_image->height();
-    auto &cmd_buf = _cmd_bufs[i];
-    VK_CHECK_RESULT(vkBeginCommandBuffer(cmd_buf, &buf_info));
-
-    clearValues[0].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 1;
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    build_depth_command_buffer(cmd_buf);
-
-    vkCmdEndRenderPass(cmd_buf);
+  if (!_graph) {
+    _graph = std::make_unique<FrameGraph>(device());
+    _graph->set_profiler(profiler());
+    _graph->set_dynamic_rendering(render_pass()->dynamic());
+  }
 
-    clearValues[0].color = {{0.0, 0.0, 0.2, 1.0}};
-    clearValues[1].depthStencil = {1.f, 0};
-    renderPassBeginInfo.clearValueCount = 2;
+  // declared again every frame, the graph only rebuilds its objects when this changes
+  _graph->reset();
+  auto shadow = _graph->import_image("shadow map", _depth_image.get());
+  auto back = _graph->import_swapchain("back buffer", _swapchain.get());
+  auto depth = _graph->create_image("depth", _swapchain->width(), _swapchain->height(), _depth_format);
 
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = framebuffers[i];
-    renderPassBeginInfo.renderArea.extent.width = width();
-    renderPassBeginInfo.renderArea.extent.height = height();
+  bool cache = _cache_draws;
+  if (cache && _depth_seg == UINT32_MAX) {
+    _depth_seg = command_cache()->create_segment();
+    _scene_seg = command_cache()->create_segment();
+  }
 
-    vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  _graph->add_pass("shadow depth",
+    [&](FrameGraph::Builder &b) {
+      b.depth(shadow);
+      if (cache)
+        b.secondary();
+    },
+    [this, cache](const FrameGraph::Context &ctx) {
+      if (cache)
+        execute_cached(ctx, _depth_seg, [this](VkCommandBuffer cmd, uint32_t frame) { build_depth_command_buffer(cmd, frame); });
+      else
+        build_depth_command_buffer(ctx.cmd, ctx.frame);
+    });
+
+  bool parallel = _record_threads > 1 && _crowd > 0;
+  _graph->add_pass("main",
+    [&](FrameGraph::Builder &b) {
+      b.color(back, {{0.0, 0.0, 0.2, 1.0}});
+      b.depth(depth);
+      b.sample(shadow);
+      if (parallel || cache)
+        b.secondary();
+    },
+    [this, parallel, cache](const FrameGraph::Context &ctx) {
+      auto start = std::chrono::steady_clock::now();
+      if (cache && !parallel) {
+        execute_cached(ctx, _scene_seg, [this](VkCommandBuffer cmd, uint32_t frame) { build_command_buffer(cmd, frame); });
+      } else if (parallel) {
+        auto fn = [this, frame = ctx.frame](VkCommandBuffer cmd, uint32_t begin, uint32_t end) { record_main(cmd, frame, begin, end); };
+        if (ctx.rendering)
+          recorder()->execute(ctx.cmd, ctx.frame, *ctx.rendering, uint32_t(_crowd) + 1, fn, uint32_t(_record_threads));
+        else
+          recorder()->execute(ctx.cmd, ctx.frame, ctx.render_pass, 0, ctx.framebuffer, uint32_t(_crowd) + 1, fn, uint32_t(_record_threads));
+      } else {
+        build_command_buffer(ctx.cmd, ctx.frame);
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      _record_ms = _record_ms * 0.9 + ms * 0.1;
+    });
+
+  _graph->add_pass("hud",
+    [&](FrameGraph::Builder &b) {
+      b.color(back, {}, VK_ATTACHMENT_LOAD_OP_LOAD);
+      b.sample(shadow);
+    },
+    [this](const FrameGraph::Context &ctx) { draw_hud(ctx.cmd); });
+
+  _graph->compile();
+  _graph->execute(cmd_buf, image, frame);
+}
 
-    build_command_buffer(cmd_buf);
+void ShadowView::execute_cached(const FrameGraph::Context &ctx, uint32_t segment, const CommandCache::RecordFn &fn)
+{
+  if (ctx.rendering)
+    command_cache()->execute(ctx.cmd, ctx.frame, segment, *ctx.rendering, fn);
+  else
+    command_cache()->execute(ctx.cmd, ctx.frame, segment, ctx.render_pass, 0, fn);
+}
 
-    vkCmdEndRenderPass(cmd_buf);
+void ShadowView::set_cache_draws(bool cache)
+{
+  if (cache == _cache_draws)
+    return;
+  _cache_draws = cache;
+  // nothing is recorded into the segments while they are off
+  command_cache()->invalidate_all();
+}
 
-    {
-      renderPassBeginInfo.renderPass = *_hud_pass;
-      renderPassBeginInfo.framebuffer = _hud_frames[i];
-      renderPassBeginInfo.clearValueCount = 0;
-      vkCmdBeginRenderPass(cmd_buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-      {
-        VkViewport viewport = {};
-        viewport.width = _w;
-        viewport.height = _h;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-      }
+void ShadowView::draw_hud(VkCommandBuffer cmd_buf)
+{
+  {
+    VkViewport viewport = {};
+    viewport.width = _w;
+    viewport.height = _h;
+    viewport.minDepth = 0;
+    viewport.maxDepth = 1;
+    vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+  }
 
-      {
-        VkRect2D scissor = {};
-        scissor.extent.width = _w;
-        scissor.extent.height = _h;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
-      }
+  {
+    VkRect2D scissor = {};
+    scissor.extent.width = _w;
+    scissor.extent.height = _h;
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+  }
 
-      vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_hud_pipeline);
-      tg::mat4 mat;
-      mat.identity();
-      mat[0][0] = 2.0 / width();
-      mat[1][1] = 2.0 / height();
-      mat = tg::translate(-1.f, -1.f, 0.f) * mat;
-      vkCmdPushConstants(cmd_buf, _hud_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat), &mat);
-      _hud_rect->fill_command(cmd_buf, _hud_pipeline.get());
-      vkCmdEndRenderPass(cmd_buf);
-    }
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_hud_pipeline);
+  tg::mat4 mat;
+  mat.identity();
+  mat[0][0] = 2.0 / width();
+  mat[1][1] = 2.0 / height();
+  mat = tg::translate(-1.f, -1.f, 0.f) * mat;
+  vkCmdPushConstants(cmd_buf, _hud_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat), &mat);
+  _hud_rect->fill_command(cmd_buf, _hud_pipeline.get());
+}
 
-    VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buf));
-  }
+void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame)
+{
+  record_main(cmd_buf, frame, 0, uint32_t(_crowd) + 1);
 }
 
-void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf) 
+void ShadowView::record_main(VkCommandBuffer cmd_buf, uint32_t frame, uint32_t begin, uint32_t end)
 {
   tg::mat4 mt;
   mt.identity();
@@ -608,9 +675,9 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
   if (_shadow_pipeline && _shadow_pipeline->valid()) {
     vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, *_shadow_pipeline);
 
-    uint32_t offset[1] = {};
+    uint32_t offset[3] = {_ring->dynamic_offset(frame, _matrix_block), _ring->dynamic_offset(frame, _light_block), 0};
     VkDescriptorSet dessets[3] = {_matrix_set, _light_set, _pbr_set};
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 1, offset);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 0, 3, dessets, 3, offset);
 
     VkWriteDescriptorSet texture_set = {};
     texture_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -622,7 +689,8 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
     texture_set.pImageInfo = &descriptor;
     _device->vkCmdPushDescriptorSetKHR(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 3, 1, &texture_set);
 
-    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_matrix_set, 0, 0);
+    uint32_t shadow_offset = _ring->dynamic_offset(frame, _shadow_block);
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 4, 1, &_shadow_matrix_set, 1, &shadow_offset);
     vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadow_pipeline->pipe_layout(), 5, 1, &_shadow_texture_set, 0, 0);
 
     vkCmdPushConstants(cmd_buf, _shadow_pipeline->pipe_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
@@ -636,66 +704,90 @@ void ShadowView::build_command_buffer(VkCommandBuffer cmd_buf)
 
       vkCmdBindVertexBuffers(cmd_buf, 0, 3, bufs, offset);
       vkCmdBindIndexBuffer(cmd_buf, _index_buf, 0, VK_INDEX_TYPE_UINT16);
-      vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
+      if (begin == 0) {
+        vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
+        draw_placeholders(cmd_buf, _shadow_pipeline->pipe_layout());
+      }
+
+      draw_crowd(cmd_buf, _shadow_pipeline->pipe_layout(), std::max(begin, 1u) - 1, end - 1);
     }
   }
 
-  _tree->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+  // the meshes rebind the geometry, they come last in the chunk holding item 0
+  if (begin > 0)
+    return;
+
+  if (_tree.resident)
+    _tree.mesh->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
 
-  _deer->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
+  if (_deer.resident)
+    _deer.mesh->build_command_buffer(cmd_buf, std::static_pointer_cast<TexturePipeline>(_shadow_pipeline));
 }
 
-void ShadowView::create_pipe_layout()
+void ShadowView::draw_crowd(VkCommandBuffer cmd_buf, VkPipelineLayout layout, uint32_t first, uint32_t last)
 {
-  VkDescriptorPoolSize typeCounts[1];
-  typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  typeCounts[0].descriptorCount = 10;
+  // a square grid of small cubes around the origin, one draw each
+  uint32_t side = uint32_t(std::ceil(std::sqrt(float(_crowd))));
+  for (uint32_t i = first; i < last; i++) {
+    float x = (float(i % side) - side * 0.5f) * 0.4f;
+    float y = (float(i / side) - side * 0.5f) * 0.4f;
+    tg::mat4 mt = tg::mat4(tg::translate(tg::vec3(x, y, 1)) * tg::scale(tg::vec3(0.01, 0.01, 0.1)));
+    vkCmdPushConstants(cmd_buf, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
+    vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
+  }
+}
 
-  VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
-  descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  descriptorPoolInfo.pNext = nullptr;
-  descriptorPoolInfo.poolSizeCount = 1;
-  descriptorPoolInfo.pPoolSizes = typeCounts;
-  descriptorPoolInfo.maxSets = 10;
+void ShadowView::draw_placeholders(VkCommandBuffer cmd_buf, VkPipelineLayout layout)
+{
+  // a unit cube stands in for every mesh still loading, it reuses the bound ground box geometry
+  for (auto *m : {&_tree, &_deer}) {
+    if (m->resident)
+      continue;
+    tg::mat4 mt = tg::mat4(tg::translate(m->pos + tg::vec3(0, 0, 0.5)) * tg::scale(tg::vec3(0.05, 0.05, 0.5)));
+    vkCmdPushConstants(cmd_buf, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Transform), &mt);
+    vkCmdDrawIndexed(cmd_buf, _index_count, 1, 0, 0, 0);
+  }
+}
 
-  VkDescriptorPool desPool;
-  VK_CHECK_RESULT(vkCreateDescriptorPool(*device(), &descriptorPoolInfo, nullptr, &desPool));
-  _descript_pool = desPool;
+bool ShadowView::poll_resources()
+{
+  bool changed = false;
+  for (auto *m : {&_tree, &_deer}) {
+    if (!m->mesh && m->load.valid() && m->load.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      m->mesh = m->load.get();
+      m->load = {};
+      if (m->mesh) {
+        m->mesh->set_transform(m->transform);
+        m->mesh->realize_async(_device, _shadow_pipeline);
+      } else {
+        std::cerr << "mesh failed to load, keeping the placeholder" << std::endl;
+      }
+    }
+    if (m->mesh && !m->resident && m->mesh->resident()) {
+      m->resident = true;
+      changed = true;
+    }
+  }
+  // the shadow frustum is fitted to the mesh bounds, and the meshes replace their placeholders in every pass
+  if (changed) {
+    update_ubo();
+    command_cache()->invalidate_all();
+  }
+  return changed;
+}
+
+void ShadowView::create_pipe_layout()
+{
+  // the view's sets are made once and never freed on their own
+  _descriptors = std::make_unique<DescriptorAllocator>(device(), false,
+    std::vector<DescriptorAllocator::Hint>{{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1}, {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}}, 8);
 
   //----------------------------------------------------------------------------------------------------
-  auto mlayout = _shadow_pipeline->matrix_layout();
-  auto llayout = _shadow_pipeline->light_layout();
-  auto playout = _shadow_pipeline->pbr_layout();
-
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = desPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &mlayout;
-
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_matrix_set));
-
-  allocInfo.pSetLayouts = &llayout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_light_set));
-
-  allocInfo.pSetLayouts = &playout;
-  VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_pbr_set));
-
-  VkDescriptorBufferInfo descriptor = {};
-  int sz = sizeof(_matrix);
-  _ubo_buf = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  descriptor.buffer = *_ubo_buf;
-  descriptor.offset = 0;
-  descriptor.range = sizeof(_matrix);
-
-  sz = sizeof(light);
-  VkDescriptorBufferInfo ldescriptor = {};
-  _light = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
-  ldescriptor.buffer = *_light;
-  ldescriptor.offset = 0;
-  ldescriptor.range = sz;
-
-  sz = sizeof(pbr);
+  _matrix_set = _descriptors->allocate(_shadow_pipeline->matrix_layout());
+  _light_set = _descriptors->allocate(_shadow_pipeline->light_layout());
+  _pbr_set = _descriptors->allocate(_shadow_pipeline->pbr_layout());
+
+  int sz = sizeof(pbr);
   VkDescriptorBufferInfo mdescriptor = {};
   _material = device()->create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sz);
   mdescriptor.buffer = *_material;
@@ -704,18 +796,7 @@ void ShadowView::create_pipe_layout()
 
   VkWriteDescriptorSet writeDescriptorSet = {};
   writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  writeDescriptorSet.dstSet = _matrix_set;
   writeDescriptorSet.descriptorCount = 1;
-  writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  writeDescriptorSet.pBufferInfo = &descriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
-  writeDescriptorSet.dstSet = _light_set;
-  writeDescriptorSet.pBufferInfo = &ldescriptor;
-  writeDescriptorSet.dstBinding = 0;
-  vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-
   writeDescriptorSet.dstSet = _pbr_set;
   writeDescriptorSet.pBufferInfo = &mdescriptor;
   writeDescriptorSet.dstBinding = 0;
@@ -754,138 +835,71 @@ void ShadowView::create_pipe_layout()
 
 void ShadowView::create_frame_buffers()
 {
-  {
-    auto view = _depth_image->image_view();
-    VkFramebufferCreateInfo frameBufferCreateInfo = {};
-    frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    frameBufferCreateInfo.pNext = NULL;
-    frameBufferCreateInfo.renderPass = *_depth_pass;
-    frameBufferCreateInfo.attachmentCount = 1;
-    frameBufferCreateInfo.pAttachments = &view;
-    frameBufferCreateInfo.width = _depth_image->width();
-    frameBufferCreateInfo.height = _depth_image->height();
-    frameBufferCreateInfo.layers = 1;
-
-    for (int i = 0; i < _depth_frames.size(); i++)
-      vkDestroyFramebuffer(*device(), _depth_frames[i], 0);
-
-    _depth_frames.resize(_swapchain->image_count());
-    for (int i = 0; i < _depth_frames.size(); i++) {
-      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &_depth_frames[i]));
-    }
-  }
-
-  VkImageView attachments[2];
-  attachments[1] = _depth->image_view();
-
-  VkFramebufferCreateInfo frameBufferCreateInfo = {};
-  frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  frameBufferCreateInfo.pNext = NULL;
-  frameBufferCreateInfo.renderPass = *render_pass();
-  frameBufferCreateInfo.attachmentCount = 2;
-  frameBufferCreateInfo.pAttachments = attachments;
-  frameBufferCreateInfo.width = _w;
-  frameBufferCreateInfo.height = _h;
-  frameBufferCreateInfo.layers = 1;
-
-  std::vector<VkFramebuffer> frameBuffers;
-  frameBuffers.resize(_swapchain->image_count());
-  for (uint32_t i = 0; i < frameBuffers.size(); i++) {
-    attachments[0] = _swapchain->image_view(i);
-    VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
-  }
-
-  set_frame_buffers(frameBuffers);
+  // render passes, framebuffers and the main depth buffer all come from the frame graph
+}
 
-  {
-    for (int i = 0; i < _hud_frames.size(); i++)
-      vkDestroyFramebuffer(*device(), _hud_frames[i], 0);
-
-    VkFramebufferCreateInfo frameBufferCreateInfo = {};
-    frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    frameBufferCreateInfo.pNext = NULL;
-    frameBufferCreateInfo.renderPass = *_hud_pass;
-    frameBufferCreateInfo.attachmentCount = 1;
-    frameBufferCreateInfo.width = _w;
-    frameBufferCreateInfo.height = _h;
-    frameBufferCreateInfo.layers = 1;
-
-    std::vector<VkFramebuffer> frameBuffers;
-    frameBuffers.resize(_swapchain->image_count());
-    for (uint32_t i = 0; i < frameBuffers.size(); i++) {
-      VkImageView img = _swapchain->image_view(i);
-      frameBufferCreateInfo.pAttachments = &img; 
-      VK_CHECK_RESULT(vkCreateFramebuffer(*_device, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
-    }
-    _hud_frames = std::move(frameBuffers);
-  }
+void ShadowView::set_dynamic_rendering(bool dynamic)
+{
+  _depth_pass->set_dynamic(dynamic);
+  render_pass()->set_dynamic(dynamic);
+  _hud_pass->set_dynamic(dynamic);
 }
 
 void ShadowView::create_pipeline()
 {
-  if (_depth_pipeline) {
-    _depth_pipeline->realize(_depth_pass.get());
-
-    auto des_layout = _depth_pipeline->matrix_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &des_layout;
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_matrix_set));
-
-    int sz = sizeof(_shadow_matrix);
-    VkDescriptorBufferInfo descriptor = {};
-    descriptor.buffer = *_shadow_buf;
-    descriptor.offset = 0;
-    descriptor.range = sz;
-
+  // the ring is sized by the frames in flight, so the per frame blocks are set up here
+  if (!_ring) {
+    _ring = uniforms();
+    _matrix_block = _ring->allocate(sizeof(_matrix));
+    _light_block = _ring->allocate(sizeof(light));
+    _shadow_block = _ring->allocate(sizeof(_shadow_matrix));
+
+    VkDescriptorBufferInfo descriptor = _ring->descriptor(sizeof(_matrix));
     VkWriteDescriptorSet writeDescriptorSet = {};
     writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = _shadow_matrix_set;
+    writeDescriptorSet.dstSet = _matrix_set;
     writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     writeDescriptorSet.pBufferInfo = &descriptor;
     writeDescriptorSet.dstBinding = 0;
     vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-  }
 
-  _shadow_pipeline->realize(render_pass());
+    VkDescriptorBufferInfo ldescriptor = _ring->descriptor(sizeof(light));
+    writeDescriptorSet.dstSet = _light_set;
+    writeDescriptorSet.pBufferInfo = &ldescriptor;
+    vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
 
-  _tree->realize(_device, _shadow_pipeline);
+    upload_uniforms();
 
-  _deer->realize(_device, _shadow_pipeline);
+    // the sets only point at the ring and the shadow map, a rebuilt pipeline keeps using them
+    if (_depth_pipeline) {
+      _shadow_matrix_set = _descriptors->allocate(_depth_pipeline->matrix_layout());
 
-  {
-    auto slayout = _shadow_pipeline->shadow_texture_layout();
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = _descript_pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &slayout;
+      VkDescriptorBufferInfo sdescriptor = _ring->descriptor(sizeof(_shadow_matrix));
+      writeDescriptorSet.dstSet = _shadow_matrix_set;
+      writeDescriptorSet.pBufferInfo = &sdescriptor;
+      vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
+    }
 
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device(), &allocInfo, &_shadow_texture_set));
+    _shadow_texture_set = _descriptors->allocate(_shadow_pipeline->shadow_texture_layout());
 
     _shadow_texture = std::make_shared<VulkanTexture>();
     _shadow_texture->realize(_depth_image);
     VkDescriptorImageInfo depthDescriptor = _shadow_texture->descriptor();
 
-    VkWriteDescriptorSet writeDescriptorSet = {};
-    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeDescriptorSet.dstSet = _shadow_texture_set;
-    writeDescriptorSet.descriptorCount = 1;
     writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     writeDescriptorSet.pBufferInfo = 0;
-    writeDescriptorSet.dstBinding = 0;
     writeDescriptorSet.pImageInfo = &depthDescriptor;
     vkUpdateDescriptorSets(*device(), 1, &writeDescriptorSet, 0, nullptr);
-  }
 
-  {
-    _hud_pipeline->realize(_hud_pass.get());
-    _hud_rect->setTexture(_hud_pipeline.get(), _shadow_texture.get(), _descript_pool);
+    _hud_rect->setTexture(_hud_pipeline.get(), _shadow_texture.get(), _descriptors.get());
   }
 
-  build_command_buffers();
+  if (_depth_pipeline)
+    _depth_pipeline->realize(_depth_pass.get());
+
+  _shadow_pipeline->realize(render_pass());
+
+  _hud_pipeline->realize(_hud_pass.get());
 }
@@ -9,6 +9,10 @@
 #include "HUDPass.h"
 #include "HUDPipeline.h"
 #include "HUDRect.h"
+#include "FrameGraph.h"
+#include "CommandCache.h"
+
+#include <future>
 
 class ShadowView : public VulkanView {
 public:
@@ -20,34 +24,56 @@ public:
   void set_uniforms();
   void update_ubo();
   void update_light();
+  void upload_uniforms();
 
   void resize(int w, int h);
   void update_scene();
+  bool poll_resources() override;
 
   void left_dn(int x, int y) { update_ubo(); }
   void wheel(int delta) { update_ubo(); }
   void left_drag(int x, int y, int, int) { update_ubo(); }
   void right_drag(int x, int y, int, int) { update_ubo(); }
+  void view_changed() override { update_ubo(); }
   void key_up(int key);
 
-  void create_command_buffers();
-  void build_depth_command_buffer(VkCommandBuffer cmd_buf);
-
-  void build_command_buffers();
-  void build_command_buffer(VkCommandBuffer cmd_buf) override;
+  void build_depth_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame);
+  void draw_placeholders(VkCommandBuffer cmd_buf, VkPipelineLayout layout);
+  void draw_crowd(VkCommandBuffer cmd_buf, VkPipelineLayout layout, uint32_t first, uint32_t last);
+  void draw_hud(VkCommandBuffer cmd_buf);
+  // replays segment inside the pass ctx began, recording it with fn first when it is stale
+  void execute_cached(const FrameGraph::Context &ctx, uint32_t segment, const CommandCache::RecordFn &fn);
+
+  void record_frame(VkCommandBuffer cmd_buf, uint32_t image, uint32_t frame) override;
+  void build_command_buffer(VkCommandBuffer cmd_buf) override { build_command_buffer(cmd_buf, 0); }
+  void build_command_buffer(VkCommandBuffer cmd_buf, uint32_t frame);
+  // items [begin, end) of the main pass, item 0 is the scene and the rest the crowd
+  void record_main(VkCommandBuffer cmd_buf, uint32_t frame, uint32_t begin, uint32_t end);
   void create_pipe_layout();
   void create_frame_buffers();
   void create_pipeline();
+  // the shadow depth pass and the serial main pass replay cached segments, re-recorded only on invalidate
+  void set_cache_draws(bool cache);
+  // every pass goes through dynamic rendering, call before create_pipeline
+  void set_dynamic_rendering(bool dynamic);
 
 private:
+  struct SceneMesh {
+    std::shared_future<std::shared_ptr<MeshInstance>> load;
+    std::shared_ptr<MeshInstance> mesh;
+    tg::vec3 pos;
+    tg::mat4 transform;
+    bool resident = false;
+  };
+
   VkBuffer _vert_buf;
   VkDeviceMemory _vert_mem;
   VkBuffer _index_buf;
   VkDeviceMemory _index_mem;
 
-  VkDescriptorPool _descript_pool = VK_NULL_HANDLE;
+  std::unique_ptr<DescriptorAllocator> _descriptors;
 
-  std::vector<VkFramebuffer> _depth_frames;
+  // the passes only give the pipelines compatible render passes or attachment formats, the graph begins its own
   std::shared_ptr<DepthPass> _depth_pass;
 
   std::shared_ptr<ShadowPipeline> _shadow_pipeline;
@@ -63,24 +89,37 @@ private:
   ShadowMatrix _shadow_matrix;
   VkDescriptorSet _shadow_matrix_set = VK_NULL_HANDLE;
   VkDescriptorSet _shadow_texture_set = VK_NULL_HANDLE;
-  std::shared_ptr<VulkanBuffer> _shadow_buf;
   std::shared_ptr<VulkanTexture> _shadow_texture;
 
-  std::shared_ptr<VulkanBuffer> _ubo_buf, _light, _material;
+  std::shared_ptr<VulkanBuffer> _material;
+
+  // matrix, light and shadow matrix live in the view's uniform ring once the swapchain exists
+  UniformRing *_ring = nullptr;
+  VkDeviceSize _matrix_block = 0, _light_block = 0, _shadow_block = 0;
 
   MVP _matrix;
 
   uint32_t _vert_count = 0;
   uint32_t _index_count = 0;
 
-  std::shared_ptr<MeshInstance> _tree, _deer;
+  SceneMesh _tree, _deer;
 
   std::shared_ptr<VulkanTexture> _basic_texture;
 
-  std::vector<VkFramebuffer> _hud_frames;
   std::shared_ptr<HUDPass> _hud_pass;
   std::shared_ptr<HUDPipeline> _hud_pipeline;
   std::shared_ptr<HUDRect> _hud_rect;
 
   tg::vec2 _light_dir = tg::vec2(90, 45);
+
+  int _crowd = 0;
+  int _record_threads = 1;
+  double _record_ms = 0;
+
+  bool _cache_draws = true;
+  // the shadow depth pass and the main pass, created on first use. the depth segment changes only with
+  // the meshes, the scene segment also with the crowd and the viewport
+  uint32_t _depth_seg = UINT32_MAX, _scene_seg = UINT32_MAX;
+
+  std::unique_ptr<FrameGraph> _graph;
 };
\ No newline at end of file
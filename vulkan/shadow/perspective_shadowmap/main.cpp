@@ -1,3 +1,4 @@
+#include <cstring>
 #include <exception>
 #include <stdexcept>
 
@@ -8,36 +9,134 @@
 
 #include "ShadowView.h"
 #include "VulkanInstance.h"
+#include "VulkanDevice.h"
+#include "Benchmark.h"
+
+struct Options {
+  // no window, frames are rendered offscreen
+  bool headless = false;
+  int frames = 600;
+  // frames rendered before the benchmark starts, the meshes load in the meantime
+  int warmup = 100;
+  const char *capture = nullptr;
+  const char *benchmark = nullptr;
+  // camera path played by the benchmark, an orbit when not given
+  const char *path = nullptr;
+  // camera path recorded while the demo runs interactively
+  const char *record = nullptr;
+  // passes begin with vkCmdBeginRendering, benchmark with and without to compare
+  bool dynamic = false;
+};
+
+// demo [--headless] [--frames n] [--warmup n] [--capture out.png] [--benchmark out.json] [--path in.txt] [--record out.txt]
+//      [--dynamic]
+static Options parse_options(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    bool more = i + 1 < argc;
+    if (strcmp(argv[i], "--headless") == 0)
+      opt.headless = true;
+    else if (strcmp(argv[i], "--frames") == 0 && more)
+      opt.frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--warmup") == 0 && more)
+      opt.warmup = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--capture") == 0 && more)
+      opt.capture = argv[++i];
+    else if (strcmp(argv[i], "--benchmark") == 0 && more)
+      opt.benchmark = argv[++i];
+    else if (strcmp(argv[i], "--path") == 0 && more)
+      opt.path = argv[++i];
+    else if (strcmp(argv[i], "--record") == 0 && more)
+      opt.record = argv[++i];
+    else if (strcmp(argv[i], "--dynamic") == 0)
+      opt.dynamic = true;
+  }
+  return opt;
+}
 
 int main(int argc, char **argv)
 {
+  auto opt = parse_options(argc, argv);
+
   SDL_Window *win = 0;
   VkSurfaceKHR surface = 0;
+  std::shared_ptr<VulkanDevice> dev;
   std::shared_ptr<ShadowView> view = 0;
   try {
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-      throw std::runtime_error("sdl init error.");
-    win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
-    if (win == nullptr)
-      throw std::runtime_error("could not create sdl window.");
+    auto &inst = VulkanInstance::instance();
 
-    int w = 0, h = 0;
-    SDL_GetWindowSize(win, &w, &h);
+    int w = 800, h = 600;
+    if (!opt.headless) {
+      if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        throw std::runtime_error("sdl init error.");
+      win = SDL_CreateWindow("demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, w, h, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+      if (win == nullptr)
+        throw std::runtime_error("could not create sdl window.");
 
-    auto &inst = VulkanInstance::instance();
-    if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
-      throw std::runtime_error("could not create vk surface.");
+      SDL_GetWindowSize(win, &w, &h);
+
+      if (!SDL_Vulkan_CreateSurface(win, inst, &surface))
+        throw std::runtime_error("could not create vk surface.");
+    }
 
     inst.enable_debug();
-    auto dev = inst.create_device("NVIDIA");
+    // a ci machine may only have a software device
+    dev = inst.create_device(opt.headless ? "" : "NVIDIA");
+#ifndef NDEBUG
+    // edit and recompile a baselib shader while the demo runs
+    dev->shaders()->watch(ROOT_DIR "/vulkan/baselib/shaders");
+#endif
 
     view = std::make_shared<ShadowView>(dev);
-    view->set_surface(surface, w, h);
+    if (opt.headless)
+      view->set_offscreen(w, h);
+    else
+      view->set_surface(surface, w, h);
+    if (opt.dynamic)
+      view->set_dynamic_rendering(true);
     view->create_pipeline();
   } catch (std::runtime_error &e) {
     printf("%s", e.what());
     return -1;
   }
+
+  if (opt.headless || opt.benchmark) {
+    // an explicit path that does not load fails up front, before the warmup
+    CameraPath path = CameraPath::orbit(tg::vec3(0), 20, 10);
+    if (opt.benchmark && opt.path && !path.load(opt.path)) {
+      printf("could not load camera path %s", opt.path);
+      return -1;
+    }
+
+    int frames = opt.benchmark ? opt.warmup : opt.frames;
+    for (int i = 0; i < frames; i++) {
+      view->poll_resources();
+      view->poll_shaders();
+      view->render();
+    }
+
+    if (opt.benchmark) {
+      if (!view->benchmark(path, uint32_t(opt.frames), opt.benchmark)) {
+        printf("could not write %s", opt.benchmark);
+        return -1;
+      }
+    }
+
+    if (opt.capture && !view->capture(opt.capture)) {
+      printf("could not write %s", opt.capture);
+      return -1;
+    }
+    return 0;
+  }
+
+  CameraPath recorded;
+  if (opt.record)
+    view->record_path(&recorded);
   view->frame();
+  if (opt.record) {
+    view->record_path(nullptr);
+    recorded.save(opt.record);
+  }
   return 0;
-}
\ No newline at end of file
+}
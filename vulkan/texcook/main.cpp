@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "stb_image.h"
+
+#include "BlockCompressor.h"
+#include "TextureTools.h"
+
+// texcook input.png output.ktx2 [bc1|bc3|bc5|bc7] [--srgb] [--threads n]
+int main(int argc, char **argv)
+{
+  if (argc < 3) {
+    printf("usage: %s input output.ktx2 [bc1|bc3|bc5|bc7] [--srgb] [--threads n]\n", argv[0]);
+    return -1;
+  }
+
+  tex::BlockFormat format = tex::BlockFormat::BC7;
+  bool srgb = false;
+  uint32_t threads = 0;
+  for (int i = 3; i < argc; i++) {
+    if (!strcmp(argv[i], "bc1"))
+      format = tex::BlockFormat::BC1;
+    else if (!strcmp(argv[i], "bc3"))
+      format = tex::BlockFormat::BC3;
+    else if (!strcmp(argv[i], "bc5"))
+      format = tex::BlockFormat::BC5;
+    else if (!strcmp(argv[i], "bc7"))
+      format = tex::BlockFormat::BC7;
+    else if (!strcmp(argv[i], "--srgb"))
+      srgb = true;
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+  }
+
+  int w = 0, h = 0, n = 0;
+  uint8_t *data = stbi_load(argv[1], &w, &h, &n, 4);
+  if (!data) {
+    printf("could not load %s\n", argv[1]);
+    return -1;
+  }
+
+  std::vector<uint8_t> chain;
+  auto levels = tex::build_mip_chain(data, w, h, 4, chain);
+  stbi_image_free(data);
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto img = tex::compress(chain.data(), levels, format, threads);
+  auto t1 = std::chrono::steady_clock::now();
+
+  std::vector<uint8_t> decoded(size_t(w) * h * 4);
+  tex::decompress(img.data.data(), w, h, format, decoded.data());
+  double quality = tex::psnr(chain.data(), decoded.data(), w, h, format);
+
+  if (!tex::write_ktx2(argv[2], img, srgb))
+    return -1;
+
+  double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+  printf("%s: %dx%d, %zu levels\n", argv[2], w, h, levels.size());
+  printf("  rgba8 %zu bytes -> compressed %zu bytes (%.2f:1)\n", chain.size(), img.data.size(),
+    double(chain.size()) / double(img.data.size()));
+  printf("  psnr %.2f dB, %.1f ms\n", quality, ms);
+  return 0;
+}